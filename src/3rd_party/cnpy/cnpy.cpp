@@ -11,6 +11,23 @@
 #include <sstream>
 #include <exception>
 
+// fseek()/ftell() use long, which is 32-bit on Windows, so seek with 64-bit offsets in the npz index
+static int fseek64(FILE* fp, int64_t offset, int origin) {
+#ifdef _MSC_VER
+    return _fseeki64(fp,offset,origin);
+#else
+    return fseeko(fp,(off_t)offset,origin);
+#endif
+}
+
+static int64_t ftell64(FILE* fp) {
+#ifdef _MSC_VER
+    return _ftelli64(fp);
+#else
+    return (int64_t)ftello(fp);
+#endif
+}
+
 char cnpy::BigEndianTest() {
     unsigned char x[] = {1,0};
     short y;
@@ -267,6 +284,58 @@ cnpy::NpyArrayPtr cnpy::npz_load(std::string fname, std::string varname) {
     throw std::runtime_error(ss.str());
 }
 
+std::vector<cnpy::NpzEntry> cnpy::npz_index(std::string fname) {
+    FILE* fp = fopen(fname.c_str(),"rb");
+
+    if(!fp) {
+        printf("npz_index: Error! Unable to open file %s!\n",fname.c_str());
+        abort();
+    }
+
+    std::vector<NpzEntry> entries;
+    while(1) {
+        std::vector<char> local_header(30);
+        size_t header_res = fread(&local_header[0],sizeof(char),30,fp);
+        if(header_res != 30)
+            throw std::runtime_error("npz_index: failed fread");
+
+        //if we've reached the global header, stop reading
+        if(local_header[2] != 0x03 || local_header[3] != 0x04) break;
+
+        unsigned short compression = *(unsigned short*) &local_header[8];
+        if(compression != 0)
+            throw std::runtime_error("npz_index: compressed arrays are not supported");
+
+        //read in the variable name
+        unsigned short name_len = *(unsigned short*) &local_header[26];
+        std::string vname(name_len,' ');
+        size_t vname_res = fread(&vname[0],sizeof(char),name_len,fp);
+        if(vname_res != name_len)
+            throw std::runtime_error("npz_index: failed fread");
+        vname.erase(vname.end()-4,vname.end()); //erase the lagging .npy
+
+        //skip past the extra field
+        unsigned short extra_field_len = *(unsigned short*) &local_header[28];
+        fseek64(fp,extra_field_len,SEEK_CUR);
+
+        entries.push_back({vname, ftell64(fp)});
+
+        //skip past the data
+        unsigned int size = *(unsigned int*) &local_header[22];
+        if(fseek64(fp,size,SEEK_CUR) != 0)
+            throw std::runtime_error("npz_index: failed fseek");
+    }
+
+    fclose(fp);
+    return entries;
+}
+
+cnpy::NpyArrayPtr cnpy::npz_load(FILE* fp, const NpzEntry& entry) {
+    if(fseek64(fp,entry.offset,SEEK_SET) != 0)
+        throw std::runtime_error("npz_load: failed fseek");
+    return load_the_npy_file(fp);
+}
+
 cnpy::NpyArrayPtr cnpy::npy_load(std::string fname) {
 
     FILE* fp = fopen(fname.c_str(), "rb");
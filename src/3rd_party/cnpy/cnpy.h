@@ -12,6 +12,7 @@
 #include<sstream>
 #include<vector>
 #include<cstdio>
+#include<cstdint>
 #include<typeinfo>
 #include<iostream>
 #include<cassert>
@@ -58,6 +59,12 @@ namespace cnpy {
     typedef std::shared_ptr<NpyArray> NpyArrayPtr;
     typedef std::map<std::string, NpyArrayPtr> npz_t;
 
+    // Location of an (uncompressed) array inside of a npz file
+    struct NpzEntry {
+        std::string name;
+        int64_t offset; // start of the npy header, 64-bit for models larger than 2GB
+    };
+
     char BigEndianTest();
     char map_type(const std::type_info& t);
     static inline std::vector<char> create_npy_header(char type, size_t word_size, const unsigned int* shape, const unsigned int ndims);
@@ -66,6 +73,8 @@ namespace cnpy {
     void parse_zip_footer(FILE* fp, unsigned short& nrecs, unsigned int& global_header_size, unsigned int& global_header_offset);
     npz_t npz_load(std::string fname);
     NpyArrayPtr npz_load(std::string fname, std::string varname);
+    std::vector<NpzEntry> npz_index(std::string fname);
+    NpyArrayPtr npz_load(FILE* fp, const NpzEntry& entry);
     NpyArrayPtr npy_load(std::string fname);
 
     template<typename T> std::vector<char>& operator+=(std::vector<char>& lhs, const T rhs) {
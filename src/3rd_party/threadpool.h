@@ -56,6 +56,10 @@ class ThreadPool {
       return tasks.size();
     }
 
+    size_t getNumThreads() const {
+      return workers.size();
+    }
+
     void wait_for_one(std::unique_lock<std::mutex>& lock) {
       waiting_threads++;
       sync_condition.notify_all();
@@ -3,8 +3,11 @@
 #include "tensors/cpu/expression_graph_packable.h"
 #include "onnx/expression_graph_onnx_exporter.h"
 #include "layers/lsh.h"
+#include "layers/hnsw.h"
 #include "data/shortlist.h"
+#include "data/shortlist_builder.h"
 #include <sstream>
+#include <thread>
 
 int main(int argc, char** argv) {
   using namespace marian;
@@ -17,22 +20,59 @@ int main(int argc, char** argv) {
     auto cli = New<cli::CLIWrapper>(
         config,
         "Convert a model in the .npz format and normal memory layout to a mmap-able binary model which could be in normal memory layout or packed memory layout\n"
-        "or convert a text lexical shortlist to a binary shortlist with {--shortlist,-s} option",
+        "or convert a text lexical shortlist to a binary shortlist with {--shortlist,-s} option\n"
+        "or build a binary shortlist from a sentence-aligned corpus with --build-shortlist",
         "Allowed options",
         "Examples:\n"
-        "  ./marian-conv -f model.npz -t model.bin --gemm-type packed16");
+        "  ./marian-conv -f model.npz -t model.bin --gemm-type packed16\n"
+        "  ./marian-conv --build-shortlist corpus.es corpus.en -d lex.esen.bin --vocabs vocab.esen.spm vocab.esen.spm");
     cli->add<std::string>("--from,-f", "Input model", "model.npz");
     cli->add<std::string>("--to,-t", "Output model", "model.bin");
     cli->add<std::string>("--export-as", "Kind of conversion: marian-bin or onnx-{encode,decoder-step,decoder-init,decoder-stop}", "marian-bin");
     cli->add<std::string>("--gemm-type,-g", "GEMM Type to be used: float32, packed16, packed8avx2, packed8avx512, "
-                          "intgemm8, intgemm8ssse3, intgemm8avx2, intgemm8avx512, intgemm16, intgemm16sse2, intgemm16avx2, intgemm16avx512", 
+                          "intgemm8, intgemm8ssse3, intgemm8avx2, intgemm8avx512, intgemm16, intgemm16sse2, intgemm16avx2, intgemm16avx512, "
+                          "int4 (group-wise 4-bit weights, dequantized inside the GEMM)", 
                           "float32");
+    cli->add<float>("--quantize-range",
+                    "Quantize packed8 matrices per column from mean +/- arg standard deviations instead of min/max, 0.0 means min/max", 
+                    0.f);
+    cli->add<float>("--max-quantization-error",
+                    "Fail the conversion if the relative squared quantization error of any packed8 matrix exceeds arg, 0.0 disables the check",
+                    0.f);
+    cli->add<std::vector<std::string>>("--precision-map",
+                                       "Per-matrix GEMM types overriding --gemm-type, given as regex:type, "
+                                       "e.g. 'ffn_W[12]$:int4' 'Wemb:float32'. The first matching rule is used");
+    cli->add<bool>("--sensitivity-report",
+                   "Log the relative int4 and int8 quantization error of every matrix before converting. "
+                   "With --max-quantization-error also suggest rules for --precision-map");
+    cli->add<bool>("--compress",
+                   "Compress the items of the *.bin model (byte shuffling and zlib), they are decompressed in parallel when loading. "
+                   "Compressed models cannot be memory-mapped");
+    cli->add<bool>("--deduplicate",
+                   "Store byte-identical matrices only once and reference them from all their names. "
+                   "Memory-mapped models then also share the memory of these matrices");
     cli->add<std::vector<std::string>>("--add-lsh", 
                                        "Encode output matrix and optional rotation matrix into model file. "
                                        "arg1: number of bits in LSH encoding, arg2: name of output weights matrix")->implicit_val("1024 Wemb");
+    cli->add<std::vector<std::string>>("--add-hnsw",
+                                       "Build an HNSW graph over the output matrix for --output-hnsw and store it in the model file. "
+                                       "arg1: links per node, arg2: number of candidates while building, arg3: name of output weights matrix")
+                                       ->implicit_val("16 100 Wemb");
     cli->add<std::vector<std::string>>("--vocabs,-V", "Vocabulary file, required for ONNX export");
     cli->add<std::vector<std::string>>("--shortlist,-s", "Shortlist conversion: filePath firstNum bestNum threshold");
     cli->add<std::string>("--dump-shortlist,-d", "Binary shortlist dump path","lex.bin");
+    cli->add<std::vector<std::string>>("--build-shortlist",
+                                       "Build a binary shortlist from a sentence-aligned corpus: source target [alignments]. "
+                                       "With word alignments over the subword tokens (e.g. from marian-scorer --alignment hard, "
+                                       "whose \"score ||| alignment\" lines are accepted) "
+                                       "target words are ranked by p(t|s), otherwise by the Dice coefficient of co-occurrences");
+    cli->add<std::vector<std::string>>("--build-shortlist-limits",
+                                       "Limits of the built shortlist: firstNum bestNum threshold",
+                                       {"100", "100", "0"});
+    cli->add<size_t>("--build-shortlist-memory",
+                     "Memory budget in MB for word pair counts, rare pairs are pruned beyond it", 4096);
+    cli->add<size_t>("--cpu-threads",
+                     "Number of threads for --build-shortlist, 0 means all hardware threads", 0);
     cli->parse(argc, argv);
     options->merge(config);
   }
@@ -55,6 +95,40 @@ int main(int argc, char** argv) {
     return 0;
   }
 
+  // shortlist from corpus:
+  // ./marian-conv --build-shortlist corpus.es corpus.en [corpus.align] --dump-shortlist lex.esen.bin --vocabs vocab.esen.spm vocab.esen.spm
+  if(options->hasAndNotEmpty("build-shortlist")) {
+    auto corpusPaths = options->get<std::vector<std::string>>("build-shortlist");
+    ABORT_IF(corpusPaths.size() < 2 || corpusPaths.size() > 3,
+             "--build-shortlist expects source and target corpus and optionally word alignments");
+    auto vocabPaths = options->get<std::vector<std::string>>("vocabs");
+    ABORT_IF(vocabPaths.size() != 2, "--build-shortlist requires source and target --vocabs");
+    auto dumpPath = options->get<std::string>("dump-shortlist");
+
+    auto limits = options->get<std::vector<std::string>>("build-shortlist-limits");
+    size_t firstNum  = limits.size() > 0 ? std::stoul(limits[0]) : 100;
+    size_t bestNum   = limits.size() > 1 ? std::stoul(limits[1]) : 100;
+    double threshold = limits.size() > 2 ? std::stod(limits[2]) : 0;
+
+    size_t threads = options->get<size_t>("cpu-threads");
+    if(threads == 0)
+      threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    Ptr<Vocab> srcVocab = New<Vocab>(options, 0);
+    srcVocab->load(vocabPaths[0]);
+    Ptr<Vocab> trgVocab = New<Vocab>(options, 1);
+    trgVocab->load(vocabPaths[1]);
+
+    data::ShortlistBuilder builder(srcVocab, trgVocab, threads, options->get<size_t>("build-shortlist-memory"));
+    builder.count(corpusPaths[0], corpusPaths[1], corpusPaths.size() > 2 ? corpusPaths[2] : "");
+
+    data::BinaryShortlistGenerator generator(
+        srcVocab, trgVocab, builder.scores(), firstNum, bestNum, threshold, vocabPaths[0] == vocabPaths[1]);
+    generator.dump(dumpPath);
+    LOG(info, "Dumping of the shortlist is finished");
+    return 0;
+  }
+
   auto modelFrom = options->get<std::string>("from");
   auto modelTo = options->get<std::string>("to");
 
@@ -71,6 +145,19 @@ int main(int argc, char** argv) {
       lshOutputWeights = lshParams[1];
   }
   
+  bool addHnsw = options->hasAndNotEmpty("add-hnsw");
+  int hnswM = 16;
+  int hnswEfConstruction = 100;
+  std::string hnswOutputWeights = "Wemb";
+  if(addHnsw) {
+    auto hnswParams = options->get<std::vector<std::string>>("add-hnsw");
+    hnswM           = std::stoi(hnswParams[0]);
+    if(hnswParams.size() > 1)
+      hnswEfConstruction = std::stoi(hnswParams[1]);
+    if(hnswParams.size() > 2)
+      hnswOutputWeights = hnswParams[2];
+  }
+
   // We accept any type here and will later croak during packAndSave if the type cannot be used for conversion
   Type saveGemmType = typeFromString(options->get<std::string>("gemm-type", "float32"));
 
@@ -84,6 +171,9 @@ int main(int argc, char** argv) {
   if (exportAs == "marian-bin") {
     auto graph = New<ExpressionGraphPackable>();
     graph->setDevice(CPU0);
+    graph->getBackend()->setQuantizeRange(options->get<float>("quantize-range"));
+    graph->setMaxQuantizationError(options->get<float>("max-quantization-error"));
+    graph->setPrecisionMap(options->get<std::vector<std::string>>("precision-map", {}));
     graph->load(modelFrom);
 
     if(addLsh) {
@@ -94,21 +184,36 @@ int main(int argc, char** argv) {
       graph->setReloaded(true);
     }
 
+    if(addHnsw) {
+      // same as for the LSH, the index is built after initialization
+      graph->setReloaded(false);
+      hnsw::addDummyParameters(graph, /*weights=*/hnswOutputWeights, /*M=*/hnswM);
+      graph->setReloaded(true);
+    }
+
     graph->forward();  // run the initializers
 
+    if(options->get<bool>("sensitivity-report"))
+      graph->reportSensitivity();
+
     if(addLsh) {
       // After initialization, hijack the paramters for the LSH and force-overwrite with correct values.
       // Once this is done we can just pack and save as normal.
       lsh::overwriteDummyParameters(graph, /*weights=*/lshOutputWeights);
     }
 
+    if(addHnsw)
+      hnsw::overwriteDummyParameters(graph, /*weights=*/hnswOutputWeights, /*M=*/hnswM, /*efConstruction=*/hnswEfConstruction);
+
     // added a flag if the weights needs to be packed or not
-    graph->packAndSave(modelTo, configStr.str(), /* --gemm-type */ saveGemmType, Type::float32);
+    graph->packAndSave(modelTo, configStr.str(), /* --gemm-type */ saveGemmType, Type::float32, options->get<bool>("compress"), options->get<bool>("deduplicate"));
   }
   else if (exportAs == "onnx-encode") {
 #ifdef USE_ONNX
     auto graph = New<ExpressionGraphONNXExporter>();
     graph->setDevice(CPU0);
+    graph->getBackend()->setQuantizeRange(options->get<float>("quantize-range"));
+    graph->setMaxQuantizationError(options->get<float>("max-quantization-error"));
     graph->load(modelFrom);
     graph->forward();  // run the initializers
     auto modelOptions = New<Options>(config)->with("vocabs", vocabPaths, "inference", true);
@@ -5,7 +5,12 @@
 #include "common/types.h"
 #include "tensors/cpu/integer_common.h"
 
+#include "3rd_party/threadpool.h"
+#include "3rd_party/zlib/zlib.h"
+
+#include <algorithm>
 #include <string>
+#include <thread>
 
 namespace marian {
 namespace io {
@@ -27,22 +32,101 @@ const T* get(const void*& current, uint64_t num = 1) {
   return ptr;
 }
 
+// Compressed items store byte k of all elements before byte k+1 of all elements, this makes
+// e.g. the sign and exponent bytes of floats compress much better.
+static size_t wordSize(const io::Item& item) {
+  size_t size = sizeOf(item.type);
+  return size > 1 && item.bytes.size() % size == 0 ? size : 1;
+}
+
+static std::vector<char> compressItem(const io::Item& item) {
+  size_t words = wordSize(item);
+  size_t n = item.bytes.size() / words;
+  std::vector<char> shuffled(item.bytes.size());
+  for(size_t j = 0; j < n; ++j)
+    for(size_t k = 0; k < words; ++k)
+      shuffled[k * n + j] = item.bytes[j * words + k];
+
+  uLongf compressedSize = compressBound((uLong)shuffled.size());
+  std::vector<char> compressed(compressedSize);
+  int rc = compress2((Bytef*)compressed.data(), &compressedSize, (const Bytef*)shuffled.data(), (uLong)shuffled.size(), Z_DEFAULT_COMPRESSION);
+  ABORT_IF(rc != Z_OK, "Error {} compressing item {}", rc, item.name);
+  compressed.resize(compressedSize);
+  return compressed;
+}
+
+// Inflates the data of an item into its rawLength bytes as stored in an uncompressed file
+static std::vector<char> decompressItem(const io::Item& item, const char* data, uint64_t length, uint64_t rawLength) {
+  std::vector<char> shuffled(rawLength);
+  uLongf size = (uLongf)shuffled.size();
+  int rc = uncompress((Bytef*)shuffled.data(), &size, (const Bytef*)data, (uLong)length);
+  ABORT_IF(rc != Z_OK || size != shuffled.size(), "Error {} decompressing item {}", rc, item.name);
+
+  std::vector<char> raw(rawLength);
+  size_t words = wordSize(item);
+  size_t n = raw.size() / words;
+  for(size_t j = 0; j < n; ++j)
+    for(size_t k = 0; k < words; ++k)
+      raw[j * words + k] = shuffled[k * n + j];
+  return raw;
+}
+
+// Sets the data of an item from the length raw bytes in the file, or a decompressed copy of them. Mapped items
+// only point to the data, other items copy it into Item::bytes.
+static void setItemData(io::Item& item, const char* data, uint64_t length) {
+  // For intgemm AVX512 and AVX512VNNI have the same arangement, but the VNNI algorithm is faster.
+  // Change the type to the fastest one supported.
+  if(item.type == Type::intgemm8avx512)
+    item.type = cpu::integer::getIntgemmType(Type::intgemm8);
+  // Hardware non-specific intgemm matrices need to be reordered, hence they are never mapped
+  if(item.type == Type::intgemm8 || item.type == Type::intgemm16)
+    item.mapped = false;
+
+  if(item.mapped) { // memory-mapped, hence only set pointer
+    // @TOOD: verify this actually works for the hardware-specific ones like intgemm8avx2
+    item.ptr = data;
+    return;
+  }
+
+  item.bytes.resize(length);
+  // Intgemm8/16 matrices in binary model are just quantized, however they also need to be reordered
+  // Reordering depends on the architecture (SSE/AVX2/AVX512) so we read in the quantized matrices and
+  // then reorder them before adding them as a parameter in the graph.
+  if(matchType<intgemm8>(item.type)) {
+    item.type = cpu::integer::getIntgemmType(Type::intgemm8);
+    cpu::integer::prepareAndTransposeB<Type::intgemm8>(item, data);
+  } else if(matchType<intgemm16>(item.type)) {
+    item.type = cpu::integer::getIntgemmType(Type::intgemm16);
+    cpu::integer::prepareAndTransposeB<Type::intgemm16>(item, data);
+  } else {
+    std::copy(data, data + length, item.bytes.begin());
+  }
+}
+
+static size_t numCompressionThreads(size_t numItems) {
+  return std::max((size_t)1, std::min(numItems, (size_t)std::min(8u, std::thread::hardware_concurrency())));
+}
+
 void loadItems(const void* current, std::vector<io::Item>& items, bool mapped) {
   uint64_t binaryFileVersion = *get<uint64_t>(current);
-  ABORT_IF(binaryFileVersion != BINARY_FILE_VERSION,
-           "Binary file versions do not match: {} (file) != {} (expected)",
+  ABORT_IF(binaryFileVersion != BINARY_FILE_VERSION && binaryFileVersion != BINARY_FILE_VERSION_COMPRESSED,
+           "Binary file versions do not match: {} (file) != {} or {} (expected)",
            binaryFileVersion,
-           BINARY_FILE_VERSION);
+           BINARY_FILE_VERSION,
+           BINARY_FILE_VERSION_COMPRESSED);
+  bool compressed = binaryFileVersion == BINARY_FILE_VERSION_COMPRESSED;
 
   uint64_t numHeaders = *get<uint64_t>(current); // number of item headers that follow
   const Header* headers = get<Header>(current, numHeaders); // read that many headers
+  // for compressed items Header::dataLength is the compressed length, followed by the uncompressed lengths
+  const uint64_t* rawLengths = compressed ? get<uint64_t>(current, numHeaders) : nullptr;
 
   // prepopulate items with meta data from headers
   items.resize(numHeaders);
   for(int i = 0; i < numHeaders; ++i) {
     items[i].type = (Type)headers[i].type;
     items[i].name = get<char>(current, headers[i].nameLength);
-    items[i].mapped = mapped;
+    items[i].mapped = mapped && !compressed;
   }
 
   // read in actual shape and data
@@ -57,34 +141,24 @@ void loadItems(const void* current, std::vector<io::Item>& items, bool mapped) {
   uint64_t offset = *get<uint64_t>(current);
   get<char>(current, offset);
 
-  for(int i = 0; i < numHeaders; ++i) {
-    // For intgemm AVX512 and AVX512VNNI have the same arangement, but the VNNI algorithm is faster.
-    // Change the type to the fastest one supported.
-    if (items[i].type == Type::intgemm8avx512) {
-      items[i].type = cpu::integer::getIntgemmType(Type::intgemm8);
-    }
-    if(items[i].mapped) { // memory-mapped, hence only set pointer
-      // @TOOD: verify this actually works for the hardware-specific ones like intgemm8avx2
-      ABORT_IF(items[i].type == Type::intgemm8 || items[i].type == Type::intgemm16, "mmap format not supported for hardware non-specific intgemm matrices");
-      items[i].ptr = get<char>(current, headers[i].dataLength);
-    } else { // reading into item data
-      uint64_t len = headers[i].dataLength;
-      items[i].bytes.resize(len);
-      const char* ptr = get<char>(current, len);
-      // Intgemm8/16 matrices in binary model are just quantized, however they also need to be reordered
-      // Reordering depends on the architecture (SSE/AVX2/AVX512) so we read in the quantized matrices and
-      // then reorder them before adding them as a parameter in the graph.
-      if (matchType<intgemm8>(items[i].type)) {
-        items[i].type = cpu::integer::getIntgemmType(Type::intgemm8);
-        cpu::integer::prepareAndTransposeB<Type::intgemm8>(items[i], ptr);
-      } else if (matchType<intgemm16>(items[i].type)) {
-        items[i].type = cpu::integer::getIntgemmType(Type::intgemm16);
-        cpu::integer::prepareAndTransposeB<Type::intgemm16>(items[i], ptr);
-      } else {
-        std::copy(ptr, ptr + len, items[i].bytes.begin());
-      }
+  if(compressed) {
+    // items are compressed independently, hence they can be decompressed in parallel
+    ThreadPool pool(numCompressionThreads(numHeaders));
+    std::vector<std::future<void>> results;
+    for(int i = 0; i < numHeaders; ++i) {
+      const char* ptr = get<char>(current, headers[i].dataLength);
+      results.emplace_back(pool.enqueue([&items, &headers, rawLengths, ptr, i]() {
+        auto raw = decompressItem(items[i], ptr, headers[i].dataLength, rawLengths[i]);
+        setItemData(items[i], raw.data(), raw.size());
+      }));
     }
+    for(auto& result : results)
+      result.get();
+    return;
   }
+
+  for(int i = 0; i < numHeaders; ++i)
+    setItemData(items[i], get<char>(current, headers[i].dataLength), headers[i].dataLength);
 }
 
 void loadItems(const std::string& fileName, std::vector<io::Item>& items) {
@@ -130,24 +204,40 @@ io::Item getItem(const std::string& fileName, const std::string& varName) {
 }
 
 void saveItems(const std::string& fileName,
-               const std::vector<io::Item>& items) {
+               const std::vector<io::Item>& items,
+               bool compressed) {
+  std::vector<std::vector<char>> compressedData(compressed ? items.size() : 0);
+  if(compressed) {
+    ThreadPool pool(numCompressionThreads(items.size()));
+    std::vector<std::future<void>> results;
+    for(size_t i = 0; i < items.size(); ++i)
+      results.emplace_back(pool.enqueue([&, i]() { compressedData[i] = compressItem(items[i]); }));
+    for(auto& result : results)
+      result.get();
+  }
+
   io::OutputFileStream out(fileName);
   uint64_t pos = 0;
 
-  uint64_t binaryFileVersion = BINARY_FILE_VERSION;
+  uint64_t binaryFileVersion = compressed ? BINARY_FILE_VERSION_COMPRESSED : BINARY_FILE_VERSION;
   pos += out.write(&binaryFileVersion);
 
   std::vector<Header> headers;
-  for(const auto& item : items) {
+  std::vector<uint64_t> rawLengths;
+  for(size_t i = 0; i < items.size(); ++i) {
+    const auto& item = items[i];
     headers.push_back(Header{item.name.size() + 1,
                              (uint64_t)item.type,
                              item.shape.size(),
-                             item.bytes.size()}); // binary item size with padding, will be 256-byte-aligned
+                             compressed ? compressedData[i].size() : item.bytes.size()}); // binary item size with padding, will be 256-byte-aligned
+    rawLengths.push_back(item.bytes.size());
   }
 
   uint64_t headerSize = headers.size();
   pos += out.write(&headerSize);
   pos += out.write(headers.data(), headers.size());
+  if(compressed)
+    pos += out.write(rawLengths.data(), rawLengths.size());
 
   // Write out all names
   for(const auto& item : items) {
@@ -169,6 +259,11 @@ void saveItems(const std::string& fileName,
   }
 
   // Write out all values
+  if(compressed) {
+    for(const auto& data : compressedData)
+      pos += out.write(data.data(), data.size());
+    return;
+  }
   for(const auto& item : items)
     pos += out.write(item.data(), item.bytes.size()); // writes out data with padding, keeps 256-byte boundary. 
                                                       // Amazingly this is binary-compatible with V1 and aligned and 
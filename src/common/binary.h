@@ -8,6 +8,8 @@
 namespace marian {
 
 const static int BINARY_FILE_VERSION = 1;
+// Same layout, but each item is byte-plane shuffled and deflated on its own, see saveItems(...)
+const static int BINARY_FILE_VERSION_COMPRESSED = 2;
 
 namespace io {
 namespace binary {
@@ -20,7 +22,7 @@ void loadItems(const std::string& fileName, std::vector<io::Item>& items);
 io::Item getItem(const void* current, const std::string& vName);
 io::Item getItem(const std::string& fileName, const std::string& vName);
 
-void saveItems(const std::string& fileName, const std::vector<io::Item>& items);
+void saveItems(const std::string& fileName, const std::vector<io::Item>& items, bool compressed = false);
 
 }  // namespace binary
 }  // namespace io
@@ -687,6 +687,12 @@ void ConfigParser::addOptionsTranslation(cli::CLIWrapper& cli) {
 
   cli.add<std::vector<std::string>>("--shortlist",
      "Use softmax shortlist: path first best prune");
+  cli.add<bool>("--shortlist-per-sentence",
+     "Use a separate softmax shortlist for every sentence instead of the union over the batch. "
+     "Keeps the output layer small for large batches, not used with factored vocabularies");
+  cli.add<size_t>("--shortlist-cache",
+     "Keep the short-listed output matrices of recent batches in up to arg MB per expression graph, i.e. per "
+     "CPU thread or GPU, so that batches with the same shortlist do not select them again. 0 means off", 0);
   cli.add<std::vector<float>>("--weights",
       "Scorer weights");
   cli.add<bool>("--output-sampling",
@@ -695,15 +701,44 @@ void ConfigParser::addOptionsTranslation(cli::CLIWrapper& cli) {
   cli.add<std::vector<int>>("--output-approx-knn",
      "Use approximate knn search in output layer (currently only in transformer)")
      ->implicit_val("100 1024");
+  cli.add<std::vector<int>>("--output-hnsw",
+     "Use approximate maximum inner product search with an HNSW graph in the output layer (currently only in transformer). "
+     "arg1: number of candidates k per hypothesis, arg2: number of candidates during the search (default 2 * k). "
+     "The graph is stored in the model by marian-conv --add-hnsw or built at startup")
+     ->implicit_val("100 200");
+  cli.add<size_t>("--output-approx-knn-threads",
+     "Search the nearest neighbours of the hypotheses of a batch with arg threads per worker "
+     "for --output-approx-knn and --output-hnsw",
+     1);
+
+  cli.add<size_t>("--auto-workspace",
+      "Size the workspace automatically: translate a synthetic batch of --mini-batch sentences with arg tokens each "
+      "and reserve the measured workspace use instead of --workspace. 0 means off", 0);
+  cli.add<std::vector<size_t>>("--warmup",
+      "Before accepting input, translate synthetic batches with source sentences of these lengths on every device. "
+      "This initializes kernels, caches and the workspace so that the first real batches are not slower")
+      ->implicit_val("8 32 128");
+  cli.add<std::string>("--allocator",
+      "Memory management of the workspace: first-fit (best-fitting free block) or size-classes "
+      "(power-of-two size classes with free lists, faster for many small tensors)", "first-fit");
+  cli.add<bool>("--model-mmap",
+      "Memory-map *.bin models instead of reading them, parameters are paged in from disk when first used "
+      "(CPU only)");
 
   // parameters for on-line quantization
   cli.add<bool>("--optimize",
       "Optimize the graph on-the-fly", false);
   cli.add<std::string>("--gemm-type,-g",
-     "GEMM Type to be used for on-line quantization/packing: float32, packed16, packed8", "float32");
+     "GEMM Type to be used for on-line quantization/packing: float32, packed16, packed8, "
+     "auto (measure float32, intgemm and packed GEMMs per matrix size and use the fastest)", "float32");
   cli.add<float>("--quantize-range",
      "Range for the on-line quantiziation of weight matrix in multiple of this range and standard deviation, 0.0 means min/max quantization",
      0.f);
+  cli.add<std::string>("--autotune-cache",
+     "Load and store decisions of --gemm-type auto in this file (per CPU model) to skip measuring in later runs");
+  cli.add<bool>("--int8-on-load",
+     "Quantize float32 weight matrices to intgemm8 for the current CPU while loading the model. "
+     "The result is cached next to the model file as <model>.<intgemm type>.bin and reused at the next start");
 
 #if 0 // @TODO: Ask Hany if there are any decoding-time options
   // add ULR settings
@@ -760,10 +795,13 @@ void ConfigParser::addOptionsScoring(cli::CLIWrapper& cli) {
   cli.add<bool>("--optimize",
       "Optimize the graph on-the-fly", false);
   cli.add<std::string>("--gemm-type,-g",
-     "GEMM Type to be used for on-line quantization/packing: float32, packed16, packed8", "float32");
+     "GEMM Type to be used for on-line quantization/packing: float32, packed16, packed8, "
+     "auto (measure float32, intgemm and packed GEMMs per matrix size and use the fastest)", "float32");
   cli.add<float>("--quantize-range",
      "Range for the on-line quantiziation of weight matrix in multiple of this range and standard deviation, 0.0 means min/max quantization",
      0.f);
+  cli.add<std::string>("--autotune-cache",
+     "Load and store decisions of --gemm-type auto in this file (per CPU model) to skip measuring in later runs");
 
   cli.switchGroup(previous_group);
   // clang-format on
@@ -872,6 +910,11 @@ void ConfigParser::addSuboptionsBatching(cli::CLIWrapper& cli) {
   cli.add<std::string>("--maxi-batch-sort",
       "Sorting strategy for maxi-batch: none, src, trg (not available for decoder)",
       defaultMaxiBatchSort);
+  cli.add<size_t>("--data-threads",
+      (mode_ == cli::mode::translation)
+          ? "Number of threads for encoding input sentences (in chunks of a maxi-batch) and decoding translations"
+          : "Number of threads for encoding input sentences (in chunks of a maxi-batch)",
+      1);
 
   if(mode_ == cli::mode::training) {
     cli.add<bool>("--shuffle-in-ram",
@@ -960,6 +1003,11 @@ void ConfigParser::addSuboptionsQuantization(cli::CLIWrapper& cli) {
      "Uses log-based quantization");
   cli.add<bool>("--quantize-biases",
      "Apply quantization to biases");
+  cli.add<bool>("--quantize-intgemm",
+     "Emulate intgemm8 inference during training (requires --quantize-bits 8): per-tensor 127/max|W| "
+     "weight quantization, int8 quantization of the inputs of affine layers, "
+     "and the model is additionally saved as <model>.intgemm8.bin. That conversion is lossless unless "
+     "--exponential-smoothing is used, whose averaged weights are not on the intgemm8 grid");
   // clang-format on
 }
 
@@ -5,7 +5,20 @@
 #include "common/types.h"
 
 #include "common/binary.h"
+#include "common/filesystem.h"
+#include "common/hash.h"
 #include "common/io_item.h"
+#include "tensors/cpu/aligned.h"
+
+#include "3rd_party/threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 namespace marian {
 namespace io {
@@ -75,36 +88,126 @@ void addMetaToItems(const std::string& meta,
   items.push_back(item);
 }
 
+static Item itemFromNpy(const std::string& name, cnpy::NpyArrayPtr array) {
+  Shape shape;
+  shape.resize(array->shape.size());
+  for(size_t i = 0; i < array->shape.size(); ++i)
+    shape.set(i, (size_t)array->shape[i]);
+
+  Item item;
+  item.name = name;
+  item.shape = shape;
+
+  char npzType = array->type;
+  int wordSize = array->word_size;
+  if     (npzType == 'f' && wordSize == 2) item.type = Type::float16;
+  else if(npzType == 'f' && wordSize == 4) item.type = Type::float32;
+  else if(npzType == 'f' && wordSize == 8) item.type = Type::float64;
+  else if(npzType == 'i' && wordSize == 1) item.type = Type::int8;
+  else if(npzType == 'i' && wordSize == 2) item.type = Type::int16;
+  else if(npzType == 'i' && wordSize == 4) item.type = Type::int32;
+  else if(npzType == 'i' && wordSize == 8) item.type = Type::uint64;
+  else if(npzType == 'u' && wordSize == 1) item.type = Type::uint8;
+  else if(npzType == 'u' && wordSize == 2) item.type = Type::uint16;
+  else if(npzType == 'u' && wordSize == 4) item.type = Type::uint32;
+  else if(npzType == 'u' && wordSize == 8) item.type = Type::uint64;
+  else ABORT("Numpy item '{}' type '{}' with size {} not supported", name, npzType, wordSize);
+
+  item.bytes.swap(array->bytes);
+  return item;
+}
+
+// Arrays in npz files written by Marian are stored uncompressed, hence after a quick scan of the
+// local headers each array can be read independently. Large models are read by several threads.
 void loadItemsFromNpz(const std::string& fileName, std::vector<Item>& items) {
-  auto numpy = cnpy::npz_load(fileName);
-  for(auto it : numpy) {
-    Shape shape;
-    shape.resize(it.second->shape.size());
-    for(size_t i = 0; i < it.second->shape.size(); ++i)
-      shape.set(i, (size_t)it.second->shape[i]);
-
-    Item item;
-    item.name = it.first;
-    item.shape = shape;
-
-    char npzType = it.second->type;
-    int wordSize = it.second->word_size;
-    if     (npzType == 'f' && wordSize == 2) item.type = Type::float16;
-    else if(npzType == 'f' && wordSize == 4) item.type = Type::float32;
-    else if(npzType == 'f' && wordSize == 8) item.type = Type::float64;
-    else if(npzType == 'i' && wordSize == 1) item.type = Type::int8;
-    else if(npzType == 'i' && wordSize == 2) item.type = Type::int16;
-    else if(npzType == 'i' && wordSize == 4) item.type = Type::int32;
-    else if(npzType == 'i' && wordSize == 8) item.type = Type::uint64;
-    else if(npzType == 'u' && wordSize == 1) item.type = Type::uint8;
-    else if(npzType == 'u' && wordSize == 2) item.type = Type::uint16;
-    else if(npzType == 'u' && wordSize == 4) item.type = Type::uint32;
-    else if(npzType == 'u' && wordSize == 8) item.type = Type::uint64;
-    else ABORT("Numpy item '{}' type '{}' with size {} not supported", it.first, npzType, wordSize);
-
-    item.bytes.swap(it.second->bytes);
-    items.emplace_back(std::move(item));
+  auto entries = cnpy::npz_index(fileName);
+  // keep the order of the former std::map-based loading
+  std::sort(entries.begin(), entries.end(), [](const cnpy::NpzEntry& a, const cnpy::NpzEntry& b) {
+    return a.name < b.name;
+  });
+
+  size_t start = items.size();
+  items.resize(start + entries.size());
+
+  size_t numThreads = std::min(entries.size(), (size_t)std::max(1u, std::min(8u, std::thread::hardware_concurrency())));
+  std::atomic<size_t> next(0);
+  auto readEntries = [&]() {
+    FILE* fp = fopen(fileName.c_str(), "rb");
+    ABORT_IF(fp == nullptr, "Error {} ('{}') opening file '{}'", errno, strerror(errno), fileName);
+    for(size_t i = next++; i < entries.size(); i = next++)
+      items[start + i] = itemFromNpy(entries[i].name, cnpy::npz_load(fp, entries[i]));
+    fclose(fp);
+  };
+
+  ThreadPool pool(numThreads);
+  std::vector<std::future<void>> results;
+  for(size_t i = 0; i < numThreads; ++i)
+    results.emplace_back(pool.enqueue(readEntries));
+  for(auto& result : results)
+    result.get(); // rethrows errors from cnpy
+}
+
+static const std::string aliasesName = "special:aliases";
+
+void deduplicateItems(std::vector<Item>& items) {
+  std::unordered_map<size_t, std::vector<size_t>> byHash; // content hash -> indices of kept items
+  std::vector<Item> kept;
+  std::stringstream aliases;
+  size_t numAliases = 0, savedBytes = 0;
+
+  for(auto& item : items) {
+    bool isAlias = false;
+    if(item.name.substr(0, 8) != "special:") {
+      size_t hash = item.size() % sizeof(uint64_t) == 0
+                        ? util::hashMem<uint64_t>((const uint64_t*)item.data(), item.size() / sizeof(uint64_t))
+                        : util::hashMem<char>(item.data(), item.size());
+      util::hash_combine(hash, (size_t)item.type);
+      for(auto i : byHash[hash]) {
+        const auto& other = kept[i];
+        if(other.type == item.type && other.shape == item.shape
+           && std::equal(item.data(), item.data() + item.size(), other.data())) {
+          aliases << item.name << " " << other.name << "\n";
+          numAliases++;
+          savedBytes += item.size();
+          isAlias = true;
+          break;
+        }
+      }
+      if(!isAlias)
+        byHash[hash].push_back(kept.size());
+    }
+    if(!isAlias)
+      kept.emplace_back(std::move(item));
+  }
+
+  items.swap(kept);
+  if(numAliases > 0) {
+    LOG(info, "Deduplicated {} items, saving {:.2f} MB", numAliases, savedBytes / (1024.f * 1024.f));
+    addMetaToItems(aliases.str(), aliasesName, items);
+  }
+}
+
+// Restores items removed by deduplicateItems(...)
+static void resolveAliases(std::vector<Item>& items) {
+  auto it = std::find_if(items.begin(), items.end(), [](const Item& item) { return item.name == aliasesName; });
+  if(it == items.end())
+    return;
+
+  std::unordered_map<std::string, size_t> indices;
+  for(size_t i = 0; i < items.size(); ++i)
+    indices[items[i].name] = i;
+
+  std::stringstream aliases(std::string(it->data()));
+  std::string alias, target;
+  std::vector<Item> resolved;
+  while(aliases >> alias >> target) {
+    ABORT_IF(indices.count(target) == 0, "Alias {} refers to missing item {}", alias, target);
+    Item item = items[indices[target]]; // mapped items share the pointer, otherwise the bytes are copied
+    item.name = alias;
+    resolved.emplace_back(std::move(item));
   }
+  for(auto& item : resolved)
+    items.emplace_back(std::move(item));
 }
 
 std::vector<Item> loadItems(const std::string& fileName) {
@@ -116,6 +219,7 @@ std::vector<Item> loadItems(const std::string& fileName) {
   } else {
     ABORT("Unknown model file format for file {}", fileName);
   }
+  resolveAliases(items);
 
   return items;
 }
@@ -123,15 +227,31 @@ std::vector<Item> loadItems(const std::string& fileName) {
 std::vector<Item> loadItems(const void* ptr) {
   std::vector<Item> items;
   binary::loadItems(ptr, items, false);
+  resolveAliases(items);
   return items;
 }
 
 std::vector<Item> mmapItems(const void* ptr) {
   std::vector<Item> items;
   binary::loadItems(ptr, items, true);
+  resolveAliases(items);
   return items;
 }
 
+std::shared_ptr<char> loadFileAligned(const std::string& fileName) {
+  uint64_t fileSize = filesystem::fileSize(fileName);
+  std::shared_ptr<char> buffer((char*)cpu::genericMalloc(256, std::max(fileSize, (uint64_t)256)),
+                               [](char* ptr) { cpu::genericFree(ptr); });
+
+  FILE* f = fopen(fileName.c_str(), "rb");
+  ABORT_IF(f == nullptr, "Error {} ('{}') opening file '{}'", errno, strerror(errno), fileName);
+  auto rc = fread(buffer.get(), 1, fileSize, f);
+  ABORT_IF(rc != fileSize, "Error {} ('{}') reading file '{}'", errno, strerror(errno), fileName);
+  fclose(f);
+
+  return buffer;
+}
+
 // @TODO: make cnpy and our wrapper talk to each other in terms of types
 // or implement our own saving routines for npz based on npy, probably better.
 void saveItemsNpz(const std::string& fileName, const std::vector<Item>& items) {
@@ -158,11 +278,12 @@ void saveItemsNpz(const std::string& fileName, const std::vector<Item>& items) {
   cnpy::npz_save(fileName, npzItems);
 }
 
-void saveItems(const std::string& fileName, const std::vector<Item>& items) {
+void saveItems(const std::string& fileName, const std::vector<Item>& items, bool compressed) {
   if(isNpz(fileName)) {
+    ABORT_IF(compressed, "Compression is only supported for *.bin files, not {}", fileName);
     saveItemsNpz(fileName, items);
   } else if(isBin(fileName)) {
-    binary::saveItems(fileName, items);
+    binary::saveItems(fileName, items, compressed);
   } else {
     ABORT("Unknown file format for file {}", fileName);
   }
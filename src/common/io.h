@@ -3,6 +3,7 @@
 #include "3rd_party/yaml-cpp/yaml.h"
 #include "common/io_item.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -26,12 +27,26 @@ void addMetaToItems(const std::string& meta,
                     const std::string& varName,
                     std::vector<io::Item>& items);
 
+/**
+ * Removes items whose content is byte-identical to an earlier item (same type and shape) and records
+ * them as aliases of that item in a "special:aliases" item. The loading functions below restore
+ * aliased items; mapped aliases point to the same memory as their target.
+ */
+void deduplicateItems(std::vector<Item>& items);
+
 std::vector<Item> loadItems(const std::string& fileName);
 std::vector<Item> loadItems(const void* ptr);
 
 std::vector<Item> mmapItems(const void* ptr);
 
-void saveItems(const std::string& fileName, const std::vector<Item>& items);
+/**
+ * Reads a whole file with a single read into a 256-byte aligned buffer. Items of a *.bin model in
+ * this buffer can be used in place like memory-mapped items, see ExpressionGraph::load(...).
+ */
+std::shared_ptr<char> loadFileAligned(const std::string& fileName);
+
+// compressed is only supported for *.bin files
+void saveItems(const std::string& fileName, const std::vector<Item>& items, bool compressed = false);
 
 /**
  * Creates a flat io::Item from a given std::vector so that it can be saved in a npz file 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <iostream>
 
 #include "spdlog/spdlog.h"
@@ -51,14 +52,14 @@ namespace marian {
  */
 #define LOG(level, ...) checkedLog("general", #level, __VA_ARGS__)
 
-// variant that prints the log message only upon the first time the call site is executed
-#define LOG_ONCE(level, ...) do { \
-  static bool logged = false;     \
-  if (!logged)                    \
-  {                               \
-    logged = true;                \
-    LOG(level, __VA_ARGS__);      \
-  }                               \
+// variant that prints the log message only upon the first time the call site is executed,
+// also if the call site is executed by several threads at once (e.g. with --data-threads)
+#define LOG_ONCE(level, ...) do {          \
+  static std::atomic<bool> logged(false);  \
+  if (!logged.exchange(true))              \
+  {                                        \
+    LOG(level, __VA_ARGS__);               \
+  }                                        \
 } while(0)
 
 /**
@@ -1,5 +1,6 @@
 #include "common/types.h"
 #include "tensors/cpu/fbgemm/packed_gemm.h"
+#include "tensors/cpu/int4_gemm.h"
 
 namespace marian {
 
@@ -29,6 +30,10 @@ size_t requiredBytes(const Shape& shape, Type type) {
   }
 #endif  // USE_FBGEMM 
 
+  if (isInt4(type)) {
+    return cpu::int4::requiredBytes(shape);
+  }
+
   if (isIntgemm(type)) {
     /* Intgemm tensors have an extra float at the back that stores the quantization multiplier */
     return shape.elements() * sizeOf(type) + sizeOf(Type::float32);
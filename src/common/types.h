@@ -276,6 +276,7 @@ enum class TypeClass : size_t { // size_type has 8 bytes, so we can have 16 fiel
 
   packed_type   = 0x00800, // special packed (CPU cache friendly) type class, used in FBGEMM. Annoyingly we need to keep 0x800 for back-compat, would be nicer to align with intgemm
   intgemm_type  = 0x10000, // intgemm quantized architecture agnostic models
+  int4_type     = 0x20000, // group-wise 4-bit quantized matrices with float scales, see tensors/cpu/int4_gemm.h
 
   size_mask     = 0x000FF, // maximum allowed size is 256 bytes right now; if more are required, extend the size field
   class_mask    = 0xFFF00, // three fields for different type classes, if more classes are added we need to increase the number of fields here
@@ -321,6 +322,8 @@ enum class Type : size_t {
   intgemm16sse2       = TypeClass::intgemm_type + 2u + TypeClass::sse2_type,           ///< Int16 quantized and packed (sse2) matrices for intgemm
   intgemm16avx2       = TypeClass::intgemm_type + 2u + TypeClass::avx2_type,           ///< Int16 quantized and packed (avx2) matrices for intgemm
   intgemm16avx512     = TypeClass::intgemm_type + 2u + TypeClass::avx512_type,         ///< Int16 quantized and packed (avx512) matrices for intgemm
+
+  int4                = TypeClass::int4_type + 1u,                                     ///< Group-wise 4-bit quantized matrices with float scales, two values per byte. Not meant to be accessed invidually.
 };
 
 static inline size_t operator&(TypeClass typeClass, Type type) {
@@ -375,6 +378,10 @@ static inline bool isIntgemm(Type type) {
   return (TypeClass::intgemm_type & type) != 0;
 }
 
+static inline bool isInt4(Type type) {
+  return (TypeClass::int4_type & type) != 0;
+}
+
 size_t requiredBytes(const Shape& shape, Type type); // towards Frank's vision of joint Shape/Type
 
 template <typename T>
@@ -441,6 +448,8 @@ static inline std::ostream& operator<<(std::ostream& out, Type type) {
     case Type::intgemm16sse2       : out << "intgemm16sse2"; break;
     case Type::intgemm16avx2       : out << "intgemm16avx2"; break;
     case Type::intgemm16avx512     : out << "intgemm16avx512"; break;
+
+    case Type::int4                : out << "int4"; break;
   }
   return out;
 }
@@ -531,6 +540,9 @@ static Type inline typeFromString(const std::string& str) {
   if(str == "intgemm16avx512")
     return Type::intgemm16avx512;
 
+  if(str == "int4")
+    return Type::int4;
+
   ABORT("Unknown type {}", str);
 }
 
@@ -16,7 +16,9 @@ Corpus::Corpus(Ptr<Options> options, bool translate /*= false*/, size_t seed /*=
     : CorpusBase(options, translate, seed),
         shuffleInRAM_(options_->get<bool>("shuffle-in-ram", false)),
         allCapsEvery_(options_->get<size_t>("all-caps-every", 0)),
-        titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {}
+        titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {
+  initEncoderPool();
+}
 
 Corpus::Corpus(std::vector<std::string> paths,
                std::vector<Ptr<Vocab>> vocabs,
@@ -25,12 +27,24 @@ Corpus::Corpus(std::vector<std::string> paths,
     : CorpusBase(paths, vocabs, options, seed),
         shuffleInRAM_(options_->get<bool>("shuffle-in-ram", false)),
         allCapsEvery_(options_->get<size_t>("all-caps-every", 0)),
-        titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {}
+        titleCaseEvery_(options_->get<size_t>("english-title-case-every", 0)) {
+  initEncoderPool();
+}
+
+void Corpus::initEncoderPool() {
+  size_t threads = options_->get<size_t>("data-threads", 1);
+  if(threads > 1) {
+    encoderPool_.reset(new ThreadPool(threads - 1));
+    // a chunk is what the batch generator reads for one maxi-batch, so that reading ahead does not
+    // delay line-by-line translation with --mini-batch 1 --maxi-batch 1
+    chunkSize_ = (size_t)std::max(1, options_->get<int>("mini-batch", 1) * options_->get<int>("maxi-batch", 1));
+  }
+}
 
-void Corpus::preprocessLine(std::string& line, size_t streamId, bool& altered) {
+void Corpus::preprocessLine(std::string& line, size_t streamId, size_t pos, bool& altered) {
   bool isFactoredVocab = vocabs_.back()->tryAs<FactoredVocab>() != nullptr;
   altered = false; 
-  if (allCapsEvery_ != 0 && pos_ % allCapsEvery_ == 0 && !inference_) {
+  if (allCapsEvery_ != 0 && pos % allCapsEvery_ == 0 && !inference_) {
     line = vocabs_[streamId]->toUpper(line);
     if (streamId == 0)
       LOG_ONCE(info, "[data] Source all-caps'ed line to: {}", line);
@@ -38,7 +52,7 @@ void Corpus::preprocessLine(std::string& line, size_t streamId, bool& altered) {
       LOG_ONCE(info, "[data] Target all-caps'ed line to: {}", line);
     altered = isFactoredVocab ? false : true; // FS vocab does not really "alter" the token lemma for all caps
   }
-  else if (titleCaseEvery_ != 0 && pos_ % titleCaseEvery_ == 1 && !inference_ && streamId == 0) {
+  else if (titleCaseEvery_ != 0 && pos % titleCaseEvery_ == 1 && !inference_ && streamId == 0) {
     // Only applied to stream 0 (source) since this feature is aimed at robustness against
     // title case in the source (and not at translating into title case).
     // Note: It is user's responsibility to not enable this if the source language is not English.
@@ -52,6 +66,66 @@ void Corpus::preprocessLine(std::string& line, size_t streamId, bool& altered) {
 }
 
 SentenceTuple Corpus::next() {
+  if(encoderPool_) {
+    while(encoded_.empty())
+      if(!encodeChunk())
+        return SentenceTuple(0);
+    SentenceTuple tup = encoded_.front();
+    encoded_.pop_front();
+    return tup;
+  }
+
+  Lines lines;
+  for(;;) { // (this is a retry loop for skipping invalid sentences)
+    if(!readLines(lines))
+      return SentenceTuple(0);
+
+    SentenceTuple tup(lines.id);
+    if(encodeLines(lines, tup))
+      return tup;
+
+    // otherwise skip this sentence and try the next one
+  }
+}
+
+bool Corpus::readLines(Lines& lines) {
+  // get index of the current sentence
+  size_t curId = pos_; // note: at end, pos_  == total size
+  // if corpus has been shuffled, ids_ contains sentence indexes
+  if(pos_ < ids_.size())
+    curId = ids_[pos_];
+  pos_++;
+
+  lines.id = curId;
+  lines.pos = pos_;
+
+  // fetch the lines of all input files
+  size_t eofsHit = 0;
+  size_t numStreams = corpusInRAM_.empty() ? files_.size() : corpusInRAM_.size();
+  lines.lines.resize(numStreams);
+  for(size_t i = 0; i < numStreams; ++i) {
+    // fetch line, from cached copy in RAM or actual file
+    if (!corpusInRAM_.empty()) {
+      if (curId < corpusInRAM_[i].size())
+        lines.lines[i] = corpusInRAM_[i][curId];
+      else
+        eofsHit++;
+    }
+    else {
+      bool gotLine = io::getline(*files_[i], lines.lines[i]).good();
+      if(!gotLine)
+        eofsHit++;
+    }
+  }
+
+  if (eofsHit == numStreams)
+    return false;
+  ABORT_IF(eofsHit != 0, "not all input files have the same number of lines");
+  return true;
+}
+
+// Only reads members that do not change while reading, hence it can run concurrently for different lines
+bool Corpus::encodeLines(Lines& lines, SentenceTuple& tup) {
   // Used for handling TSV inputs
   // Determine the total number of fields including alignments or weights
   auto tsvNumAllFields = tsvNumInputFields_;
@@ -61,97 +135,98 @@ SentenceTuple Corpus::next() {
     ++tsvNumAllFields;
   std::vector<std::string> fields(tsvNumAllFields);
 
-  for(;;) { // (this is a retry loop for skipping invalid sentences)
-    // get index of the current sentence
-    size_t curId = pos_; // note: at end, pos_  == total size
-    // if corpus has been shuffled, ids_ contains sentence indexes
-    if(pos_ < ids_.size())
-      curId = ids_[pos_];
-    pos_++;
-
-    // fill up the sentence tuple with sentences from all input files
-    SentenceTuple tup(curId);
-    size_t eofsHit = 0;
-    size_t numStreams = corpusInRAM_.empty() ? files_.size() : corpusInRAM_.size();
-    for(size_t i = 0; i < numStreams; ++i) {
-      std::string line;
-
-      // fetch line, from cached copy in RAM or actual file
-      if (!corpusInRAM_.empty()) {
-        if (curId < corpusInRAM_[i].size())
-          line = corpusInRAM_[i][curId];
-        else {
-          eofsHit++;
-          continue;
-        }
-      }
-      else {
-        bool gotLine = io::getline(*files_[i], line).good();
-        if(!gotLine) {
-          eofsHit++;
-          continue;
+  // fill up the sentence tuple with sentences from all input files
+  for(size_t i = 0; i < lines.lines.size(); ++i) {
+    std::string& line = lines.lines[i];
+
+    if(i > 0 && i == alignFileIdx_) {
+      addAlignmentToSentenceTuple(line, tup);
+    } else if(i > 0 && i == weightFileIdx_) {
+      addWeightsToSentenceTuple(line, tup);
+    } else {
+      if(tsv_) {  // split TSV input and add each field into the sentence tuple
+        utils::splitTsv(line, fields, tsvNumAllFields);
+        size_t shift = 0;
+        for(size_t j = 0; j < tsvNumAllFields; ++j) {
+          // index j needs to be shifted to get the proper vocab index if guided-alignment or
+          // data-weighting are preceding source or target sequences in TSV input
+          if(j == alignFileIdx_ || j == weightFileIdx_) {
+            ++shift;
+          } else {
+            size_t vocabId = j - shift;
+            bool altered;
+            preprocessLine(fields[j], vocabId, lines.pos, /*out=*/altered);
+            if (altered)
+              tup.markAltered();
+            addWordsToSentenceTuple(fields[j], vocabId, tup);
+          }
         }
-      }
 
-      if(i > 0 && i == alignFileIdx_) {
-        addAlignmentToSentenceTuple(line, tup);
-      } else if(i > 0 && i == weightFileIdx_) {
-        addWeightsToSentenceTuple(line, tup);
-      } else {
-        if(tsv_) {  // split TSV input and add each field into the sentence tuple
-          utils::splitTsv(line, fields, tsvNumAllFields);
-          size_t shift = 0;
-          for(size_t j = 0; j < tsvNumAllFields; ++j) {
-            // index j needs to be shifted to get the proper vocab index if guided-alignment or
-            // data-weighting are preceding source or target sequences in TSV input
-            if(j == alignFileIdx_ || j == weightFileIdx_) {
-              ++shift;
-            } else {
-              size_t vocabId = j - shift;
-              bool altered;
-              preprocessLine(fields[j], vocabId, /*out=*/altered);
-              if (altered)
-                tup.markAltered();
-              addWordsToSentenceTuple(fields[j], vocabId, tup);
-            }
-          }
+        // weights are added last to the sentence tuple, because this runs a validation that needs
+        // length of the target sequence
+        if(alignFileIdx_ > -1)
+          addAlignmentToSentenceTuple(fields[alignFileIdx_], tup);
+        if(weightFileIdx_ > -1)
+          addWeightsToSentenceTuple(fields[weightFileIdx_], tup);
 
-          // weights are added last to the sentence tuple, because this runs a validation that needs
-          // length of the target sequence
-          if(alignFileIdx_ > -1)
-            addAlignmentToSentenceTuple(fields[alignFileIdx_], tup);
-          if(weightFileIdx_ > -1)
-            addWeightsToSentenceTuple(fields[weightFileIdx_], tup);
-
-        } else {
-          bool altered;
-          preprocessLine(line, i, /*out=*/altered);
-          if (altered)
-            tup.markAltered();
-          addWordsToSentenceTuple(line, i, tup);
-        }
+      } else {
+        bool altered;
+        preprocessLine(line, i, lines.pos, /*out=*/altered);
+        if (altered)
+          tup.markAltered();
+        addWordsToSentenceTuple(line, i, tup);
       }
     }
+  }
 
-    if (eofsHit == numStreams)
-      return SentenceTuple(0);
-    ABORT_IF(eofsHit != 0, "not all input files have the same number of lines");
-
-    // check if all streams are valid, that is, non-empty and no longer than maximum allowed length
-    if(std::all_of(tup.begin(), tup.end(), [=](const Words& words) {
-         return words.size() > 0 && words.size() <= maxLength_;
-       }))
-      return tup;
+  // check if all streams are valid, that is, non-empty and no longer than maximum allowed length
+  return std::all_of(tup.begin(), tup.end(), [=](const Words& words) {
+    return words.size() > 0 && words.size() <= maxLength_;
+  });
+}
 
-    // otherwise skip this sentence and try the next one
-    // @TODO: tail recursion?
-  }
+// Reads up to chunkSize_ tuples and encodes them on the calling thread and the threads of encoderPool_.
+// The encoded tuples are kept in corpus order, so the batches are the same as with a single thread.
+bool Corpus::encodeChunk() {
+  std::vector<Lines> chunk(chunkSize_);
+  size_t num = 0;
+  while(num < chunkSize_ && readLines(chunk[num]))
+    num++;
+  if(num == 0)
+    return false;
+
+  std::vector<SentenceTuple> tuples;
+  tuples.reserve(num);
+  for(size_t i = 0; i < num; ++i)
+    tuples.emplace_back(chunk[i].id);
+  std::vector<char> valid(num);
+
+  auto encodeRange = [&](size_t begin, size_t end) {
+    for(size_t i = begin; i < end; ++i)
+      valid[i] = encodeLines(chunk[i], tuples[i]);
+  };
+
+  // the calling thread encodes the first slice itself
+  size_t threads = std::min(encoderPool_->getNumThreads() + 1, num);
+  size_t perThread = (num + threads - 1) / threads;
+  std::vector<std::future<void>> slices;
+  for(size_t begin = perThread; begin < num; begin += perThread)
+    slices.emplace_back(encoderPool_->enqueue(encodeRange, begin, std::min(begin + perThread, num)));
+  encodeRange(0, std::min(perThread, num));
+  for(auto& slice : slices)
+    slice.get();
+
+  for(size_t i = 0; i < num; ++i)
+    if(valid[i])
+      encoded_.push_back(tuples[i]);
+  return true;
 }
 
 // reset and initialize shuffled reading
 // Call either reset() or shuffle().
 // @TODO: merge with reset() below to clarify mutual exclusiveness with reset()
 void Corpus::shuffle() {
+  encoded_.clear();
   shuffleData(paths_);
 }
 
@@ -160,6 +235,7 @@ void Corpus::shuffle() {
 // @TODO: make shuffle() private, instad pass a shuffle() flag to reset(), to clarify mutual
 // exclusiveness with shuffle()
 void Corpus::reset() {
+  encoded_.clear();
   corpusInRAM_.clear();
   ids_.clear();
   if (pos_ == 0) // no data read yet
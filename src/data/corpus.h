@@ -12,6 +12,9 @@
 #include "data/corpus_base.h"
 #include "data/dataset.h"
 #include "data/vocab.h"
+#include "3rd_party/threadpool.h"
+
+#include <deque>
 
 namespace marian {
 namespace data {
@@ -30,7 +33,23 @@ private:
   // for pre-processing
   size_t allCapsEvery_{0};   // if set, convert every N-th input sentence (after randomization) to all-caps (source and target)
   size_t titleCaseEvery_{0}; // ditto for title case (source only)
-  void preprocessLine(std::string& line, size_t streamId, bool& altered); // altered => whether the segmentation was altered in marian
+  void preprocessLine(std::string& line, size_t streamId, size_t pos, bool& altered); // altered => whether the segmentation was altered in marian
+
+  // the lines of one sentence tuple as read from the files or RAM, before they are encoded
+  struct Lines {
+    size_t id{0};
+    size_t pos{0}; // value of pos_ after reading the lines, used by preprocessLine()
+    std::vector<std::string> lines; // [stream]
+  };
+  bool readLines(Lines& lines);                                // false at the end of the data
+  bool encodeLines(Lines& lines, SentenceTuple& tup);          // false if the tuple has to be skipped
+
+  // for --data-threads > 1: chunks of chunkSize_ tuples are read at once and encoded in parallel
+  UPtr<ThreadPool> encoderPool_;
+  size_t chunkSize_{0};
+  std::deque<SentenceTuple> encoded_; // encoded tuples of the current chunk in corpus order
+  void initEncoderPool();
+  bool encodeChunk();                 // false at the end of the data
 
 public:
   // @TODO: check if translate can be replaced by an option in options
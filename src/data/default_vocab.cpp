@@ -1,4 +1,5 @@
 #include "data/vocab_base.h"
+#include "data/string_table.h"
 
 #include "3rd_party/yaml-cpp/yaml.h"
 #include "common/logging.h"
@@ -7,6 +8,7 @@
 #include "common/filesystem.h"
 
 #include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -17,11 +19,8 @@ namespace marian {
 
 class DefaultVocab : public IVocab {
 protected:
-  typedef std::map<std::string, Word> Str2Id;
-  Str2Id str2id_;
-
-  typedef std::vector<std::string> Id2Str;
-  Id2Str id2str_;
+  // all word strings, read-only after load() or createFake()
+  StringTable words_;
 
   Word eosId_ = Word::NONE;
   Word unkId_ = Word::NONE;
@@ -53,21 +52,49 @@ public:
   virtual const std::vector<std::string>& suffixes() const override { return suffixes_; }
 
   virtual Word operator[](const std::string& word) const override {
-    auto it = str2id_.find(word);
-    if(it != str2id_.end())
-      return it->second;
-    else
-      return unkId_;
+    return lookup(word.data(), word.size());
   }
 
+  // Splits at spaces like utils::split(line, " ") and looks the tokens up in place, without copying them
   Words encode(const std::string& line, bool addEOS, bool /*inference*/) const override {
-    auto lineTokens = utils::split(line, " ");
-    return (*this)(lineTokens, addEOS);
+    Words words;
+    const char* begin = line.data();
+    const char* end = begin + line.size();
+    while(begin < end) {
+      auto tokenEnd = (const char*)std::memchr(begin, ' ', end - begin);
+      if(!tokenEnd)
+        tokenEnd = end;
+      if(tokenEnd > begin)
+        words.push_back(lookup(begin, tokenEnd - begin));
+      begin = tokenEnd + 1;
+    }
+    if(addEOS)
+      words.push_back(eosId_);
+    return words;
   }
 
+  // Copies the tokens from the string table directly into the output, separated by spaces
   std::string decode(const Words& sentence, bool ignoreEOS) const override {
-    auto tokens = (*this)(sentence, ignoreEOS);
-    return utils::join(tokens, " ");
+    size_t bytes = 0;
+    for(auto word : sentence) {
+      auto id = word.toWordIndex();
+      ABORT_IF(id >= words_.size(), "Unknown word id: {}", id);
+      bytes += words_.length(id) + 1;
+    }
+
+    std::string line;
+    line.reserve(bytes);
+    bool first = true;
+    for(auto word : sentence) {
+      if(word == eosId_ && ignoreEOS)
+        continue;
+      if(!first)
+        line.push_back(' ');
+      auto id = word.toWordIndex();
+      line.append(words_.data(id), words_.length(id));
+      first = false;
+    }
+    return line;
   }
 
   std::string surfaceForm(const Words& sentence) const override {
@@ -89,14 +116,14 @@ public:
   virtual Word getEosId() const override { return eosId_; }
   virtual Word getUnkId() const override { return unkId_; }
 
-  const std::string& operator[](Word word) const override {
+  std::string operator[](Word word) const override {
     auto id = word.toWordIndex();
-    ABORT_IF(id >= id2str_.size(), "Unknown word id: {}", id);
-    return id2str_[id];
+    ABORT_IF(id >= words_.size(), "Unknown word id: {}", id);
+    return words_[id];
   }
 
   size_t size() const override {
-    return id2str_.size();
+    return words_.size();
   }
 
   size_t load(const std::string& vocabPath, size_t maxSize) override {
@@ -131,29 +158,37 @@ public:
       ABORT_IF(in.bad(), "DefaultVocabulary file {} could not be read", vocabPath);
     }
 
-    id2str_.reserve(vocab.size());
+    // unused ids (only possible in JSON/Yaml vocabs) remain empty strings
+    std::vector<std::string> id2str;
+    id2str.reserve(vocab.size());
     for(auto&& pair : vocab) {
-      auto str = pair.first;
-      auto id = pair.second;
+      auto id = pair.second.toWordIndex();
 
       // note: this requires ids to be sorted by frequency
-      if(!maxSize || id.toWordIndex() < maxSize) {
-        insertWord(id, str);
+      if(!maxSize || id < maxSize) {
+        if(id >= id2str.size())
+          id2str.resize(id + 1);
+        id2str[id] = pair.first;
       }
     }
-    ABORT_IF(id2str_.empty(), "Empty vocabulary: ", vocabPath);
+    ABORT_IF(id2str.empty(), "Empty vocabulary: ", vocabPath);
+    words_.build(id2str);
 
     populateControlChars();
 
     addRequiredVocabulary(vocabPath, isJson);
 
-    return std::max(id2str_.size(), maxSize);
+    return std::max(words_.size(), maxSize);
   }
 
   // for fakeBatch()
   virtual void createFake() override {
-    eosId_ = insertWord(Word::DEFAULT_EOS_ID, DEFAULT_EOS_STR);
-    unkId_ = insertWord(Word::DEFAULT_UNK_ID, DEFAULT_UNK_STR);
+    eosId_ = Word::DEFAULT_EOS_ID;
+    unkId_ = Word::DEFAULT_UNK_ID;
+    std::vector<std::string> id2str(std::max(eosId_.toWordIndex(), unkId_.toWordIndex()) + 1);
+    id2str[eosId_.toWordIndex()] = DEFAULT_EOS_STR;
+    id2str[unkId_.toWordIndex()] = DEFAULT_UNK_STR;
+    words_.build(id2str);
   }
 
   virtual void create(const std::string& vocabPath,
@@ -210,9 +245,9 @@ private:
         // if word id 0 or 1 is either empty or has the Nematus-convention string,
         // then use it
         auto backCompatId = backCompatWord.toWordIndex();
-        if(backCompatId < id2str_.size()
-          && (id2str_[backCompatId].empty()
-              || id2str_[backCompatId] == backCompatStr)) {
+        if(backCompatId < words_.size()
+          && (words_.length(backCompatId) == 0
+              || words_[backCompatId] == backCompatStr)) {
           LOG(info,
               "[data] Using unused word id {} for {}",
               backCompatStr,
@@ -221,12 +256,12 @@ private:
           return backCompatWord;
         }
       }
-      auto iter = str2id_.find(str);
-      ABORT_IF(iter == str2id_.end(),
+      WordIndex id;
+      ABORT_IF(!words_.tryFind(str, id),
               "DefaultVocabulary file {} is expected to contain an entry for {}",
               vocabPath,
               str);
-      return iter->second;
+      return Word::fromWordIndex(id);
     };
     eosId_ = getRequiredWordId(DEFAULT_EOS_STR, NEMATUS_EOS_STR, Word::DEFAULT_EOS_ID);
     unkId_ = getRequiredWordId(DEFAULT_UNK_STR, NEMATUS_UNK_STR, Word::DEFAULT_UNK_ID);
@@ -281,38 +316,10 @@ private:
     *vocabStrm << vocabYaml;
   }
 
-  Words operator()(const std::vector<std::string>& lineTokens,
-                   bool addEOS) const {
-    Words words(lineTokens.size());
-    std::transform(lineTokens.begin(),
-                  lineTokens.end(),
-                  words.begin(),
-                  [&](const std::string& w) { return (*this)[w]; });
-    if(addEOS)
-      words.push_back(eosId_);
-    return words;
+  Word lookup(const char* str, size_t len) const {
+    WordIndex id;
+    return words_.tryFind(str, len, id) ? Word::fromWordIndex(id) : unkId_;
   }
-
-  std::vector<std::string> operator()(const Words& sentence,
-                                      bool ignoreEOS) const {
-    std::vector<std::string> decoded;
-    for(size_t i = 0; i < sentence.size(); ++i) {
-      if((sentence[i] != eosId_ || !ignoreEOS)) {
-        decoded.push_back((*this)[sentence[i]]);
-      }
-    }
-    return decoded;
-  }
-
-  // helper to insert a word into str2id_[] and id2str_[]
-  Word insertWord(Word word, const std::string& str) {
-    str2id_[str] = word;
-    auto id = word.toWordIndex();
-    if(id >= id2str_.size())
-      id2str_.resize(id + 1);
-    id2str_[id] = str;
-    return word;
-  };
 };
 
 // This is a vocabulary class that does not enforce </s> or <unk>.
@@ -153,7 +153,7 @@ namespace marian {
   //  - result of Output layer is nevertheless logits, not a normalized probability, due to the sigmoid entries
   // For every lemma, the factor map contains one example. At the end of this loop, we have a vocabulary
   // vocab_ that contains those examples, but not all possible combinations
-  lemmaHasFactorGroup_.resize(groupRanges_[0].second - groupRanges_[0].first); // group 0 is the lemmas; this difference is the number of lemma symbols
+  lemmaFactorGroups_.resize(groupRanges_[0].second - groupRanges_[0].first, 0); // group 0 is the lemmas; this difference is the number of lemma symbols
   size_t numTotalFactors = 0;
   for (WordIndex v = 0; v < factorMapTokenized.size(); v++) {
     const auto& tokens = factorMapTokenized[v];
@@ -170,16 +170,16 @@ namespace marian {
     // convert to fully unrolled factors representation
     auto na = FACTOR_NOT_APPLICABLE; // (gcc compiler bug: sometimes it cannot find this if passed directly)
     std::vector<size_t> factorIndices(groupRanges_.size(), na); // default for unused factors
-    std::vector<bool> hasFactorGroupFlags(groupRanges_.size(), false);
+    uint64_t hasFactorGroupFlags = 0; // bit g set if the word has factor group g
     for (auto u : factorUnits) {
       factorIndices[factorGroups_[u]] = factorUnit2FactorIndex(u);
-      hasFactorGroupFlags[factorGroups_[u]] = true;
+      hasFactorGroupFlags |= (uint64_t)1 << factorGroups_[u];
     }
     // record which lemma has what factor groups
-    ABORT_IF(!hasFactorGroupFlags[0], "Factor map does not specify a lemma (factor of first group) for word {}", tokens.front());
-    auto& lemmaFlags = lemmaHasFactorGroup_[factorIndices[0]];
-    if (lemmaFlags.empty())
-      lemmaFlags = std::move(hasFactorGroupFlags);
+    ABORT_IF(!(hasFactorGroupFlags & 1), "Factor map does not specify a lemma (factor of first group) for word {}", tokens.front());
+    auto& lemmaFlags = lemmaFactorGroups_[factorIndices[0]];
+    if (lemmaFlags == 0) // not seen yet, since every lemma has group 0
+      lemmaFlags = hasFactorGroupFlags;
     else
       ABORT_IF(lemmaFlags != hasFactorGroupFlags, "Inconsistent factor groups used for word {}", tokens.front());
     // map factors to non-dense integer
@@ -263,6 +263,8 @@ void FactoredVocab::constructGroupInfoFromFactorVocab() {
         factorGroups_[u] = g;
       }
   }
+  // lemmaFactorGroups_ holds one bit per group
+  ABORT_IF(numGroups > 64, "Too many factor groups ({}), at most 64 are supported", numGroups);
   // determine group index ranges
   groupRanges_.resize(numGroups, { SIZE_MAX, (size_t)0 });
   std::vector<int> groupCounts(numGroups, 0); // number of group members
@@ -368,6 +370,24 @@ Word FactoredVocab::expandFactoredWord(Word word, size_t groupIndex, size_t fact
   return word;
 }
 
+// masks for the lemma step of beam search, see Logits::getFactoredLogits()
+// If indices is null, the masks are for the first n lemmas, otherwise for the lemma units indices[0..n-1] (e.g. a shortlist).
+// Both loops are written without branches. For all lemmas the flags are read sequentially. With indices, every
+// element is a scattered load from the flags, whose cost grows with the shortlist size, not with the vocabulary.
+void FactoredVocab::getFactorMasks(size_t g, const WordIndex* indices, size_t n, float* out) const {
+  const uint64_t* flags = lemmaFactorGroups_.data();
+  if (!indices) {
+    ABORT_IF(n > lemmaFactorGroups_.size(), "More factor masks requested than there are lemmas");
+    for (size_t i = 0; i < n; i++)
+      out[i] = (float)((flags[i] >> g) & 1);
+  }
+  else {
+    auto lemmaBegin = groupRanges_[0].first;
+    for (size_t i = 0; i < n; i++)
+      out[i] = (float)((flags[indices[i] - lemmaBegin] >> g) & 1);
+  }
+}
+
 // factor unit: index of factor name in the joint factor vocabulary
 // factor index: relative index within factor type, e.g. 0 for |ca
 size_t FactoredVocab::factorUnit2FactorIndex(WordIndex u) const {
@@ -530,7 +550,7 @@ void FactoredVocab::constructNormalizationInfoForVocab() {
     return string2word(word);
 }
 
-/*virtual*/ const std::string& FactoredVocab::operator[](Word word) const /*override final*/ {
+/*virtual*/ std::string FactoredVocab::operator[](Word word) const /*override final*/ {
   //LOG(info, "Looking up Word {}={}", word.toWordIndex(), word2string(word));
   ABORT_IF(!vocab_.contains(word.toWordIndex()), "Invalid factor combination {}", word2string(word));
   return vocab_[word.toWordIndex()];
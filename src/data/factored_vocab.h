@@ -31,7 +31,7 @@ public:
   virtual Words encode(const std::string& line, bool addEOS = true, bool inference = false) const override final;
   virtual std::string decode(const Words& sentence, bool ignoreEos = true) const override final;
   virtual std::string surfaceForm(const Words& sentence) const override final;
-  virtual const std::string& operator[](Word id) const override final;
+  virtual std::string operator[](Word id) const override final;
   virtual size_t size() const override final { return vocab_.size(); } // active factored vocabulary size (counting all valid combinations but not gaps)
   virtual std::string type() const override final { return "FactoredVocab"; }
   virtual Word getEosId() const override final { return eosId_; }
@@ -66,7 +66,8 @@ public:
   Word expandFactoredWord(Word word, size_t groupIndex, size_t factorIndex) const;
   bool canExpandFactoredWord(Word word, size_t groupIndex) const { return lemmaHasFactorGroup(getFactor(word, 0), groupIndex); }
   size_t getFactor(Word word, size_t groupIndex) const;
-  bool lemmaHasFactorGroup(size_t factor0Index, size_t g) const { return lemmaHasFactorGroup_[factor0Index][g]; }
+  bool lemmaHasFactorGroup(size_t factor0Index, size_t g) const { return (lemmaFactorGroups_[factor0Index] >> g) & 1; }
+  void getFactorMasks(size_t g, const WordIndex* indices, size_t n, float* out) const; // [i] -> 1.0 if lemma (unit) indices[i] has factor group g, else 0
   const std::string& getFactorGroupPrefix(size_t groupIndex) const { return groupPrefixes_[groupIndex]; } // for diagnostics only
   const std::string& getFactorName(size_t groupIndex, size_t factorIndex) const { return factorVocab_[(WordIndex)(factorIndex + groupRanges_[groupIndex].first)]; }
   std::string decodeForDiagnostics(const Words& sentence) const;
@@ -128,7 +129,7 @@ private:
 #endif
   std::vector<size_t> factorGroups_;                   // [u] -> group id of factor u
   std::vector<std::pair<size_t, size_t>> groupRanges_; // [group id g] -> (u_begin,u_end) index range of factors u for this group. These don't overlap.
-  std::vector<std::vector<bool>> lemmaHasFactorGroup_; // [factor 0 index][g] -> true if lemma has factor group
+  std::vector<uint64_t> lemmaFactorGroups_;            // [factor 0 index] -> bit g set if lemma has factor group g
   Shape factorShape_;                                  // [g] number of factors in each factor group
   std::vector<size_t> factorStrides_;                  // [g] stride for factor dimension
 #ifdef FACTOR_FULL_EXPANSION
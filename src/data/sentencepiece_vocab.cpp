@@ -215,7 +215,7 @@ public:
     return Word::fromWordIndex(spm_->PieceToId(token));
   }
 
-  const std::string& operator[](Word id) const override {
+  std::string operator[](Word id) const override {
     ABORT_IF(id.toWordIndex() >= size(), "Unknown word id: ", id.toWordIndex());
     return spm_->IdToPiece(id.toWordIndex());
   }
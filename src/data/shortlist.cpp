@@ -2,7 +2,13 @@
 #include "microsoft/shortlist/utils/ParameterTree.h"
 #include "marian.h"
 #include "layers/lsh.h"
+#include "layers/hnsw.h"
+#include "data/factored_vocab.h"
+#include "tensors/cpu/intgemm_interface.h"
+#include "3rd_party/threadpool.h"
 
+#include <iterator>
+#include <numeric>
 #include <queue>
 
 namespace marian {
@@ -16,6 +22,121 @@ const T* get(const void*& current, size_t num = 1) {
   return ptr;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////
+
+// Node whose value lives in the shortlist cache instead of the graph workspace. If the value is not
+// filled yet, it copies the freshly selected child into it, otherwise the child is only used to find
+// the graph and nothing is computed. The flag is shared with the cache entry, since the graph might be
+// cleared before it runs forward, in which case the entry stays unfilled.
+class ShortlistCacheNodeOp : public NaryNodeOp {
+private:
+  Ptr<bool> filled_;
+
+public:
+  ShortlistCacheNodeOp(Expr child, Tensor value, Ptr<bool> filled)
+  : NaryNodeOp({child}, value->shape(), value->type()), filled_(filled) {
+    val_ = value;
+    destroy_ = false; // memory is owned by the cache
+    setTrainable(false);
+  }
+
+  void forward() override {
+    if(*filled_)
+      return;
+    Tensor in = child(0)->val();
+    if(isIntgemm(in->type())) // packed matrices, copy the raw bytes (CPU only)
+      std::copy(in->data<char>(), in->data<char>() + requiredBytes(in->shape(), in->type()), val_->data<char>());
+    else
+      val_->copyFrom(in);
+    *filled_ = true;
+  }
+
+  void backward() override {}
+
+  const std::string type() override { return "shortlist-cache"; }
+
+  virtual size_t hash() override {
+    size_t seed = NaryNodeOp::hash();
+    util::hash_combine(seed, val_.get());
+    return seed;
+  }
+
+  virtual bool equal(Expr node) override {
+    return NaryNodeOp::equal(node) && node->val() == val_;
+  }
+};
+
+ShortlistCache::ShortlistCache(size_t budgetMB) : budget_(budgetMB * 1024 * 1024) {}
+
+// Evicts least-recently-used entries until `bytes` more fit into the budget. Entries that are still
+// referenced by a graph are kept. Returns false if that is not enough.
+bool ShortlistCache::evict(GraphCache& cache, size_t bytes) {
+  if(bytes > budget_) // would never fit, keep the other entries
+    return false;
+  auto it = cache.entries.end();
+  while(cache.bytes + bytes > budget_ && it != cache.entries.begin()) {
+    --it;
+    if(it->value.useCount() > 1)
+      continue;
+    auto& bucket = cache.lookup[it->hash];
+    bucket.erase(std::find(bucket.begin(), bucket.end(), it));
+    if(bucket.empty())
+      cache.lookup.erase(it->hash);
+    cache.bytes -= it->value->memory()->size();
+    cache.allocator->free(it->value);
+    it = cache.entries.erase(it);
+  }
+  return cache.bytes + bytes <= budget_;
+}
+
+Expr ShortlistCache::getOrSelect(Expr source, const std::vector<WordIndex>& indices, const std::function<Expr()>& select) {
+  auto graph = source->graph();
+  size_t hash = util::hashMem<WordIndex>(indices.data(), indices.size());
+  util::hash_combine(hash, source->name());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& cache = graphs_[graph.get()];
+  if(cache.graph.lock() != graph) {
+    cache = GraphCache();
+    cache.graph = graph;
+    cache.allocator = New<TensorAllocator>(graph->getBackend());
+  }
+
+  auto found = cache.lookup.find(hash);
+  if(found != cache.lookup.end()) {
+    for(auto it : found->second) {
+      if(it->source == source->name() && it->indices == indices) {
+        cache.entries.splice(cache.entries.begin(), cache.entries, it); // move to front, iterators stay valid
+        if(*it->filled) {
+          hits_++;
+          return Expression<ShortlistCacheNodeOp>(source, it->value, it->filled);
+        }
+        // not filled yet: select again, whichever node runs forward first fills the entry
+        misses_++;
+        return Expression<ShortlistCacheNodeOp>(select(), it->value, it->filled);
+      }
+    }
+  }
+
+  misses_++;
+  if((hits_ + misses_) % 1000 == 0)
+    LOG(debug, "[data] Shortlist cache hit rate {:.1f}%, {} entries, {} MB",
+        100.f * hits_ / (hits_ + misses_), cache.entries.size(), cache.bytes / (1024 * 1024));
+
+  Expr selected = select();
+  size_t bytes = requiredBytes(selected->shape(), selected->value_type());
+  if(!evict(cache, bytes))
+    return selected;
+
+  Tensor value;
+  cache.allocator->allocate(value, selected->shape(), selected->value_type());
+  auto filled = New<bool>(false);
+  cache.entries.push_front({hash, source->name(), indices, value, filled});
+  cache.lookup[hash].push_back(cache.entries.begin());
+  cache.bytes += value->memory()->size();
+  return Expression<ShortlistCacheNodeOp>(selected, value, filled);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////
 Shortlist::Shortlist(const std::vector<WordIndex>& indices)
   : indices_(indices), 
@@ -33,11 +154,29 @@ WordIndex Shortlist::tryForwardMap(WordIndex wIdx) const {
     return npos;                                        // return npos if not found, @TODO: replace with std::optional once we switch to C++17?
 }
 
+// Adds the first words that are not in the shortlist yet. These are real candidates and get correct
+// scores, so this is safe.
+void Shortlist::padToMultipleOf8() {
+  if(indices_.size() % 8 == 0)
+    return;
+  std::vector<WordIndex> padding;
+  for(WordIndex wIdx = 0; (indices_.size() + padding.size()) % 8 != 0; ++wIdx)
+    if(!std::binary_search(indices_.begin(), indices_.end(), wIdx))
+      padding.push_back(wIdx);
+  std::vector<WordIndex> padded;
+  std::merge(indices_.begin(), indices_.end(), padding.begin(), padding.end(), std::back_inserter(padded));
+  indices_.swap(padded);
+}
+
 void Shortlist::filter(Expr input, Expr weights, bool isLegacyUntransposedW, Expr b, Expr lemmaEt) {
   if (initialized_) {
     return;
   }
 
+  // Packed intgemm matrices can only be gathered in blocks of 8 columns
+  if(isIntgemm(weights->value_type()))
+    padToMultipleOf8();
+
   auto forward = [this](Expr out, const std::vector<Expr>& ) {
     out->val()->set(indices_);
   };
@@ -61,25 +200,138 @@ void Shortlist::createCachedTensors(Expr weights,
                           Expr b,
                           Expr lemmaEt,
                           int k) {
-  ABORT_IF(isLegacyUntransposedW, "Legacy untranspose W not yet tested");
-  cachedShortWt_ = index_select(weights, isLegacyUntransposedW ? -1 : 0, indicesExpr_);
-  cachedShortWt_ = reshape(cachedShortWt_, {1, 1, cachedShortWt_->shape()[0], cachedShortWt_->shape()[1]});
+  // with a cache, a recurring set of indices reuses the rows selected for an earlier batch
+  auto select = [this](Expr source, const std::function<Expr()>& selectFn) {
+    return cache_ ? cache_->getOrSelect(source, indices_, selectFn) : selectFn();
+  };
+
+  if(isIntgemm(weights->value_type())) {
+    // intgemm output matrix [dim x vocab], gather the columns directly from the packed memory
+    cachedShortWt_ = select(weights, [&]() { return cpu::integer::selectColumnsB(weights, indicesExpr_); });
+  } else {
+    ABORT_IF(isLegacyUntransposedW, "Legacy untranspose W not yet tested");
+    cachedShortWt_ = select(weights, [&]() { return index_select(weights, isLegacyUntransposedW ? -1 : 0, indicesExpr_); });
+    cachedShortWt_ = reshape(cachedShortWt_, {1, 1, cachedShortWt_->shape()[0], cachedShortWt_->shape()[1]});
+  }
 
   if (b) {
-    cachedShortb_ = index_select(b, -1, indicesExpr_);
+    cachedShortb_ = select(b, [&]() { return index_select(b, -1, indicesExpr_); });
   }
 
   if (lemmaEt) {
-    cachedShortLemmaEt_ = index_select(lemmaEt, -1, indicesExpr_);
+    cachedShortLemmaEt_ = select(lemmaEt, [&]() { return index_select(lemmaEt, -1, indicesExpr_); });
     cachedShortLemmaEt_ = reshape(cachedShortLemmaEt_, {1, 1, cachedShortLemmaEt_->shape()[0], k});
   }
 }
 
 ///////////////////////////////////////////////////////////////////////////////////
 
-LSHShortlist::LSHShortlist(int k, int nbits, size_t lemmaSize, bool abortIfDynamic)
+SentenceShortlist::SentenceShortlist(const std::vector<std::vector<WordIndex>>& sentenceIndices,
+                                     const std::vector<WordIndex>& sharedIndices,
+                                     WordIndex padFrom,
+                                     size_t vocabSize)
+  : Shortlist(std::vector<WordIndex>()), k_(0), shared_(sharedIndices) {
+  ABORT_IF(sentenceIndices.empty(), "Per-sentence shortlist requires at least one sentence");
+  std::vector<std::vector<WordIndex>> others(sentenceIndices.size()); // words of each set that are not shared
+  for(size_t i = 0; i < sentenceIndices.size(); ++i) {
+    std::set_difference(sentenceIndices[i].begin(), sentenceIndices[i].end(), shared_.begin(), shared_.end(),
+                        std::back_inserter(others[i]));
+    k_ = std::max(k_, (int)(shared_.size() + others[i].size()));
+  }
+  // multiple of 8 like all other shortlists, this keeps the rows of the gathered matrices aligned
+  k_ = std::min((int)vocabSize, (k_ + 7) / 8 * 8);
+
+  sentenceIndices_.reserve(sentenceIndices.size() * k_);
+  for(const auto& indices : others) {
+    // padding words are real candidates and get correct scores, so this is safe
+    std::vector<WordIndex> padding;
+    for(WordIndex wIdx = padFrom; shared_.size() + indices.size() + padding.size() < (size_t)k_; ++wIdx) {
+      if(wIdx >= vocabSize) // wrap around to the most frequent words
+        wIdx = 0;
+      if(!std::binary_search(indices.begin(), indices.end(), wIdx) && !std::binary_search(shared_.begin(), shared_.end(), wIdx))
+        padding.push_back(wIdx);
+    }
+    std::sort(padding.begin(), padding.end());
+    sentenceIndices_.insert(sentenceIndices_.end(), shared_.begin(), shared_.end());
+    std::merge(indices.begin(), indices.end(), padding.begin(), padding.end(), std::back_inserter(sentenceIndices_));
+  }
+
+  // the union is only used if the output matrix can not be gathered per sentence, see filter()
+  indices_ = sentenceIndices_;
+  std::sort(indices_.begin(), indices_.end());
+  indices_.erase(std::unique(indices_.begin(), indices_.end()), indices_.end());
+  padToMultipleOf8(); // now rather than in filter(), which runs after beam search mapped the suppressed words
+
+  rows_.resize(sentenceIndices.size());
+  std::iota(rows_.begin(), rows_.end(), 0);
+}
+
+WordIndex SentenceShortlist::reverseMap(int beamIdx, int batchIdx, int idx) const {
+  if(!perSentence_)
+    return Shortlist::reverseMap(beamIdx, batchIdx, idx);
+  return sentenceIndices_[rows_[batchIdx] * k_ + idx];
+}
+
+// Only the shared words have the same packed index in all sentences, other words can not be mapped.
+WordIndex SentenceShortlist::tryForwardMap(WordIndex wIdx) const {
+  if(!perSentence_)
+    return Shortlist::tryForwardMap(wIdx);
+  auto found = std::lower_bound(shared_.begin(), shared_.end(), wIdx);
+  if(found == shared_.end() || *found != wIdx)
+    return npos;
+  return (WordIndex)std::distance(shared_.begin(), found);
+}
+
+void SentenceShortlist::selectBatchEntries(const std::vector<IndexType>& batchIndices) {
+  if(batchIndices.size() == rows_.size()) // batch indices are sorted, so nothing was removed
+    return;
+  std::vector<size_t> rows;
+  rows.reserve(batchIndices.size());
+  for(auto batchIdx : batchIndices)
+    rows.push_back(rows_[batchIdx]);
+  rows_.swap(rows);
+  rowsChanged_ = true;
+}
+
+void SentenceShortlist::filter(Expr input, Expr weights, bool isLegacyUntransposedW, Expr b, Expr lemmaEt) {
+  // packed intgemm matrices, legacy untransposed matrices and factored outputs use the union of all sets
+  if(!perSentence_ || isIntgemm(weights->value_type()) || isLegacyUntransposedW || lemmaEt) {
+    perSentence_ = false;
+    Shortlist::filter(input, weights, isLegacyUntransposedW, b, lemmaEt);
+    return;
+  }
+
+  if(initialized_ && !rowsChanged_)
+    return;
+
+  // candidate sets of the sentences that are still in the batch
+  std::vector<WordIndex> indices;
+  indices.reserve(rows_.size() * k_);
+  for(auto row : rows_)
+    indices.insert(indices.end(), sentenceIndices_.begin() + row * k_, sentenceIndices_.begin() + (row + 1) * k_);
+
+  auto forward = [indices](Expr out, const std::vector<Expr>& ) {
+    out->val()->set(indices);
+  };
+
+  Shape kShape({(int)rows_.size(), k_});
+  indicesExpr_ = lambda({input, weights}, kShape, Type::uint32, forward);
+
+  initialized_ = true;
+  rowsChanged_ = false;
+}
+
+Expr SentenceShortlist::getIndicesExpr() const {
+  if(!perSentence_)
+    return Shortlist::getIndicesExpr();
+  return indicesExpr_; // [current batch, k]
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+
+LSHShortlist::LSHShortlist(int k, int nbits, size_t lemmaSize, bool abortIfDynamic, Ptr<ThreadPool> pool)
 : Shortlist(std::vector<WordIndex>()), 
-  k_(k), nbits_(nbits), lemmaSize_(lemmaSize), abortIfDynamic_(abortIfDynamic) {
+  k_(k), nbits_(nbits), lemmaSize_(lemmaSize), abortIfDynamic_(abortIfDynamic), pool_(pool) {
 }
 
 WordIndex LSHShortlist::reverseMap(int beamIdx, int batchIdx, int idx) const {
@@ -94,12 +346,18 @@ Expr LSHShortlist::getIndicesExpr() const {
   return indicesExpr_;
 }
 
+Expr LSHShortlist::search(Expr input, Expr weights) const {
+  return lsh::search(input, weights, k_, nbits_, (int)lemmaSize_, abortIfDynamic_, pool_.get());
+}
+
 void LSHShortlist::filter(Expr input, Expr weights, bool isLegacyUntransposedW, Expr b, Expr lemmaEt) {
 
   ABORT_IF(input->graph()->getDeviceId().type == DeviceType::gpu,
-           "LSH index (--output-approx-knn) currently not implemented for GPU");
+           "Approximate output layer search (--output-approx-knn, --output-hnsw) currently not implemented for GPU");
+  ABORT_IF(isIntgemm(weights->value_type()),
+           "Approximate output layer search (--output-approx-knn, --output-hnsw) currently not implemented for intgemm output matrices");
 
-  indicesExpr_ = callback(lsh::search(input, weights, k_, nbits_, (int)lemmaSize_, abortIfDynamic_),
+  indicesExpr_ = callback(search(input, weights),
                           [this](Expr node) { 
                             node->val()->get(indices_); // set the value of the field indices_ whenever the graph traverses this node
                           });
@@ -135,12 +393,33 @@ void LSHShortlist::createCachedTensors(Expr weights,
   }
 }
 
-LSHShortlistGenerator::LSHShortlistGenerator(int k, int nbits, size_t lemmaSize, bool abortIfDynamic) 
+LSHShortlistGenerator::LSHShortlistGenerator(int k, int nbits, size_t lemmaSize, bool abortIfDynamic, size_t threads) 
   : k_(k), nbits_(nbits), lemmaSize_(lemmaSize), abortIfDynamic_(abortIfDynamic) {
+  // the thread that runs the graph searches its share of the hypotheses, too
+  if(threads > 1)
+    pool_ = New<ThreadPool>(threads - 1);
 }
 
 Ptr<Shortlist> LSHShortlistGenerator::generate(Ptr<data::CorpusBatch> batch) const {
-  return New<LSHShortlist>(k_, nbits_, lemmaSize_, abortIfDynamic_);
+  return New<LSHShortlist>(k_, nbits_, lemmaSize_, abortIfDynamic_, pool_);
+}
+
+HNSWShortlist::HNSWShortlist(int k, int ef, size_t lemmaSize, bool abortIfDynamic, Ptr<ThreadPool> pool)
+: LSHShortlist(k, /*nbits=*/0, lemmaSize, abortIfDynamic, pool), ef_(ef) {
+}
+
+Expr HNSWShortlist::search(Expr input, Expr weights) const {
+  return hnsw::search(input, weights, k_, ef_, (int)lemmaSize_, abortIfDynamic_, pool_.get());
+}
+
+HNSWShortlistGenerator::HNSWShortlistGenerator(int k, int ef, size_t lemmaSize, bool abortIfDynamic, size_t threads)
+  : k_(k), ef_(ef), lemmaSize_(lemmaSize), abortIfDynamic_(abortIfDynamic) {
+  if(threads > 1)
+    pool_ = New<ThreadPool>(threads - 1);
+}
+
+Ptr<Shortlist> HNSWShortlistGenerator::generate(Ptr<data::CorpusBatch> batch) const {
+  return New<HNSWShortlist>(k_, ef_, lemmaSize_, abortIfDynamic_, pool_);
 }
 
 //////////////////////////////////////////////////////////////////////////////////////
@@ -262,7 +541,7 @@ Ptr<Shortlist> QuicksandShortlistGenerator::generate(Ptr<data::CorpusBatch> batc
     indices.push_back((WordIndex)i);
 
   std::sort(indices.begin(), indices.end());
-  return New<Shortlist>(indices);
+  return withCache(New<Shortlist>(indices));
 }
 
 Ptr<ShortlistGenerator> createShortlistGenerator(Ptr<Options> options,
@@ -272,23 +551,65 @@ Ptr<ShortlistGenerator> createShortlistGenerator(Ptr<Options> options,
                                                  size_t srcIdx,
                                                  size_t trgIdx,
                                                  bool shared) {
-  if (lshOpts.size()) {
+  if(options->hasAndNotEmpty("output-hnsw")) {
+    ABORT_IF(lshOpts.size(), "--output-approx-knn and --output-hnsw cannot be used at the same time");
+    auto hnswOpts = options->get<std::vector<int>>("output-hnsw");
+    ABORT_IF(hnswOpts.size() > 2, "--output-hnsw takes 1 or 2 parameters");
+    int k  = hnswOpts[0];
+    int ef = hnswOpts.size() > 1 ? hnswOpts[1] : 2 * k;
+    ABORT_IF(ef < k, "The number of candidates of the HNSW search ({}) needs to be at least k ({})", ef, k);
+    size_t threads = options->get<size_t>("output-approx-knn-threads", 1);
+    return New<HNSWShortlistGenerator>(k, ef, trgVocab->lemmaSize(), /*abortIfDynamic=*/false, threads);
+  }
+  else if (lshOpts.size()) {
     assert(lshOpts.size() == 2);
     size_t lemmaSize = trgVocab->lemmaSize();
-    return New<LSHShortlistGenerator>(lshOpts[0], lshOpts[1], lemmaSize, /*abortIfDynamic=*/false);
+    size_t threads = options->get<size_t>("output-approx-knn-threads", 1);
+    return New<LSHShortlistGenerator>(lshOpts[0], lshOpts[1], lemmaSize, /*abortIfDynamic=*/false, threads);
   }
   else {                                                   
     std::vector<std::string> vals = options->get<std::vector<std::string>>("shortlist");
     ABORT_IF(vals.empty(), "No path to shortlist given");
     std::string fname = vals[0];
+    Ptr<ShortlistGenerator> generator;
     if(isBinaryShortlist(fname)){
-        return New<BinaryShortlistGenerator>(options, srcVocab, trgVocab, srcIdx, trgIdx, shared);
+        generator = New<BinaryShortlistGenerator>(options, srcVocab, trgVocab, srcIdx, trgIdx, shared);
     } else if(filesystem::Path(fname).extension().string() == ".bin") {
-      return New<QuicksandShortlistGenerator>(options, srcVocab, trgVocab, srcIdx, trgIdx, shared);
+      generator = New<QuicksandShortlistGenerator>(options, srcVocab, trgVocab, srcIdx, trgIdx, shared);
     } else {
-      return New<LexicalShortlistGenerator>(options, srcVocab, trgVocab, srcIdx, trgIdx, shared);
+      generator = New<LexicalShortlistGenerator>(options, srcVocab, trgVocab, srcIdx, trgIdx, shared);
     }
+
+    size_t cacheMB = options->get<size_t>("shortlist-cache", 0);
+    if(cacheMB > 0) {
+      LOG(info, "[data] Caching short-listed output matrices of up to {} MB per device", cacheMB);
+      generator->setCache(New<ShortlistCache>(cacheMB));
+    }
+    return generator;
+  }
+}
+
+bool usePerSentenceShortlist(Ptr<Options> options, Ptr<const Vocab> trgVocab) {
+  if(!options->get<bool>("shortlist-per-sentence", false))
+    return false;
+  if(trgVocab->tryAs<FactoredVocab>()) {
+    LOG_ONCE(warn, "[data] --shortlist-per-sentence is not supported with factored vocabularies, using one shortlist per batch");
+    return false;
   }
+  LOG_ONCE(info, "[data] Using one shortlist per sentence");
+  return true;
+}
+
+std::vector<WordIndex> sentenceShortlistSharedWords(Ptr<const Vocab> trgVocab, size_t firstNum) {
+  std::vector<WordIndex> shared;
+  for(WordIndex i = 0; i < firstNum && i < trgVocab->size(); ++i)
+    shared.push_back(i);
+  shared.push_back(trgVocab->getEosId().toWordIndex());
+  auto suppressed = trgVocab->suppressedIndices(/*suppressUnk=*/true, /*suppressSpecial=*/true);
+  shared.insert(shared.end(), suppressed.begin(), suppressed.end());
+  std::sort(shared.begin(), shared.end());
+  shared.erase(std::unique(shared.begin(), shared.end()), shared.end());
+  return shared;
 }
 
 bool isBinaryShortlist(const std::string& fileName){
@@ -372,7 +693,8 @@ BinaryShortlistGenerator::BinaryShortlistGenerator(Ptr<Options> options,
       srcVocab_(srcVocab),
       trgVocab_(trgVocab),
       srcIdx_(srcIdx),
-      shared_(shared) {
+      shared_(shared),
+      perSentence_(usePerSentenceShortlist(options, trgVocab)) {
 
   std::vector<std::string> vals = options_->get<std::vector<std::string>>("shortlist");
   ABORT_IF(vals.empty(), "No path to shortlist file given");
@@ -408,11 +730,48 @@ BinaryShortlistGenerator::BinaryShortlistGenerator(const void *ptr_void,
   load(ptr_void, blobSize, check);
 }
 
+BinaryShortlistGenerator::BinaryShortlistGenerator(Ptr<const Vocab> srcVocab,
+                                                   Ptr<const Vocab> trgVocab,
+                                                   const std::vector<std::unordered_map<WordIndex, float>>& srcTgtProbTable,
+                                                   uint64_t firstNum,
+                                                   uint64_t bestNum,
+                                                   double threshold,
+                                                   bool shared /*= false*/)
+    : srcVocab_(srcVocab),
+      trgVocab_(trgVocab),
+      srcIdx_(0),
+      shared_(shared),
+      firstNum_(firstNum),
+      bestNum_(bestNum) {
+  build(srcTgtProbTable, threshold);
+}
+
 Ptr<Shortlist> BinaryShortlistGenerator::generate(Ptr<data::CorpusBatch> batch) const {
   auto srcBatch = (*batch)[srcIdx_];
   size_t srcVocabSize = srcVocab_->size();
   size_t trgVocabSize = trgVocab_->size();
 
+  if(perSentence_) {
+    // A sentence selects far fewer words than the vocabulary size, so sort instead of truth tables
+    std::vector<std::vector<WordIndex>> sentenceIndices(srcBatch->batchSize());
+    for(size_t b = 0; b < srcBatch->batchSize(); ++b) {
+      auto& indices = sentenceIndices[b];
+      for(size_t w = 0; w < srcBatch->batchWidth(); ++w) {
+        size_t pos = srcBatch->locate(b, w);
+        if(srcBatch->mask()[pos] == 0.f) // padding
+          continue;
+        WordIndex srcIndex = srcBatch->data()[pos].toWordIndex();
+        if(shared_)
+          indices.push_back(srcIndex);
+        indices.insert(indices.end(), shortLists_ + wordToOffset_[srcIndex], shortLists_ + wordToOffset_[srcIndex + 1]);
+      }
+      std::sort(indices.begin(), indices.end());
+      indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+    }
+    return withCache(New<SentenceShortlist>(sentenceIndices, sentenceShortlistSharedWords(trgVocab_, firstNum_),
+                                            (WordIndex)firstNum_, trgVocabSize));
+  }
+
   // Since V=trgVocab_->size() is not large, anchor the time and space complexity to O(V).
   // Attempt to squeeze the truth tables into CPU cache
   std::vector<bool> srcTruthTable(srcVocabSize, 0);  // holds selected source words
@@ -459,7 +818,7 @@ Ptr<Shortlist> BinaryShortlistGenerator::generate(Ptr<data::CorpusBatch> batch)
       indices.push_back(i);
   }
 
-  return New<Shortlist>(indices);
+  return withCache(New<Shortlist>(indices));
 }
 
 void BinaryShortlistGenerator::dump(const std::string& fileName) const {
@@ -487,6 +846,10 @@ void BinaryShortlistGenerator::import(const std::string& filename, double thresh
       srcTgtProbTable[sId][tId] = prob;
   }
 
+  build(srcTgtProbTable, threshold);
+}
+
+void BinaryShortlistGenerator::build(const std::vector<std::unordered_map<WordIndex, float>>& srcTgtProbTable, double threshold) {
   // Create priority queue and count
   std::vector<std::priority_queue<std::pair<float, WordIndex>>> vpq;
   uint64_t shortListsSize = 0;
@@ -495,7 +858,7 @@ void BinaryShortlistGenerator::import(const std::string& filename, double thresh
   for(WordIndex sId = 0; sId < srcTgtProbTable.size(); sId++) {
     uint64_t shortListsSizeCurrent = 0;
     for(auto entry : srcTgtProbTable[sId]) {
-      if (entry.first>=threshold) {
+      if (entry.second>=threshold) {
         vpq[sId].push(std::make_pair(entry.second, entry.first));
         if(shortListsSizeCurrent < bestNum_)
           shortListsSizeCurrent++;
@@ -14,14 +14,62 @@
 #include <iostream>
 #include <algorithm>
 #include <limits>
+#include <functional>
+#include <list>
+#include <mutex>
 
 namespace faiss {
   struct IndexLSH;
 }
 
 namespace marian {
+class ExpressionGraph;
+class TensorAllocator;
+class ThreadPool;
+
 namespace data {
 
+// Keeps the short-listed output matrices and biases of recent batches, so that a set of shortlist indices
+// that occurs again (e.g. recurring requests in a server) does not gather the same rows again. Entries are
+// keyed by the source parameter and a hash of the sorted indices, stored in a separate allocator for every
+// graph and evicted in least-recently-used order once they take more than the budget on that graph.
+class ShortlistCache {
+private:
+  struct Entry {
+    size_t hash;
+    std::string source;
+    std::vector<WordIndex> indices;
+    Tensor value;
+    Ptr<bool> filled; // set by the node that copies the selection into value when the graph runs forward
+  };
+
+  struct GraphCache {
+    Weak<ExpressionGraph> graph; // detects a new graph at the address of a destroyed one
+    Ptr<TensorAllocator> allocator;
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<size_t, std::vector<std::list<Entry>::iterator>> lookup;
+    size_t bytes{0};
+  };
+
+  size_t budget_; // in bytes per graph
+  std::unordered_map<ExpressionGraph*, GraphCache> graphs_;
+  std::mutex mutex_;
+  size_t hits_{0};
+  size_t misses_{0};
+
+  bool evict(GraphCache& cache, size_t bytes);
+
+public:
+  ShortlistCache(size_t budgetMB);
+
+  // Returns the selection of `indices` from `source` from the cache if possible. Otherwise returns the
+  // result of `select()`, which is also stored in the cache if it fits into the budget.
+  Expr getOrSelect(Expr source, const std::vector<WordIndex>& indices, const std::function<Expr()>& select);
+
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+};
+
 class Shortlist {
 protected:
   std::vector<WordIndex> indices_;    // // [packed shortlist index] -> word index, used to select columns from output embeddings
@@ -31,7 +79,9 @@ protected:
   Expr cachedShortb_;   // these match the current value of shortlist_
   Expr cachedShortLemmaEt_;
   bool initialized_; // used by batch-level shortlist. Only initialize with 1st call then skip all subsequent calls for same batch
+  Ptr<ShortlistCache> cache_; // optional, shared by all shortlists of a generator
   
+  void padToMultipleOf8(); // with words that are not in the shortlist yet
   void createCachedTensors(Expr weights,
                            bool isLegacyUntransposedW,
                            Expr b,
@@ -42,10 +92,17 @@ public:
 
   Shortlist(const std::vector<WordIndex>& indices);
   virtual ~Shortlist();
+
+  void setCache(Ptr<ShortlistCache> cache) { cache_ = cache; }
   
   virtual bool isDynamic() const { return false; }
+  // true if every batch entry has its own candidate set and the output layer has to use gatherAffine()
+  virtual bool isPerSentence() const { return false; }
+  // batchIdx is the index of the batch entry in the current (possibly purged) batch
   virtual WordIndex reverseMap(int beamIdx, int batchIdx, int idx) const;
   virtual WordIndex tryForwardMap(WordIndex wIdx) const;
+  // called during decoding when batch entries are removed, see EncoderDecoder::step()
+  virtual void selectBatchEntries(const std::vector<IndexType>& /*batchIndices*/) {}
 
   virtual void filter(Expr input, Expr weights, bool isLegacyUntransposedW, Expr b, Expr lemmaEt);
   virtual Expr getIndicesExpr() const;
@@ -54,10 +111,63 @@ public:
   virtual Expr getCachedShortLemmaEt() const { return cachedShortLemmaEt_; }
 };
 
+// Shortlist with its own candidate set for every sentence of the batch. The union over a large batch
+// approaches the full vocabulary, while the sets of single sentences stay small. All sets are padded
+// to a common size k with additional real words, so that the output layer can compute the logits for
+// the whole batch with one gather-GEMM of shape [beam, 1, batch, k]. Batch entries that are purged
+// during beam search are removed with selectBatchEntries(). Intgemm output matrices can only be
+// gathered for the whole batch and legacy untransposed matrices are not supported by the gather-GEMM,
+// in those cases this falls back to the union of all sets.
+class SentenceShortlist : public Shortlist {
+private:
+  int k_;                                  // common size of all candidate sets
+  std::vector<WordIndex> shared_;          // words at the start of every set, sorted
+  std::vector<WordIndex> sentenceIndices_; // [original batch index * k + packed index] -> word index
+  std::vector<size_t> rows_;               // [current batch index] -> original batch index
+  bool perSentence_{true};
+  bool rowsChanged_{false};
+
+public:
+  // sentenceIndices are sorted candidate sets for each sentence. Every set starts with the sorted shared
+  // words, so that these have the same packed index in all sentences and can be mapped with tryForwardMap(),
+  // followed by the other words of the set, which are padded with the first words from padFrom on that are
+  // not in the set yet.
+  SentenceShortlist(const std::vector<std::vector<WordIndex>>& sentenceIndices,
+                    const std::vector<WordIndex>& sharedIndices,
+                    WordIndex padFrom,
+                    size_t vocabSize);
+
+  virtual bool isPerSentence() const override { return perSentence_; }
+  virtual WordIndex reverseMap(int beamIdx, int batchIdx, int idx) const override;
+  virtual WordIndex tryForwardMap(WordIndex wIdx) const override;
+  virtual void selectBatchEntries(const std::vector<IndexType>& batchIndices) override;
+
+  virtual void filter(Expr input, Expr weights, bool isLegacyUntransposedW, Expr b, Expr lemmaEt) override;
+  virtual Expr getIndicesExpr() const override;
+};
+
+// Whether generators should create a SentenceShortlist, i.e. --shortlist-per-sentence is set and
+// the target vocabulary is not factored
+bool usePerSentenceShortlist(Ptr<Options> options, Ptr<const Vocab> trgVocab);
+
+// Words that are part of every set of a SentenceShortlist: the firstNum most frequent words, end-of-sentence
+// and the words beam search may suppress (<unk> and special words), which it has to find in every set
+std::vector<WordIndex> sentenceShortlistSharedWords(Ptr<const Vocab> trgVocab, size_t firstNum);
+
 class ShortlistGenerator {
+protected:
+  Ptr<ShortlistCache> cache_; // see --shortlist-cache
+
+  Ptr<Shortlist> withCache(Ptr<Shortlist> shortlist) const {
+    shortlist->setCache(cache_);
+    return shortlist;
+  }
+
 public:
   virtual ~ShortlistGenerator() {}
 
+  void setCache(Ptr<ShortlistCache> cache) { cache_ = cache; }
+
   virtual Ptr<Shortlist> generate(Ptr<data::CorpusBatch> batch) const = 0;
 
   // Writes text version of (possibly) pruned short list to file
@@ -71,15 +181,19 @@ public:
 // faster inference inspired by these 2 papers
 // https://arxiv.org/pdf/1903.03129.pdf      https://arxiv.org/pdf/1806.00588.pdf
 class LSHShortlist: public Shortlist {
-private:
+protected:
   int k_; // number of candidates returned from each input 
   int nbits_; // length of hash
   size_t lemmaSize_; // vocab size
   bool abortIfDynamic_; // if true disallow dynamic allocation for encoded weights and rotation matrix (only allow use of pre-allocated parameters)
+  Ptr<ThreadPool> pool_; // if set, hypotheses are searched in parallel
 
   static Ptr<faiss::IndexLSH> index_; // LSH index to store all possible candidates
   static std::mutex mutex_;
 
+  // returns the indices of the k candidates [beam, batch, k] for every hypothesis
+  virtual Expr search(Expr input, Expr weights) const;
+
   void createCachedTensors(Expr weights,
                            bool isLegacyUntransposedW,
                            Expr b,
@@ -87,7 +201,7 @@ private:
                            int k);
 
 public:
-  LSHShortlist(int k, int nbits, size_t lemmaSize, bool abortIfDynamic = false);
+  LSHShortlist(int k, int nbits, size_t lemmaSize, bool abortIfDynamic = false, Ptr<ThreadPool> pool = nullptr);
 
   virtual bool isDynamic() const override { return true; }
   virtual WordIndex reverseMap(int beamIdx, int batchIdx, int idx) const override;
@@ -103,9 +217,37 @@ private:
   int nbits_;
   size_t lemmaSize_;
   bool abortIfDynamic_;
+  Ptr<ThreadPool> pool_; // shared by all shortlists, nullptr for a single thread
 
 public:
-  LSHShortlistGenerator(int k, int nbits, size_t lemmaSize, bool abortIfDynamic = false);
+  // threads > 1 searches the hypotheses of a batch with that many threads
+  LSHShortlistGenerator(int k, int nbits, size_t lemmaSize, bool abortIfDynamic = false, size_t threads = 1);
+  Ptr<Shortlist> generate(Ptr<data::CorpusBatch> batch) const override;
+};
+
+// Same as the LSH shortlist, but the candidates are found by searching an HNSW graph over the output
+// embeddings for the largest inner products (see layers/hnsw.h)
+class HNSWShortlist : public LSHShortlist {
+private:
+  int ef_; // number of candidates kept during the search, >= k
+
+  virtual Expr search(Expr input, Expr weights) const override;
+
+public:
+  HNSWShortlist(int k, int ef, size_t lemmaSize, bool abortIfDynamic = false, Ptr<ThreadPool> pool = nullptr);
+};
+
+class HNSWShortlistGenerator : public ShortlistGenerator {
+private:
+  int k_;
+  int ef_;
+  size_t lemmaSize_;
+  bool abortIfDynamic_;
+  Ptr<ThreadPool> pool_; // shared by all shortlists, nullptr for a single thread
+
+public:
+  // threads > 1 searches the hypotheses of a batch with that many threads
+  HNSWShortlistGenerator(int k, int ef, size_t lemmaSize, bool abortIfDynamic = false, size_t threads = 1);
   Ptr<Shortlist> generate(Ptr<data::CorpusBatch> batch) const override;
 };
 
@@ -195,6 +337,7 @@ private:
 
   size_t srcIdx_;
   bool shared_{false};
+  bool perSentence_{false};
 
   size_t firstNum_{100};
   size_t bestNum_{100};
@@ -253,7 +396,8 @@ public:
         srcVocab_(srcVocab),
         trgVocab_(trgVocab),
         srcIdx_(srcIdx),
-        shared_(shared) {
+        shared_(shared),
+        perSentence_(usePerSentenceShortlist(options, trgVocab)) {
     std::vector<std::string> vals = options_->get<std::vector<std::string>>("shortlist");
 
     ABORT_IF(vals.empty(), "No path to filter path given");
@@ -298,6 +442,27 @@ public:
   virtual Ptr<Shortlist> generate(Ptr<data::CorpusBatch> batch) const override {
     auto srcBatch = (*batch)[srcIdx_];
 
+    if(perSentence_) {
+      std::vector<std::vector<WordIndex>> sentenceIndices(srcBatch->batchSize());
+      for(size_t b = 0; b < srcBatch->batchSize(); ++b) {
+        auto& indices = sentenceIndices[b];
+        for(size_t w = 0; w < srcBatch->batchWidth(); ++w) {
+          size_t pos = srcBatch->locate(b, w);
+          if(srcBatch->mask()[pos] == 0.f) // padding
+            continue;
+          WordIndex srcIndex = srcBatch->data()[pos].toWordIndex();
+          if(shared_)
+            indices.push_back(srcIndex);
+          for(auto& it : data_[srcIndex])
+            indices.push_back(it.first);
+        }
+        std::sort(indices.begin(), indices.end());
+        indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+      }
+      return withCache(New<SentenceShortlist>(sentenceIndices, sentenceShortlistSharedWords(trgVocab_, firstNum_),
+                                              (WordIndex)firstNum_, trgVocab_->size()));
+    }
+
     // add firstNum most frequent words
     std::unordered_set<WordIndex> indexSet;
     for(WordIndex i = 0; i < firstNum_ && i < trgVocab_->size(); ++i)
@@ -332,7 +497,7 @@ public:
     std::vector<WordIndex> indices(indexSet.begin(), indexSet.end());
     std::sort(indices.begin(), indices.end());
 
-    return New<Shortlist>(indices);
+    return withCache(New<Shortlist>(indices));
   }
 };
 
@@ -347,7 +512,7 @@ public:
   }
 
   Ptr<Shortlist> generate(Ptr<data::CorpusBatch> /*batch*/) const override {
-    return New<Shortlist>(indices_);
+    return withCache(New<Shortlist>(indices_));
   }
 };
 
@@ -412,6 +577,7 @@ private:
 
   size_t srcIdx_;
   bool shared_{false};
+  bool perSentence_{false};
 
   uint64_t firstNum_{100};  // baked into binary header
   uint64_t bestNum_{100};   // baked into binary header
@@ -442,6 +608,9 @@ private:
   void load(const std::string& filename, bool check=true);
   // import text shortlist from file
   void import(const std::string& filename, double threshold);
+  // create the binary blob from [WordIndex src] -> [WordIndex tgt] -> P_trans(tgt|src), keeping the bestNum_ best
+  // target words with a probability of at least threshold for every source word
+  void build(const std::vector<std::unordered_map<WordIndex, float>>& srcTgtProbTable, double threshold);
   // save blob to file (called by dump)
   void saveBlobToFile(const std::string& filename) const;
 
@@ -463,6 +632,15 @@ public:
                            bool shared = false,
                            bool check = true);
 
+  // construct from translation probabilities or other lexical scores, e.g. from ShortlistBuilder
+  BinaryShortlistGenerator(Ptr<const Vocab> srcVocab,
+                           Ptr<const Vocab> trgVocab,
+                           const std::vector<std::unordered_map<WordIndex, float>>& srcTgtProbTable,
+                           uint64_t firstNum,
+                           uint64_t bestNum,
+                           double threshold,
+                           bool shared = false);
+
   ~BinaryShortlistGenerator(){
     mmapMem_.unmap();
   }
@@ -0,0 +1,184 @@
+#include "data/shortlist_builder.h"
+#include "common/file_stream.h"
+#include "common/timer.h"
+#include "data/alignment.h"
+#include "3rd_party/threadpool.h"
+
+#include <algorithm>
+#include <future>
+
+namespace marian {
+namespace data {
+
+static inline uint64_t pairKey(WordIndex s, WordIndex t) { return ((uint64_t)s << 32) | t; }
+
+ShortlistBuilder::ShortlistBuilder(Ptr<const Vocab> srcVocab,
+                                   Ptr<const Vocab> trgVocab,
+                                   size_t threads,
+                                   size_t memoryMB)
+    : srcVocab_(srcVocab),
+      trgVocab_(trgVocab),
+      threads_(std::max<size_t>(threads, 1)),
+      // about 48 bytes per entry of the unordered_map, 3/4 of the budget for the global counts
+      maxPairs_(memoryMB * 1024 * 1024 / 48 * 3 / 4),
+      maxThreadPairs_(std::max<size_t>(memoryMB * 1024 * 1024 / 48 / 4 / threads_, 1)),
+      srcCounts_(srcVocab->size(), 0),
+      trgCounts_(trgVocab->size(), 0) {}
+
+// marian-scorer --alignment hard writes "score ||| alignment [||| WordScores= ...]", plain alignment
+// files only have the alignment
+static std::string alignmentField(const std::string& line) {
+  auto pos = line.find("|||");
+  if(pos == std::string::npos)
+    return line;
+  auto end = line.find("|||", pos + 3);
+  return line.substr(pos + 3, end == std::string::npos ? std::string::npos : end - pos - 3);
+}
+
+void ShortlistBuilder::countChunk(const std::vector<std::string>& srcLines,
+                                  const std::vector<std::string>& trgLines,
+                                  const std::vector<std::string>& alignLines,
+                                  size_t begin,
+                                  size_t end) {
+  Counts counts;
+  counts.src.resize(srcCounts_.size(), 0);
+  counts.trg.resize(trgCounts_.size(), 0);
+
+  std::vector<WordIndex> srcTypes, trgTypes;
+  for(size_t i = begin; i < end; ++i) {
+    Words src = srcVocab_->encode(srcLines[i], /*addEOS=*/false, /*inference=*/true);
+    Words trg = trgVocab_->encode(trgLines[i], /*addEOS=*/false, /*inference=*/true);
+
+    if(aligned_) {
+      // every link counts, positions outside of the sentences (e.g. EOS) are ignored
+      for(const auto& point : WordAlignment(alignmentField(alignLines[i]))) {
+        if(point.srcPos >= src.size() || point.tgtPos >= trg.size())
+          continue;
+        WordIndex s = src[point.srcPos].toWordIndex(), t = trg[point.tgtPos].toWordIndex();
+        counts.pairs[pairKey(s, t)]++;
+        counts.src[s]++;
+        counts.trg[t]++;
+      }
+    } else {
+      // every pair of word types in a sentence pair co-occurs once
+      srcTypes.clear();
+      for(auto w : src)
+        srcTypes.push_back(w.toWordIndex());
+      std::sort(srcTypes.begin(), srcTypes.end());
+      srcTypes.erase(std::unique(srcTypes.begin(), srcTypes.end()), srcTypes.end());
+
+      trgTypes.clear();
+      for(auto w : trg)
+        trgTypes.push_back(w.toWordIndex());
+      std::sort(trgTypes.begin(), trgTypes.end());
+      trgTypes.erase(std::unique(trgTypes.begin(), trgTypes.end()), trgTypes.end());
+
+      for(auto s : srcTypes) {
+        counts.src[s]++;
+        for(auto t : trgTypes)
+          counts.pairs[pairKey(s, t)]++;
+      }
+      for(auto t : trgTypes)
+        counts.trg[t]++;
+    }
+
+    if(counts.pairs.size() >= maxThreadPairs_)
+      merge(counts);
+  }
+  merge(counts);
+}
+
+void ShortlistBuilder::merge(Counts& counts) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for(const auto& it : counts.pairs)
+    pairCounts_[it.first] += it.second;
+  for(size_t i = 0; i < counts.src.size(); ++i)
+    srcCounts_[i] += counts.src[i];
+  for(size_t i = 0; i < counts.trg.size(); ++i)
+    trgCounts_[i] += counts.trg[i];
+
+  if(pairCounts_.size() > maxPairs_)
+    prune();
+
+  counts.pairs.clear();
+  std::fill(counts.src.begin(), counts.src.end(), 0);
+  std::fill(counts.trg.begin(), counts.trg.end(), 0);
+}
+
+// Removes the rarest pairs until 3/4 of the budget are used, rare pairs would not make it into
+// the shortlist anyway
+void ShortlistBuilder::prune() {
+  size_t before = pairCounts_.size();
+  while(pairCounts_.size() > maxPairs_ * 3 / 4) {
+    pruned_++;
+    for(auto it = pairCounts_.begin(); it != pairCounts_.end();) {
+      if(it->second <= pruned_)
+        it = pairCounts_.erase(it);
+      else
+        ++it;
+    }
+  }
+  LOG(info, "[data] Pruned word pairs with count <= {} to stay within the memory budget ({} -> {} pairs)",
+      pruned_, before, pairCounts_.size());
+}
+
+void ShortlistBuilder::count(const std::string& srcPath, const std::string& trgPath, const std::string& alignPath) {
+  aligned_ = !alignPath.empty();
+  LOG(info, "[data] Counting {} in {} and {} with {} threads",
+      aligned_ ? "aligned word pairs from " + alignPath : std::string("co-occurrences"), srcPath, trgPath, threads_);
+
+  io::InputFileStream srcIn(srcPath), trgIn(trgPath);
+  UPtr<io::InputFileStream> alignIn;
+  if(aligned_)
+    alignIn.reset(new io::InputFileStream(alignPath));
+
+  const size_t linesPerThread = 10000;
+  const size_t chunkSize = linesPerThread * threads_;
+  ThreadPool pool(threads_, threads_);
+  timer::Timer timer;
+
+  size_t lines = 0;
+  std::vector<std::string> srcLines(chunkSize), trgLines(chunkSize), alignLines(aligned_ ? chunkSize : 0);
+  for(bool done = false; !done;) {
+    // read the next chunk, only this chunk is kept in memory
+    size_t n = 0;
+    for(; n < chunkSize; ++n) {
+      if(!io::getline(srcIn, srcLines[n])) {
+        ABORT_IF(io::getline(trgIn, trgLines[n]), "Target corpus {} has more lines than source corpus {}", trgPath, srcPath);
+        done = true;
+        break;
+      }
+      ABORT_IF(!io::getline(trgIn, trgLines[n]), "Target corpus {} has fewer lines than source corpus {}", trgPath, srcPath);
+      if(aligned_)
+        ABORT_IF(!io::getline(*alignIn, alignLines[n]), "Alignment file {} has fewer lines than the corpus", alignPath);
+    }
+
+    std::vector<std::future<void>> results;
+    for(size_t begin = 0; begin < n; begin += linesPerThread) {
+      size_t end = std::min(begin + linesPerThread, n);
+      results.emplace_back(pool.enqueue([&, begin, end]() { countChunk(srcLines, trgLines, alignLines, begin, end); }));
+    }
+    for(auto& result : results)
+      result.get();
+
+    lines += n;
+    if(n > 0)
+      LOG(info, "[data] Processed {} sentence pairs, {} distinct word pairs, {:.2f}s", lines, pairCounts_.size(), timer.elapsed());
+  }
+}
+
+std::vector<std::unordered_map<WordIndex, float>> ShortlistBuilder::scores() const {
+  std::vector<std::unordered_map<WordIndex, float>> scores(srcCounts_.size());
+  for(const auto& it : pairCounts_) {
+    WordIndex s = (WordIndex)(it.first >> 32), t = (WordIndex)(it.first & 0xFFFFFFFF);
+    float count = (float)it.second;
+    if(aligned_)
+      scores[s][t] = count / srcCounts_[s];                            // p(t|s)
+    else
+      scores[s][t] = 2.f * count / (srcCounts_[s] + trgCounts_[t]);    // Dice coefficient
+  }
+  return scores;
+}
+
+}  // namespace data
+}  // namespace marian
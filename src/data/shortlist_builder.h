@@ -0,0 +1,70 @@
+#pragma once
+
+#include "common/definitions.h"
+#include "data/types.h"
+#include "data/vocab.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace marian {
+namespace data {
+
+/**
+ * Collects lexical translation statistics from a sentence-aligned corpus, used by marian-conv
+ * --build-shortlist to create a binary shortlist without an external alignment toolchain.
+ *
+ * With word alignments (e.g. from marian-scorer --alignment hard, positions over the subword
+ * tokens of the model vocabularies), aligned word pairs are counted and scored with p(t|s). Lines
+ * of the form "score ||| alignment [||| ...]" as written by the scorer are accepted as well.
+ * Without, co-occurrences of word types within a sentence pair are counted and scored with the
+ * Dice coefficient, which unlike p(t|s) does not favour the most frequent target words.
+ *
+ * The corpus is streamed in chunks that are counted in parallel. A quarter of the memory budget is
+ * shared by the per-thread counts, which are merged into the global counts whenever they are full.
+ * If the number of distinct word pairs exceeds the rest of the budget, rare pairs are pruned (lossy
+ * counting).
+ */
+class ShortlistBuilder {
+private:
+  Ptr<const Vocab> srcVocab_;
+  Ptr<const Vocab> trgVocab_;
+  size_t threads_;
+  size_t maxPairs_;         // of the global counts, derived from the memory budget
+  size_t maxThreadPairs_;   // of the counts of each thread before they are merged
+  uint32_t pruned_{0};      // pairs with at most this count have been pruned
+  bool aligned_{false};
+
+  std::unordered_map<uint64_t, uint32_t> pairCounts_; // (src << 32 | trg) -> count
+  std::vector<uint32_t> srcCounts_;
+  std::vector<uint32_t> trgCounts_;
+  std::mutex mutex_;        // guards the global counts
+
+  struct Counts {
+    std::unordered_map<uint64_t, uint32_t> pairs;
+    std::vector<uint32_t> src;
+    std::vector<uint32_t> trg;
+  };
+
+  void countChunk(const std::vector<std::string>& srcLines,
+                  const std::vector<std::string>& trgLines,
+                  const std::vector<std::string>& alignLines,
+                  size_t begin,
+                  size_t end);
+  void merge(Counts& counts); // adds counts to the global counts and resets them
+  void prune();
+
+public:
+  ShortlistBuilder(Ptr<const Vocab> srcVocab, Ptr<const Vocab> trgVocab, size_t threads, size_t memoryMB);
+
+  // Counts word pairs of the corpus, alignPath may be empty
+  void count(const std::string& srcPath, const std::string& trgPath, const std::string& alignPath = "");
+
+  // [WordIndex src] -> [WordIndex tgt] -> score, see BinaryShortlistGenerator
+  std::vector<std::unordered_map<WordIndex, float>> scores() const;
+};
+
+}  // namespace data
+}  // namespace marian
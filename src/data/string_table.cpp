@@ -0,0 +1,73 @@
+#include "data/string_table.h"
+#include "common/logging.h"
+
+#include <cstring>
+
+namespace marian {
+
+void StringTable::clear() {
+  if(hashed_) {
+    PHF::destroy(&phf_);
+    hashed_ = false;
+  }
+  arena_.clear();
+  offsets_.assign(1, 0);
+  slots_.clear();
+}
+
+void StringTable::build(const std::vector<std::string>& strings) {
+  clear();
+
+  size_t bytes = 0;
+  for(const auto& str : strings)
+    bytes += str.size();
+  ABORT_IF(bytes > UINT32_MAX, "String table of {} bytes is too large", bytes);
+
+  arena_.reserve(bytes);
+  offsets_.reserve(strings.size() + 1);
+  for(const auto& str : strings) {
+    arena_.insert(arena_.end(), str.begin(), str.end());
+    offsets_.push_back((uint32_t)arena_.size());
+  }
+
+  // keys point into the arena, which does not move anymore
+  std::vector<phf_string_t> keys;
+  keys.reserve(strings.size());
+  for(WordIndex i = 0; i < size(); ++i)
+    if(length(i) > 0)
+      keys.push_back({(void*)data(i), length(i)});
+  if(keys.empty())
+    return;
+
+  // the perfect hash cannot be constructed over duplicate keys (it would not terminate)
+  std::vector<phf_string_t> unique(keys);
+  ABORT_IF(PHF::uniq<phf_string_t>(unique.data(), unique.size()) != keys.size(),
+           "Duplicate strings in string table");
+
+  int error = PHF::init<phf_string_t, true>(&phf_, keys.data(), keys.size(),
+    /* bucket size */ 4,
+    /* loading factor */ 90,
+    /* seed */ 123456);
+  ABORT_IF(error != 0, "PHF error {}", error);
+  PHF::compact(&phf_);
+  hashed_ = true;
+
+  slots_.assign(phf_.m, WordIndex(INVALID));
+  for(WordIndex i = 0; i < size(); ++i)
+    if(length(i) > 0)
+      slots_[PHF::hash<phf_string_t>(&phf_, {(void*)data(i), length(i)})] = i;
+}
+
+bool StringTable::tryFind(const char* str, size_t len, WordIndex& index) const {
+  if(!hashed_ || len == 0)
+    return false;
+  // the hash of a string that is not in the table is an arbitrary slot, hence the comparison
+  auto slot = PHF::hash<phf_string_t>(const_cast<phf*>(&phf_), {(void*)str, len});
+  WordIndex found = slots_[slot];
+  if(found == INVALID || length(found) != len || std::memcmp(data(found), str, len) != 0)
+    return false;
+  index = found;
+  return true;
+}
+
+}  // namespace marian
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "data/types.h"
+#include "3rd_party/phf/phf.h"
+
+#include <string>
+#include <vector>
+
+namespace marian {
+
+// Read-only two-way map between word indices and strings, used by DefaultVocab. All strings are stored
+// back-to-back in a single arena and looked up through a minimal perfect hash (3rd_party/phf, see also
+// PerfectHash in common/fastopt.h) plus one string comparison to reject unknown words. Compared to a
+// std::map<std::string, Word> and a std::vector<std::string> this needs a fraction of the memory and no
+// allocation per string, and looking up a token does not require it to be a std::string.
+class StringTable {
+private:
+  std::vector<char> arena_;         // all strings without separators
+  std::vector<uint32_t> offsets_;   // [index] -> start of the string in arena_, plus the end of the last one
+  std::vector<WordIndex> slots_;    // [hash of string] -> index, or INVALID for unused slots
+  phf phf_;
+  bool hashed_{false};
+
+  static const WordIndex INVALID = (WordIndex)-1;
+
+public:
+  StringTable() : offsets_(1, 0) {}
+  StringTable(const StringTable&) = delete;
+  StringTable& operator=(const StringTable&) = delete;
+  ~StringTable() { clear(); }
+
+  // (Re-)builds the table from strings[index]. Empty strings mark unused indices and cannot be looked up.
+  // The non-empty strings have to be unique.
+  void build(const std::vector<std::string>& strings);
+  void clear();
+
+  // number of indices including unused ones
+  size_t size() const { return offsets_.size() - 1; }
+
+  const char* data(WordIndex index) const { return arena_.data() + offsets_[index]; }
+  size_t length(WordIndex index) const { return offsets_[index + 1] - offsets_[index]; }
+  std::string operator[](WordIndex index) const { return std::string(data(index), length(index)); }
+
+  // looks up the string [str, str + len), returns false if it is not in the table
+  bool tryFind(const char* str, size_t len, WordIndex& index) const;
+  bool tryFind(const std::string& str, WordIndex& index) const { return tryFind(str.data(), str.size(), index); }
+};
+
+}  // namespace marian
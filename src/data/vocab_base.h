@@ -36,7 +36,8 @@ public:
                              bool ignoreEos = true) const = 0;
   virtual std::string surfaceForm(const Words& sentence) const = 0;
 
-  virtual const std::string& operator[](Word id) const = 0;
+  // by value, implementations do not necessarily store a std::string per word
+  virtual std::string operator[](Word id) const = 0;
 
   virtual size_t size() const = 0;
   virtual size_t lemmaSize() const { return size(); }
@@ -0,0 +1,117 @@
+#include "graph/auto_tuner.h"
+
+#include "3rd_party/yaml-cpp/yaml.h"
+#include "common/filesystem.h"
+#include "common/logging.h"
+
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+namespace marian {
+
+namespace {
+std::mutex mutex_;
+std::string fileName_;
+YAML::Node cacheYaml_; // decisions for all CPU models found in fileName_
+std::unordered_map<std::string, std::string> decisions_;
+size_t unsaved_{0}; // decisions not yet written to fileName_
+
+// Decisions are written in batches of this size and by AutoTunerCache::flush()
+const size_t saveEvery = 16;
+
+// Decisions are only valid for the hardware they were measured on
+const std::string& cpuModel() {
+  static const std::string model = []() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while(std::getline(cpuinfo, line)) {
+      if(line.find("model name") == 0) {
+        auto pos = line.find(':');
+        if(pos != std::string::npos && pos + 2 <= line.size())
+          return line.substr(pos + 2);
+      }
+    }
+    return std::string("unknown");
+  }();
+  return model;
+}
+
+// Write all decisions to a temporary file first and rename it, so that another process sharing the
+// cache never reads a partial file. Expects mutex_ to be held.
+void save() {
+  if(fileName_.empty() || unsaved_ == 0)
+    return;
+  unsaved_ = 0;
+
+  std::string tempFile = fileName_ + ".tmp";
+  {
+    std::ofstream out(tempFile);
+    if(out)
+      out << cacheYaml_ << std::endl;
+    if(!out) {
+      LOG(warn, "[autotuner] Could not write auto-tuning decisions to {}", tempFile);
+      return;
+    }
+  }
+  bool renamed = std::rename(tempFile.c_str(), fileName_.c_str()) == 0;
+  if(!renamed && filesystem::exists(fileName_)) { // rename() does not replace an existing file on Windows
+    std::remove(fileName_.c_str());
+    renamed = std::rename(tempFile.c_str(), fileName_.c_str()) == 0;
+  }
+  if(!renamed)
+    LOG(warn, "[autotuner] Could not rename {} to {}", tempFile, fileName_);
+}
+}  // namespace
+
+void AutoTunerCache::load(const std::string& fileName) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(fileName_ == fileName) // already loaded, e.g. by another device
+    return;
+  save();
+  fileName_ = fileName;
+  if(!filesystem::exists(fileName_))
+    return;
+
+  cacheYaml_ = YAML::LoadFile(fileName_);
+  size_t loaded = 0;
+  if(cacheYaml_[cpuModel()]) {
+    for(const auto& it : cacheYaml_[cpuModel()]) {
+      decisions_[it.first.as<std::string>()] = it.second.as<std::string>();
+      loaded++;
+    }
+  }
+  LOG(info, "[autotuner] Loaded {} GEMM decisions for '{}' from {}", loaded, cpuModel(), fileName_);
+}
+
+bool AutoTunerCache::find(const std::string& key, std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = decisions_.find(key);
+  if(it == decisions_.end())
+    return false;
+  name = it->second;
+  return true;
+}
+
+void AutoTunerCache::insert(const std::string& key, const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // several threads may tune the same operation, keep the first decision
+  if(!decisions_.emplace(key, name).second)
+    return;
+  LOG(info, "[autotuner] Using {} for {}", name, key);
+
+  if(fileName_.empty())
+    return;
+
+  cacheYaml_[cpuModel()][key] = name;
+  if(++unsaved_ >= saveEvery)
+    save();
+}
+
+void AutoTunerCache::flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  save();
+}
+
+}  // namespace marian
@@ -1,14 +1,29 @@
 #pragma once
 
+#include "common/definitions.h"
 #include "common/timer.h"
 
 #include <chrono>
 #include <functional>
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace marian {
 
+// Process-wide table of auto-tuning decisions (operation key -> name of the fastest algorithm).
+// If a file is loaded (--autotune-cache), decisions are read from and written back to it in batches, keyed
+// by the CPU model, so that later runs on the same hardware can skip measuring.
+class AutoTunerCache {
+public:
+  static void load(const std::string& fileName);
+  static bool find(const std::string& key, /*out*/ std::string& name);
+  static void insert(const std::string& key, const std::string& name);
+  // write decisions that were not saved yet, insert() only saves every few decisions
+  static void flush();
+};
+
 class AutoTunerRecorder {
 public:
   virtual void start(size_t hash) = 0;
@@ -31,9 +46,11 @@ private:
   // hash: a unique hash key for each operation size
   //      (e.g. m, n, k, transpose A, transpose B, bias size for GEMM)
   // algorithm: a function that holds an algorithm
+  // name: the name of the algorithm used for persisting decisions in the AutoTunerCache
   struct HashedAlgorithm {
     size_t hash;
     Algorithm algorithm;
+    std::string name;
   };
 
   // This structure represents the collected statistics.
@@ -48,8 +65,22 @@ private:
   std::unordered_map<size_t, size_t> done_;
 
   std::vector<HashedAlgorithm> algorithms_;
+  std::string key_; // operation key for the AutoTunerCache, nothing is persisted if empty
+
+  size_t decide(size_t best) {
+    for(auto& a : algorithms_)
+      done_[a.hash] = best;
+    return best;
+  }
 
   size_t choose() {
+    std::string name;
+    if(!key_.empty() && done_.count(algorithms_[0].hash) == 0 && AutoTunerCache::find(key_, name)) {
+      for(size_t i = 0; i < algorithms_.size(); ++i)
+        if(algorithms_[i].name == name)
+          return decide(i);
+    }
+
     size_t best = 0;
     double bestTime = std::numeric_limits<double>::max();
 
@@ -76,16 +107,21 @@ private:
       }
     }
 
-    for(auto& a : algorithms_)
-      done_[a.hash] = best;
+    if(!key_.empty())
+      AutoTunerCache::insert(key_, algorithms_[best].name);
 
-    return best;
+    return decide(best);
   }
 
 public:
   void insert(const HashedAlgorithm& ha) { algorithms_.push_back(ha); }
 
-  void clear() { algorithms_.clear(); }
+  void setKey(const std::string& key) { key_ = key; }
+
+  void clear() {
+    algorithms_.clear();
+    key_.clear();
+  }
 
   Return run(Args... args) { return algorithms_[choose()].algorithm(args...); }
 
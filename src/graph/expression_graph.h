@@ -2,6 +2,7 @@
 
 #include "common/config.h"
 #include "common/definitions.h"
+#include "common/timer.h"
 
 #include "tensors/backend.h"
 #include "tensors/tensor_allocator.h"
@@ -151,10 +152,14 @@ private:
 
   bool checkpointing_{false};               // use gradient checkpointing if true
 
+  std::vector<std::shared_ptr<char>> modelBuffers_; // model data used in place by mapped parameters, see load(const std::string&)
+
   bool reloaded_{false};                    // a flag holds whether the graph is reloaded: reloaded is true if the graph loads parameters by load() function.
 
   bool throwNaN_{false};                    // a flag holds whether the graph throws a NaN exception
 
+  bool quantizeActivations_{false};         // simulate intgemm8 quantization of affine inputs, see setQuantizeActivations(...)
+
 protected:
   // Delete, copy and move constructors
   ExpressionGraph(const ExpressionGraph&) = delete;
@@ -250,6 +255,27 @@ public:
     tensors_->reserve(bytes);
   }
 
+  /**
+   * Set how the graph workspace manages its memory, see AllocationStrategy.
+   * This frees all current workspace allocations.
+   */
+  void setWorkspaceAllocationStrategy(AllocationStrategy strategy) {
+    tensors_->getTensorAllocator()->setAllocationStrategy(strategy);
+  }
+
+  /** Allocation statistics of the graph workspace, e.g. peak usage and number of grow events */
+  AllocatorStats getWorkspaceStats() { return allocator()->stats(); }
+
+  /** Reset peak usage, number of allocations and grow events of the graph workspace */
+  void resetWorkspaceStats() { allocator()->resetStats(); }
+
+  /**
+   * Replace the workspace by one of exactly the given size, e.g. after measuring the peak usage.
+   * Unlike reserveWorkspaceMB() this can also shrink the workspace. Must only be called between
+   * batches as all workspace allocations are freed.
+   */
+  void resizeWorkspace(size_t bytes) { tensors_->getTensorAllocator()->resize(bytes); }
+
   /** Copy tensor objects from one graph to current graph */
   void reuseWorkspace(Ptr<ExpressionGraph> graph) {
     tensors_ = graph->tensors_;
@@ -737,6 +763,15 @@ public:
   /** Get the flag value whether the graph throws a NaN exception (true) or not */
   bool getThrowNaN() { return throwNaN_; }
 
+  /**
+   * Set the flag value whether the inputs of affine and dot operations with intgemm weight matrices
+   * are fake-quantized like intgemm8 does at inference time (used by --quantize-intgemm)
+   */
+  void setQuantizeActivations(bool quantize) { quantizeActivations_ = quantize; }
+
+  /** Get the flag value whether the inputs of intgemm-convertible GEMMs are fake-quantized */
+  bool getQuantizeActivations() { return quantizeActivations_; }
+
 public:
   /** Load model (mainly parameter objects) from array of io::Items */
   void load(std::vector<io::Item>& ioItems, bool markReloaded = true) {
@@ -757,11 +792,59 @@ public:
       setReloaded(true);
   }
 
-  /** Load model by filename */
+  /**
+   * Load model from array of io::Items and take ownership of their data. The data of each item
+   * is released as soon as it has been copied into its parameter tensor.
+   */
+  void load(std::vector<io::Item>&& ioItems, bool markReloaded = true) {
+    setReloaded(false);
+    for(auto& item : ioItems) {
+      std::string pName = item.name;
+      if(pName.substr(0, 8) == "special:")
+        continue;
+      auto loadElementType = isSameTypeClass(item.type, defaultElementType_) ? defaultElementType_ : item.type;
+      auto shape = item.shape;
+      param(pName, shape, inits::fromItem(std::move(item)), loadElementType, /*fixed=*/false);
+    }
+    ioItems.clear();
+    if(markReloaded)
+      setReloaded(true);
+  }
+
+  /**
+   * Load model by filename. For *.bin models used for CPU inference the file is read with a
+   * single read into an aligned buffer and the parameters point directly into that buffer
+   * (zero-copy) if all items can be used as they are stored. Otherwise parameters are copied.
+   */
   void load(const std::string& name, bool markReloaded = true) {
     LOG(info, "Loading model from {}", name);
-    auto items = io::loadItems(name);
-    load(items, markReloaded);
+    timer::Timer timer;
+    if(io::isBin(name) && backend_ && backend_->getDeviceId().type == DeviceType::cpu && inferenceOnly_) {
+      auto buffer = io::loadFileAligned(name);
+      auto items = io::mmapItems(buffer.get());
+      if(canMapItems(items)) {
+        LOG(info, "Using parameters in place from model buffer");
+        modelBuffers_.push_back(buffer); // keep the buffer alive for as long as the graph
+        mapItems(items, markReloaded);
+        LOG(info, "[load] Read and mapped {} items in {:.2f}s", items.size(), timer.elapsed());
+        return;
+      }
+      // fall back to copying, e.g. for type conversions or hardware non-specific intgemm matrices
+      for(auto& item : items) {
+        if(item.mapped) {
+          item.bytes.assign(item.ptr, item.ptr + item.size());
+          item.ptr = nullptr;
+          item.mapped = false;
+        }
+      }
+      buffer.reset();
+      load(std::move(items), markReloaded);
+    } else {
+      auto items = io::loadItems(name);
+      LOG(info, "[load] Read {} items in {:.2f}s", items.size(), timer.elapsed());
+      load(std::move(items), markReloaded);
+    }
+    LOG(info, "[load] Loaded {} in {:.2f}s", name, timer.elapsed());
   }
 
   /** Load model from buffer (a file pointer) */
@@ -781,7 +864,27 @@ public:
 
     LOG(info, "Memory mapping model at {}", ptr);
     auto items = io::mmapItems(ptr);
-    
+    for(const auto& item : items)
+      ABORT_IF(!item.mapped, "mmap format not supported for compressed models or hardware non-specific intgemm matrices");
+
+    mapItems(items, markReloaded);
+  }
+
+private:
+  // Items can be used in place if they are all mapped, properly aligned and do not require type conversion
+  bool canMapItems(const std::vector<io::Item>& items) const {
+    for(const auto& item : items) {
+      if(item.name.substr(0, 8) == "special:")
+        continue;
+      if(!item.mapped || (size_t)item.ptr % 256 != 0)
+        return false;
+      if(item.type != defaultElementType_ && isSameTypeClass(item.type, defaultElementType_))
+        return false;
+    }
+    return true;
+  }
+
+  void mapItems(std::vector<io::Item>& items, bool markReloaded) {
     // Deal with default parameter set object that might not be a mapped object.
     // This gets assigned during ExpressionGraph::setDevice(...) and by default 
     // would contain allocated tensors. Here we replace it with a mmapped version.
@@ -807,6 +910,16 @@ public:
       }
     }
 
+    // tell the parameter objects which tensors point into the mapped memory
+    for(auto& item : items) {
+      if(item.name.substr(0, 8) == "special:")
+        continue;
+      auto loadElementType = isSameTypeClass(item.type, defaultElementType_) ? defaultElementType_ : item.type;
+      auto params = std::dynamic_pointer_cast<MappedParameters>(paramsByElementType_[loadElementType]);
+      if(params) // under the name that param() gives it in the current namespace, e.g. "F0::"
+        params->setMapped(namespace_.empty() ? item.name : namespace_ + "::" + item.name);
+    }
+
     load(items, markReloaded);
   }
 
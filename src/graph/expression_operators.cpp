@@ -9,6 +9,8 @@
 
 #include "graph/auto_tuner.h"
 #include "tensors/cpu/intgemm_interface.h"
+#include "tensors/cpu/int4_interface.h"
+#include "tensors/cpu/gather_gemm.h"
 #include "tensors/cpu/fbgemm/expanded_gemm.h"
 
 #if USE_FBGEMM
@@ -477,7 +479,36 @@ Expr weighted_average(Expr in, Expr weights, int ax) {
   return p / s;
 }
 
+// Simulates the quantization of A in intgemm8 GEMMs (see --quantize-intgemm): A is rounded to the
+// per-tensor grid max|A|/127 that intgemm::PrepareA uses at inference time. The gradient is passed
+// through unchanged (straight-through estimator), the scale is not differentiated.
+static Expr fakeQuantizeIntgemm8(Expr a) {
+  Expr step = stopGradient(maximum(max(flatten(abs(a)), -1), 1e-7f) / 127.f);
+  step = reshape(step, Shape(std::vector<int>(a->shape().size(), 1))); // broadcast against a
+
+  auto fwd = [](Expr out, const std::vector<Expr>& children) {
+    using namespace functional;
+    Element(_1 = round(_2 / _3) * _3, out->val(), children[0]->val(), children[1]->val());
+  };
+  auto bwd = [](Expr out, const std::vector<Expr>& children) {
+    using namespace functional;
+    if(children[0]->trainable())
+      Add(_1, children[0]->grad(), out->grad());
+  };
+  static const size_t hash = std::hash<std::string>()("fakeQuantizeIntgemm8");
+  return lambda({a, step}, a->shape(), a->value_type(), fwd, bwd, hash);
+}
+
+// True if b is a parameter that marian-conv would convert to intgemm and the graph simulates that
+static bool isQuantizedActivationGemm(Expr a, Expr b) {
+  return a->graph()->getQuantizeActivations() && b->type() == "param"
+         && isFloat(a->value_type()) && cpu::integer::isIntgemmWeightName(b->name());
+}
+
 Expr dot(Expr a, Expr b, bool transA, bool transB, float scale) {
+  if(isQuantizedActivationGemm(a, b))
+    a = fakeQuantizeIntgemm8(a);
+
   auto device = a->graph()->getDeviceId().type;
   // added support for packed GEMM API (fp16, int8)
   Type aElementType = a->value_type();
@@ -528,6 +559,8 @@ Expr dot(Expr a, Expr b, bool transA, bool transB, float scale) {
       }
     } else if(isFloat(aElementType) && isIntgemm(bElementType)) {
       return cpu::integer::affineOrDot(a, b, nullptr, transA, transB, scale);
+    } else if(isFloat(aElementType) && isInt4(bElementType)) {
+      return cpu::int4::affineOrDot(a, b, nullptr, transA, transB, scale);
     } else if(isFloat(aElementType) && isPacked(bElementType)) {
 #if USE_FBGEMM
       // 07/10/2019 - Use packed GEMM only if the cpu architecture supports AVX2
@@ -566,6 +599,41 @@ Expr bdot_legacy(Expr a, Expr b, bool transA, bool transB, float scale) {
   return Expression<DotBatchedLegacyNodeOp>(a, b, transA, transB, scale);
 }
 
+Expr gatherAffine(Expr a, Expr W, Expr indices, Expr bias) {
+  auto graph = a->graph();
+  int batch = indices->shape()[0];
+  int k     = indices->shape()[1];
+  int dim   = a->shape()[-1];
+  ABORT_IF(a->shape()[-2] != batch, "gatherAffine: batch dimension of {} does not match indices {}", a->shape(), indices->shape());
+
+  Shape outShape = a->shape();
+  outShape.set(-1, k);
+
+  // Gather and multiply one batch entry at a time, this never stores the selected rows of W for all entries
+  if(graph->isInference() && graph->getDeviceId().type == DeviceType::cpu
+     && isFloat(a->value_type()) && isFloat(W->value_type())) {
+    auto gatherAffineOp = [](Expr out, const std::vector<Expr>& children) {
+      Tensor bias = children.size() > 3 ? children[3]->val() : nullptr;
+      cpu::gatherAffine(out->val(), children[0]->val(), children[1]->val(), children[2]->val(), bias);
+    };
+
+    std::vector<Expr> children = {a, W, indices};
+    if(bias)
+      children.push_back(bias);
+    return lambda(children, outShape, a->value_type(), gatherAffineOp); // inference-only Lambda node
+  }
+
+  // otherwise select all rows and multiply batch entry-wise
+  int rows = a->shape().elements() / (batch * dim);
+  auto flatIndices = flatten(indices);
+  auto Wsel = reshape(index_select(W, 0, flatIndices), {batch, k, dim});           // [batch, k, dim]
+  auto aT   = transpose(reshape(a, {rows, batch, dim}), {1, 0, 2});               // [batch, rows, dim]
+  auto out  = bdot(aT, Wsel, /*transA=*/false, /*transB=*/true);                  // [batch, rows, k]
+  if(bias)
+    out = out + reshape(index_select(bias, -1, flatIndices), {batch, 1, k});
+  return reshape(transpose(out, {1, 0, 2}), outShape);                            // [..., batch, k]
+}
+
 Expr affineDefault(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
   // general version, MKL, CBlas or CUDA
 
@@ -575,12 +643,84 @@ Expr affineDefault(Expr a, Expr b, Expr bias, bool transA, bool transB, float sc
   return Expression<AffineNodeOp>(nodes, transA, transB, scale);
 }
 
-// This operation used to implement auto-tuning. We have removed it for now due to complexity, but plan to revisit it in the future. 
-// The last branch with auto-tuner is: 
-// youki/packed-model-pr-backup1031
-// https://machinetranslation.visualstudio.com/Marian/_git/marian-dev?version=GByouki%2Fpacked-model-pr-backup1031
-// SHA: 3456a7ed1d1608cfad74cd2c414e7e8fe141aa52
+// Attach the auto-tuner to all nodes created by a GEMM candidate, i.e. everything between the
+// final node and the inputs a, bias or memoized nodes (e.g. the packed parameter which is only
+// computed once). The first of these nodes starts the timer, the final node stops it.
+static void recordCandidate(Expr e, Ptr<AutoTunerRecorder> tuner, size_t hash, bool stop, Expr a, Expr bias) {
+  if(e == a || e == bias || e->memoize())
+    return;
+  e->record(tuner, hash, stop);
+  for(auto& child : e->children())
+    recordCandidate(child, tuner, hash, /*stop=*/false, a, bias);
+}
+
+// --gemm-type auto: choose between float32, intgemm and fbgemm-packed GEMMs per matrix size by
+// measuring them during the first batches. Decisions are shared with the AutoTunerCache and can
+// be persisted with --autotune-cache.
+static Expr affineAutoTuned(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
+  static thread_local Ptr<AutoTuner<Expr>> tuner = New<AutoTuner<Expr>>();
+
+  int rows = transA ? a->shape()[-1] : a->shape().elements() / a->shape()[-1];
+  int inner = transB ? b->shape()[-1] : b->shape()[-2];
+  int cols  = transB ? b->shape()[-2] : b->shape()[-1];
+
+  // round the number of rows up to a power of 2, batches of similar size share a decision
+  int bucket = 1;
+  while(bucket < rows)
+    bucket *= 2;
+
+  std::stringstream key;
+  key << bucket << "x" << inner << "x" << cols << (transA ? ":tA" : "") << (transB ? ":tB" : "") << (bias ? ":bias" : "");
+
+  tuner->clear();
+  tuner->setKey(key.str());
+  auto addCandidate = [&](const std::string& name, std::function<Expr()> gemm) {
+    size_t hash = std::hash<std::string>()(key.str());
+    util::hash_combine(hash, name);
+    tuner->insert({hash, [=]() {
+      Expr e = gemm();
+      recordCandidate(e, tuner, hash, /*stop=*/true, a, bias);
+      return e;
+    }, name});
+  };
+
+  addCandidate("float32", [=]() { return affineDefault(a, b, bias, transA, transB, scale); });
+
+#if COMPILE_CPU
+  // intgemm needs the inner dimension to be a multiple of 64 and the columns a multiple of 8
+  if(!transA && inner % 64 == 0 && cols % 8 == 0) {
+    for(Type intgemmType : {Type::intgemm8, Type::intgemm16}) {
+      Type vtype = cpu::integer::getIntgemmType(intgemmType);
+      addCandidate(std::string(intgemmType == Type::intgemm8 ? "intgemm8" : "intgemm16"), [=]() {
+        auto bQuant = cpu::integer::prepareB(b, transB, vtype);
+        return cpu::integer::affineOrDot(a, bQuant, bias, transA, /*transB=*/false, scale);
+      });
+    }
+  }
+#endif
+
+#if USE_FBGEMM
+  if(fbgemm::fbgemmHasAvx2Support()) {
+    addCandidate("packed16", [=]() {
+      auto packedB = cpu::variant::pack(marian::Type::packed16, b, cpu::variant::PackMatrix::B, transB);
+      return cpu::variant::affine(marian::Type::packed16, a, packedB, b->shape(), bias, transA, transB, scale);
+    });
+    Type packed8Type = fbgemm::fbgemmHasAvx512Support() ? marian::Type::packed8avx512 : marian::Type::packed8avx2;
+    float quantizeRange = b->graph()->getBackend()->getQuantizeRange();
+    addCandidate("packed8", [=]() {
+      auto packedB = cpu::variant::pack(packed8Type, b, cpu::variant::PackMatrix::B, transB, quantizeRange);
+      return cpu::variant::affine(packed8Type, a, packedB, b->shape(), bias, transA, transB, scale);
+    });
+  }
+#endif  // USE_FBGEMM
+
+  return tuner->run();
+}
+
 Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
+  if(isQuantizedActivationGemm(a, b))
+    a = fakeQuantizeIntgemm8(a);
+
   auto device = a->graph()->getDeviceId().type;
 
   Type aElementType = a->value_type();
@@ -589,7 +729,9 @@ Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
   if(device == DeviceType::cpu) {
     if(isFloat(aElementType) && isFloat(bElementType)) {
       if(a->graph()->getBackend()->isOptimized()) {
-        if(b->memoize() && (a->graph()->getBackend()->getGemmType() == GemmType::FbFp16Packed ||
+        if(b->memoize() && a->graph()->getBackend()->getGemmType() == GemmType::Auto) {
+          return affineAutoTuned(a, b, bias, transA, transB, scale);
+        } else if(b->memoize() && (a->graph()->getBackend()->getGemmType() == GemmType::FbFp16Packed ||
           a->graph()->getBackend()->getGemmType() == GemmType::FbInt8Packed)) {
 #if USE_FBGEMM
           if(a->graph()->getBackend()->getGemmType() == GemmType::FbFp16Packed) {
@@ -632,6 +774,8 @@ Expr affine(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
       }
     } else if(isFloat(aElementType) && isIntgemm(bElementType)) {
       return cpu::integer::affineOrDot(a, b, bias, transA, transB, scale);
+    } else if(isFloat(aElementType) && isInt4(bElementType)) {
+      return cpu::int4::affineOrDot(a, b, bias, transA, transB, scale);
     } else if(isFloat(aElementType) && isPacked(bElementType)) {
 #if USE_FBGEMM
       // 07/10/2019 - Use packed GEMM only if the cpu architecture supports AVX2
@@ -672,6 +816,12 @@ Expr affineWithRelu(Expr a, Expr b, Expr bias, bool transA, bool transB, float s
   
   if(graph->isInference() && graph->getDeviceId().type == DeviceType::gpu)
     return Expression<AffineWithReluNodeOp>(a, b, bias, transA, transB, scale);
+#if USE_FBGEMM
+  // int8 packed GEMM adds bias and applies ReLU in its output stage
+  else if(graph->getDeviceId().type == DeviceType::cpu && isFloat(a->value_type())
+          && isPacked(b->value_type()) && sizeOf(b->value_type()) == 1 && fbgemm::fbgemmHasAvx2Support())
+    return cpu::variant::affine(b->value_type(), a, b, b->shape(), bias, transA, transB, scale, /*relu=*/true);
+#endif  // USE_FBGEMM
   else
     return relu(affine(a, b, bias, transA, transB, scale));
 }
@@ -495,6 +495,18 @@ Expr bdot_legacy(Expr a,
                  bool transB = false,
                  float scalar = 1.f);
 
+/**
+ * Affine transformation where each batch entry uses its own subset of the rows of @p W.
+ * Computes `out[..., b, j] = a[..., b, :] * W[indices[b, j], :]^T + bias[indices[b, j]]`,
+ * e.g. for output layers with a different shortlist for every sentence.
+ * @param a input of shape `[..., batch, dim]`
+ * @param W matrix of shape `[V, dim]` from which rows are selected
+ * @param indices row indices into @p W of shape `[batch, k]`
+ * @param bias optional bias of shape `[1, V]`
+ * @returns expression of shape `[..., batch, k]`
+ */
+Expr gatherAffine(Expr a, Expr W, Expr indices, Expr bias = nullptr);
+
 /**
  * Performs an affine transformation.
  * Computes
@@ -217,6 +217,19 @@ Ptr<NodeInitializer> fromItem(const io::Item& item) {
   }
 }
 
+Ptr<NodeInitializer> fromItem(io::Item&& item) {
+  if(item.mapped)
+    return fromItem((const io::Item&)item); // no data to own
+
+  auto owned = New<io::Item>(std::move(item));
+  return fromLambda(
+    [owned](Tensor tensor) {
+      tensor->set(*owned);
+      std::vector<char>().swap(owned->bytes); // free the data, the tensor holds a copy now
+    },
+    owned->type);
+}
+
 Ptr<NodeInitializer> fromTensor(Tensor externalTensor) {
   return fromLambda([externalTensor](Tensor t) { t->copyFrom(externalTensor); }, externalTensor->type());
 }
@@ -230,6 +230,12 @@ Ptr<NodeInitializer> fromSparseVector(std::pair<std::vector<size_t>, std::vector
  */
 Ptr<NodeInitializer> fromItem(const io::Item& item);
 
+/**
+ * Same as fromItem(const io::Item&), but takes ownership of the item instead of copying it
+ * and releases its data once the tensor has been initialized.
+ */
+Ptr<NodeInitializer> fromItem(io::Item&& item);
+
 /**
  * Initialize tensor by copying from the given tensor.
  * Creates a NodeInitializer that will initialize the tensor
@@ -71,6 +71,9 @@ public:
     auto cnode = std::dynamic_pointer_cast<LambdaNodeOp>(node);
     if(!cnode)
       return false;
+    // an external hash identifies the operation independent of the functor objects
+    if(externalHash_ != 0 || cnode->externalHash_ != 0)
+      return externalHash_ == cnode->externalHash_;
     if(forward_ != cnode->forward_)   // pointer compare on purpose
       return false;
     if(backward_ != cnode->backward_) // pointer compare on purpose
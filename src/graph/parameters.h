@@ -128,21 +128,42 @@ public:
 class MappedParameters : public Parameters {
 private:
   Ptr<Backend> backend_;
+  std::unordered_set<std::string> mapped_; // names of parameters which point to mapped memory
 
 public:
   MappedParameters(Type acceptedElementType) : Parameters(acceptedElementType) {
     LOG(debug, "Created mapped parameter object of type {}", acceptedElementType);
   }
 
-  virtual void init(Ptr<Backend> backend) override { backend_ = backend; }
+  virtual void init(Ptr<Backend> backend) override {
+    backend_ = backend;
+    vals_ = New<TensorAllocator>(backend);
+  }
   virtual void init(Ptr<Backend> backend, Ptr<Device>) override { init(backend); }
 
+  // Mark a parameter as mapped, its tensor memory is set by the initializer (see inits::fromItem)
+  void setMapped(const std::string& name) { mapped_.insert(name); }
+
+  // Bytes of own memory for parameters that are not mapped
+  size_t unmappedBytes() const { return vals_->size(Type::uint8); }
+
   virtual void allocateForward() override {
-    if(!params_.empty()) {
-      for(auto p : params_) {
-        if(!p->val()) {
+    // Parameters which are not part of the mapped model (e.g. created later by marian-conv --add-lsh)
+    // get their own memory
+    size_t unmappedCapacity = 0;
+    for(auto& kv : named_)
+      if(!kv.second->val() && mapped_.count(kv.first) == 0)
+        unmappedCapacity += vals_->capacity(kv.second->shape(), kv.second->value_type());
+    if(unmappedCapacity > 0 && vals_->size() == 0)
+      vals_->reserveExact(unmappedCapacity);
+
+    for(auto& kv : named_) {
+      auto p = kv.second;
+      if(!p->val()) {
+        if(mapped_.count(kv.first) > 0)
           p->val() = TensorBase::New(nullptr, p->shape(), p->value_type(), backend_);
-        }
+        else
+          vals_->allocate(p->val(), p->shape(), p->value_type());
       }
     }
   }
@@ -166,6 +187,8 @@ public:
   virtual void clear() override {
     params_.clear();
     named_.clear();
+    mapped_.clear();
+    vals_->clear();
   }
 };
 
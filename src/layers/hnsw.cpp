@@ -0,0 +1,454 @@
+#include "layers/hnsw.h"
+#include "graph/expression_graph.h"
+#include "common/hash.h"
+#include "3rd_party/threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <queue>
+#include <random>
+
+namespace marian {
+namespace hnsw {
+
+/**
+ * Layout of the index, all words are uint32:
+ *
+ *   header      [magic, M, rows, maxLevel, entry point, upperCount]
+ *   level 0     rows x (1 + 2 * M): number of links, then the links of every node on the bottom layer
+ *   upperIds    upperCount ids of the nodes on level 1 and above, in increasing order
+ *   upperOffset upperCount offsets (in words from the start of the index) of the links of these nodes
+ *   upper links for every node of level L >= 1, L x (1 + M): number of links and links on levels 1 to L
+ *
+ * The level of every node is drawn from a generator with a fixed seed, so the layout and size of the index only
+ * depend on the number of rows and M, which lets marian-conv allocate it before building.
+ */
+namespace {
+
+const uint32_t indexMagic = 0x57534e48; // "HNSW"
+
+enum Header { kMagic, kM, kRows, kMaxLevel, kEntry, kUpperCount, kHeaderSize };
+
+typedef std::pair<float, uint32_t> Candidate; // distance, node
+
+std::vector<int> drawLevels(int rows, int M) {
+  ABORT_IF(M < 2, "HNSW needs at least 2 links per node, not {}", M);
+  std::mt19937 gen(1234);
+  double levelMult = 1.0 / std::log((double)M);
+  std::vector<int> levels(rows);
+  for(auto& level : levels) {
+    double u = (gen() + 0.5) / 4294967296.0; // uniform in (0, 1), independent of the standard library
+    level = (int)(-std::log(u) * levelMult);
+  }
+  return levels;
+}
+
+inline float dotProduct(const float* a, const float* b, int dim) {
+  // independent partial sums let the compiler vectorize without reordering a single reduction
+  float sums[8] = {0.f};
+  int i = 0;
+  for(; i + 8 <= dim; i += 8)
+    for(int j = 0; j < 8; ++j)
+      sums[j] += a[i + j] * b[i + j];
+  float sum = 0.f;
+  for(; i < dim; ++i)
+    sum += a[i] * b[i];
+  for(int j = 0; j < 8; ++j)
+    sum += sums[j];
+  return sum;
+}
+
+// Nodes seen during one search, reset in O(1) by advancing the tag
+class Visited {
+  std::vector<uint32_t> tags_;
+  uint32_t tag_{0};
+
+public:
+  Visited(int rows) : tags_(rows, 0) {}
+
+  void reset() {
+    if(++tag_ == 0) { // wrapped around
+      std::fill(tags_.begin(), tags_.end(), 0);
+      tag_ = 1;
+    }
+  }
+
+  // returns true if the node has not been seen before
+  bool insert(uint32_t node) {
+    if(tags_[node] == tag_)
+      return false;
+    tags_[node] = tag_;
+    return true;
+  }
+};
+
+// Read and write access to the links of the index
+struct Links {
+  uint32_t* data;
+  int M;
+  int rows;
+  uint32_t* level0;
+  uint32_t* upperIds;
+  uint32_t* upperOffsets;
+  uint32_t upperCount;
+
+  Links(uint32_t* index)
+  : data(index), M((int)index[kM]), rows((int)index[kRows]),
+    level0(index + kHeaderSize),
+    upperIds(level0 + (size_t)rows * (1 + 2 * M)),
+    upperOffsets(upperIds + index[kUpperCount]),
+    upperCount(index[kUpperCount]) {}
+
+  size_t maxLinks(int level) const { return level == 0 ? 2 * M : M; }
+
+  // number of links followed by the links of node on level
+  uint32_t* operator()(uint32_t node, int level) const {
+    if(level == 0)
+      return level0 + (size_t)node * (1 + 2 * M);
+    size_t i = std::lower_bound(upperIds, upperIds + upperCount, node) - upperIds;
+    return data + upperOffsets[i] + (size_t)(level - 1) * (1 + M);
+  }
+};
+
+// Negative inner product of the query q with a node, smaller is closer
+struct Distance {
+  const float* weights;
+  int dim;
+
+  float operator()(const float* q, uint32_t node) const {
+    return -dotProduct(q, weights + (size_t)node * dim, dim);
+  }
+};
+
+// Best-first search on one layer starting from entries, returns up to ef candidates sorted by increasing distance
+void searchLayer(std::vector<Candidate>& found,
+                 const float* q,
+                 const std::vector<Candidate>& entries,
+                 size_t ef,
+                 int level,
+                 const Links& links,
+                 const Distance& distance,
+                 Visited& visited) {
+  std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates; // closest first
+  std::priority_queue<Candidate> results;                                                      // farthest first
+
+  visited.reset();
+  for(const auto& entry : entries) {
+    visited.insert(entry.second);
+    candidates.push(entry);
+    results.push(entry);
+  }
+  while(results.size() > ef)
+    results.pop();
+
+  while(!candidates.empty()) {
+    Candidate current = candidates.top();
+    if(current.first > results.top().first && results.size() >= ef)
+      break;
+    candidates.pop();
+
+    const uint32_t* neighbours = links(current.second, level);
+    for(uint32_t i = 1; i <= neighbours[0]; ++i) {
+      uint32_t node = neighbours[i];
+      if(!visited.insert(node))
+        continue;
+      float dist = distance(q, node);
+      if(results.size() < ef || dist < results.top().first) {
+        candidates.push({dist, node});
+        results.push({dist, node});
+        if(results.size() > ef)
+          results.pop();
+      }
+    }
+  }
+
+  found.resize(results.size());
+  for(size_t i = found.size(); i > 0; --i) {
+    found[i - 1] = results.top();
+    results.pop();
+  }
+}
+
+class Builder {
+  const float* weights_;
+  int rows_;
+  int dim_;
+  int efConstruction_;
+  Links links_;
+  Distance distance_;
+  Visited visited_;
+
+  float nodeDistance(uint32_t a, uint32_t b) const {
+    return distance_(weights_ + (size_t)a * dim_, b);
+  }
+
+  // keeps the closest candidates that are closer to the base node than to any candidate kept before,
+  // which spreads the links over different directions (heuristic of the HNSW paper)
+  std::vector<uint32_t> selectNeighbours(const std::vector<Candidate>& sorted, size_t maxLinks) const {
+    std::vector<uint32_t> selected;
+    for(const auto& candidate : sorted) {
+      if(selected.size() >= maxLinks)
+        break;
+      bool keep = true;
+      for(uint32_t other : selected) {
+        if(nodeDistance(candidate.second, other) < candidate.first) {
+          keep = false;
+          break;
+        }
+      }
+      if(keep)
+        selected.push_back(candidate.second);
+    }
+    return selected;
+  }
+
+  void setLinks(uint32_t node, int level, const std::vector<uint32_t>& neighbours) {
+    uint32_t* out = links_(node, level);
+    out[0] = (uint32_t)neighbours.size();
+    std::copy(neighbours.begin(), neighbours.end(), out + 1);
+  }
+
+  void addLink(uint32_t node, int level, uint32_t neighbour) {
+    uint32_t* current = links_(node, level);
+    size_t maxLinks = links_.maxLinks(level);
+    if(current[0] < maxLinks) {
+      current[++current[0]] = neighbour;
+      return;
+    }
+    std::vector<Candidate> candidates = {{nodeDistance(node, neighbour), neighbour}};
+    for(uint32_t i = 1; i <= current[0]; ++i)
+      candidates.push_back({nodeDistance(node, current[i]), current[i]});
+    std::sort(candidates.begin(), candidates.end());
+    setLinks(node, level, selectNeighbours(candidates, maxLinks));
+  }
+
+public:
+  Builder(uint32_t* index, const float* weights, int rows, int dim, int efConstruction)
+  : weights_(weights), rows_(rows), dim_(dim), efConstruction_(efConstruction),
+    links_(index), distance_{weights, dim}, visited_(rows) {}
+
+  void build(const std::vector<int>& levels) {
+    int maxLevel = levels[0];
+    uint32_t entry = 0;
+    std::vector<Candidate> found;
+
+    for(int i = 1; i < rows_; ++i) {
+      uint32_t node = (uint32_t)i;
+      const float* q = weights_ + (size_t)node * dim_;
+      int level = levels[node];
+
+      std::vector<Candidate> entries = {{nodeDistance(node, entry), entry}};
+      for(int l = maxLevel; l > level; --l) {
+        searchLayer(found, q, entries, 1, l, links_, distance_, visited_);
+        entries = {found[0]};
+      }
+
+      for(int l = std::min(level, maxLevel); l >= 0; --l) {
+        searchLayer(found, q, entries, efConstruction_, l, links_, distance_, visited_);
+        auto neighbours = selectNeighbours(found, links_.M);
+        setLinks(node, l, neighbours);
+        for(uint32_t neighbour : neighbours)
+          addLink(neighbour, l, node);
+        entries = found;
+      }
+
+      if(level > maxLevel) {
+        maxLevel = level;
+        entry = node;
+      }
+    }
+
+    links_.data[kMaxLevel] = (uint32_t)maxLevel;
+    links_.data[kEntry] = entry;
+  }
+};
+
+// writes the header and the offsets of the upper links, all nodes start without links
+void initLayout(uint32_t* index, int rows, int M, const std::vector<int>& levels) {
+  std::vector<uint32_t> upperIds;
+  for(int i = 0; i < rows; ++i)
+    if(levels[i] > 0)
+      upperIds.push_back((uint32_t)i);
+
+  index[kMagic]      = indexMagic;
+  index[kM]          = (uint32_t)M;
+  index[kRows]       = (uint32_t)rows;
+  index[kMaxLevel]   = 0;
+  index[kEntry]      = 0;
+  index[kUpperCount] = (uint32_t)upperIds.size();
+
+  Links links(index);
+  size_t offset = (links.upperOffsets - index) + upperIds.size();
+  for(size_t i = 0; i < upperIds.size(); ++i) {
+    links.upperIds[i] = upperIds[i];
+    links.upperOffsets[i] = (uint32_t)offset;
+    offset += (size_t)levels[upperIds[i]] * (1 + M);
+  }
+
+  for(int i = 0; i < rows; ++i)
+    for(int level = 0; level <= levels[i]; ++level)
+      links((uint32_t)i, level)[0] = 0;
+}
+
+void searchRows(uint32_t* out, const float* queries, int qBegin, int qEnd, const float* weights, int dim,
+                const uint32_t* index, int k, int ef, int firstNRows) {
+  Links links(const_cast<uint32_t*>(index)); // only read here
+  Distance distance{weights, dim};
+  Visited visited(links.rows);
+  int maxLevel = (int)index[kMaxLevel];
+  uint32_t entry = index[kEntry];
+  int validRows = firstNRows != 0 ? std::min(firstNRows, links.rows) : links.rows;
+
+  std::vector<Candidate> found;
+  std::vector<uint32_t> best;
+  for(int row = qBegin; row < qEnd; ++row) {
+    const float* q = queries + (size_t)row * dim;
+
+    std::vector<Candidate> entries = {{distance(q, entry), entry}};
+    for(int level = maxLevel; level > 0; --level) {
+      searchLayer(found, q, entries, 1, level, links, distance, visited);
+      entries = {found[0]};
+    }
+    searchLayer(found, q, entries, std::max(ef, k), 0, links, distance, visited);
+
+    best.clear();
+    for(const auto& candidate : found) {
+      if(best.size() == (size_t)k)
+        break;
+      if((int)candidate.second < validRows)
+        best.push_back(candidate.second);
+    }
+    // if the search found fewer valid rows (tiny vocabularies or many rows skipped), fill up with the first unused ones
+    std::sort(best.begin(), best.end());
+    for(uint32_t node = 0; best.size() < (size_t)k; ++node)
+      if(!std::binary_search(best.begin(), best.end(), node))
+        best.insert(std::upper_bound(best.begin(), best.end(), node), node);
+
+    std::copy(best.begin(), best.end(), out + (size_t)row * k);
+  }
+}
+
+}  // namespace
+
+size_t indexSize(int rows, int M) {
+  auto levels = drawLevels(rows, M);
+  size_t size = kHeaderSize + (size_t)rows * (1 + 2 * M);
+  for(int level : levels)
+    if(level > 0)
+      size += 2 + (size_t)level * (1 + M);
+  return size;
+}
+
+void build(uint32_t* index, const float* weights, int rows, int dim, int M, int efConstruction) {
+  ABORT_IF(rows == 0, "Cannot build HNSW index over an empty matrix");
+  auto levels = drawLevels(rows, M);
+  initLayout(index, rows, M, levels);
+  Builder(index, weights, rows, dim, efConstruction).build(levels);
+}
+
+void search(uint32_t* out, const float* queries, int qRows, const float* weights, int dim, const uint32_t* index,
+            int k, int ef, int firstNRows, ThreadPool* pool) {
+  ABORT_IF(index[kMagic] != indexMagic, "Not an HNSW index");
+  int rows = (int)index[kRows];
+  ABORT_IF(k > (firstNRows != 0 ? std::min(firstNRows, rows) : rows),
+           "Cannot return {} nearest neighbours out of {} vectors", k, rows);
+
+  int threads = pool ? (int)pool->getNumThreads() + 1 : 1;
+  if(threads > qRows)
+    threads = qRows;
+  if(threads <= 1) {
+    searchRows(out, queries, 0, qRows, weights, dim, index, k, ef, firstNRows);
+    return;
+  }
+
+  // the calling thread searches the first slice of query rows itself
+  int rowsPerThread = (qRows + threads - 1) / threads;
+  std::vector<std::future<void>> slices;
+  for(int begin = rowsPerThread; begin < qRows; begin += rowsPerThread) {
+    int end = std::min(begin + rowsPerThread, qRows);
+    slices.emplace_back(pool->enqueue([=]() {
+      searchRows(out, queries, begin, end, weights, dim, index, k, ef, firstNRows);
+    }));
+  }
+  searchRows(out, queries, 0, rowsPerThread, weights, dim, index, k, ef, firstNRows);
+  for(auto& slice : slices)
+    slice.get();
+}
+
+Expr index(Expr weights, int M, int efConstruction) {
+  auto buildFwd = [M, efConstruction](Expr out, const std::vector<Expr>& inputs) {
+    Tensor w = inputs[0]->val();
+    int dim  = w->shape()[-1];
+    int rows = w->shape().elements() / dim;
+    build(out->val()->data<uint32_t>(), w->data<float>(), rows, dim, M, efConstruction);
+  };
+
+  // see lsh::encode, the index is memoized and only built once per graph and settings
+  static const size_t buildHash = (size_t)&buildFwd;
+  size_t hash = buildHash;
+  util::hash_combine(hash, M);
+  util::hash_combine(hash, efConstruction);
+
+  int rows = weights->shape().elements() / weights->shape()[-1];
+  return lambda({weights}, {(int)indexSize(rows, M)}, Type::uint32, buildFwd, hash);
+}
+
+Expr search(Expr query, Expr weights, int k, int ef, int firstNRows, bool abortIfDynamic, ThreadPool* pool) {
+  ABORT_IF(weights->value_type() != Type::float32, "HNSW search requires float32 output weights, not {}", weights->value_type());
+
+  Expr idx = weights->graph()->get("hnsw_output_index");
+  if(idx) {
+    LOG_ONCE(info, "Reusing parameter HNSW index {} with shape {}", idx->name(), idx->shape());
+  } else {
+    ABORT_IF(abortIfDynamic, "Dynamic creation of HNSW index prohibited");
+    LOG_ONCE(warn, "Building ad-hoc HNSW index over output matrix {}, use marian-conv --add-hnsw to store it in the model",
+             weights->shape());
+    idx = index(weights, /*M=*/16, /*efConstruction=*/100);
+  }
+
+  int currBeamSize = query->shape()[0];
+  int batchSize    = query->shape()[2];
+
+  auto searchFwd = [=](Expr out, const std::vector<Expr>& inputs) {
+    Tensor q = inputs[0]->val();
+    Tensor w = inputs[1]->val();
+    int dim   = w->shape()[-1];
+    int qRows = q->shape().elements() / dim;
+    ABORT_IF(inputs[2]->val()->data<uint32_t>()[kRows] != (uint32_t)(w->shape().elements() / dim),
+             "HNSW index does not match output matrix {}", w->shape());
+    hnsw::search(out->val()->data<uint32_t>(), q->data<float>(), qRows, w->data<float>(), dim,
+                 inputs[2]->val()->data<uint32_t>(), k, ef, firstNRows, pool);
+  };
+
+  Shape kShape({currBeamSize, batchSize, k});
+  return lambda({query, weights, idx}, kShape, Type::uint32, searchFwd);
+}
+
+void addDummyParameters(Ptr<ExpressionGraph> graph, std::string weightsName, int M) {
+  auto weights = graph->get(weightsName);
+  ABORT_IF(!weights, "Trying to index non-existing weights matrix {}??", weightsName);
+
+  int rows = weights->shape().elements() / weights->shape()[-1];
+  Shape shape({(int)indexSize(rows, M)});
+  LOG(info, "Adding HNSW index hnsw_output_index with shape {}", shape);
+  graph->param("hnsw_output_index", shape, inits::dummy(), Type::uint32);
+}
+
+void overwriteDummyParameters(Ptr<ExpressionGraph> graph, std::string weightsName, int M, int efConstruction) {
+  Expr weights = graph->get(weightsName);
+  Expr idx     = graph->get("hnsw_output_index");
+
+  ABORT_IF(!weights, "Trying to index non-existing weights matrix {}??", weightsName);
+  ABORT_IF(!idx, "Trying to overwrite non-existing HNSW parameter hnsw_output_index??");
+  ABORT_IF(weights->value_type() != Type::float32, "HNSW index requires float32 output weights, not {}", weights->value_type());
+
+  int dim  = weights->shape()[-1];
+  int rows = weights->shape().elements() / dim;
+  ABORT_IF(idx->shape().elements() != (int)indexSize(rows, M), "HNSW parameter hnsw_output_index was not added for M = {}", M);
+  LOG(info, "Building HNSW index over {} output vectors", rows);
+  build(idx->val()->data<uint32_t>(), weights->val()->data<float>(), rows, dim, M, efConstruction);
+}
+
+}  // namespace hnsw
+}  // namespace marian
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "graph/expression_operators.h"
+
+#include <string>
+
+/**
+ * Approximate maximum inner product search over the output embeddings with a hierarchical navigable small
+ * world graph (HNSW, https://arxiv.org/abs/1603.09320), an alternative to the LSH in layers/lsh.h.
+ *
+ * The graph is built and searched with the inner product as similarity (ip-NSW, Morozov and Babenko, 2018).
+ * This gives a much better recall for the same number of candidates than building it for euclidean distances
+ * after the usual reduction of inner products to distances, where queries are far away from all vectors.
+ *
+ * The index is a single uint32 tensor (see hnsw.cpp for its layout) that can be built ad-hoc or stored
+ * in the model by marian-conv like the LSH parameters, and is then memory-mapped with the rest of the model.
+ */
+
+namespace marian {
+
+class ThreadPool;
+
+namespace hnsw {
+
+  // number of uint32 words of the index over rows vectors with at most M links per node
+  size_t indexSize(int rows, int M);
+
+  // builds the index over the rows of weights [rows x dim] into index[0, indexSize(rows, M)). M is the number of links
+  // per node on the upper layers (2 * M on the bottom layer), efConstruction the number of candidates while inserting.
+  void build(uint32_t* index, const float* weights, int rows, int dim, int M, int efConstruction);
+
+  // writes the indices of (approximately) the k rows of weights with the largest inner product with each of the qRows
+  // queries to out[row * k, (row + 1) * k), sorted by increasing index. ef >= k is the number of candidates kept
+  // during the search. With firstNRows != 0 only the first firstNRows rows are returned.
+  void search(uint32_t* out, const float* queries, int qRows, const float* weights, int dim, const uint32_t* index,
+              int k, int ef, int firstNRows = 0, ThreadPool* pool = nullptr);
+
+  // builds the index for weights, memoized as long as weights is a parameter
+  Expr index(Expr weights, int M, int efConstruction);
+
+  // returns k indices per hypothesis [beam, batch, k] for queries [beam, 1, batch, dim]. Uses the index stored in the model
+  // as hnsw_output_index or builds one on the fly.
+  Expr search(Expr query, Expr weights, int k, int ef, int firstNRows = 0, bool abortIfDynamic = false, ThreadPool* pool = nullptr);
+
+  // These are helper functions for storing the index in the binary Marian model, used by marian-conv
+  void addDummyParameters(Ptr<ExpressionGraph> graph, std::string weightsName, int M);
+  void overwriteDummyParameters(Ptr<ExpressionGraph> graph, std::string weightsName, int M, int efConstruction);
+}
+
+}
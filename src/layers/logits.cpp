@@ -111,10 +111,17 @@ Expr Logits::getFactoredLogits(size_t groupIndex,
         factorMasks = constant(getFactorMasks(g, std::vector<WordIndex>()));
       }
       else {
+        // separate indices for each batch and beam
         auto forward = [this, g](Expr out, const std::vector<Expr>& inputs) {
-          Expr lastIndices = inputs[0];
-          std::vector<float> masks = getFactorMasks(g, lastIndices);
-          out->val()->set(masks);
+          std::vector<WordIndex> indices;
+          inputs[0]->val()->get(indices);
+          if(out->val()->getDeviceId().type == DeviceType::cpu) { // write the masks directly into the tensor
+            factoredVocab_->getFactorMasks(g, indices.data(), indices.size(), out->val()->data<float>());
+          } else {
+            std::vector<float> masks(indices.size());
+            factoredVocab_->getFactorMasks(g, indices.data(), indices.size(), masks.data());
+            out->val()->set(masks);
+          }
         };
 
         //int currBeamSize = sel->shape()[0];
@@ -143,6 +150,22 @@ Expr Logits::getFactoredLogits(size_t groupIndex,
   return sel;
 }
 
+// For lazy factor scoring during decoding (see BeamSearch::getNBestListLazyFactors()): the lemma logits
+// without the maxima of the secondary factors, and the maxima themselves, which getFactoredLogits(0)
+// otherwise adds to all lemmas that have the respective factor group.
+Expr Logits::getLemmaLogits() const {
+  ABORT_IF(empty(), "Attempted to read out logits on empty Logits object");
+  return logits_[0]->loss();
+}
+
+Expr Logits::getFactorMaxima() const {
+  ABORT_IF(getNumFactorGroups() < 2, "Factor maxima requested without secondary factors");
+  std::vector<Expr> maxima;
+  for(size_t g = 1; g < getNumFactorGroups(); g++)
+    maxima.push_back(max(logits_[g]->loss(), -1));  // [B... x 1]
+  return cast(concatenate(maxima, /*axis=*/-1), Type::float32);
+}
+
 // used for breakDown() only
 // Index is flattened
 Tensor Logits::getFactoredLogitsTensor(size_t groupIndex) const {
@@ -234,43 +257,8 @@ std::vector<float> Logits::getFactorMasks(size_t factorGroup, const std::vector<
       = indices.empty()
             ? (factoredVocab_->getGroupRange(0).second - factoredVocab_->getGroupRange(0).first)
             : indices.size();
-  std::vector<float> res;
-  res.reserve(n);
-  // @TODO: we should rearrange lemmaHasFactorGroup as vector[groups[i] of float; then move this
-  // into FactoredVocab
-  for(size_t i = 0; i < n; i++) {
-    auto lemma = indices.empty() ? i : (indices[i] - factoredVocab_->getGroupRange(0).first);
-    res.push_back((float)factoredVocab_->lemmaHasFactorGroup(lemma, factorGroup));
-  }
-  return res;
-}
-
-std::vector<float> Logits::getFactorMasks(size_t factorGroup, Expr indicesExpr)
-    const {  // [lemmaIndex] -> 1.0 for words that do have this factor; else 0
-  int batchSize = indicesExpr->shape()[0];
-  int currBeamSize = indicesExpr->shape()[1];
-  int numHypos = batchSize * currBeamSize;
-  std::vector<WordIndex> indices;
-  indicesExpr->val()->get(indices);
-
-  //std::cerr << "indices=" << indices.size() << std::endl;
-  size_t n
-      = indices.empty()
-            ? (factoredVocab_->getGroupRange(0).second - factoredVocab_->getGroupRange(0).first)
-            : indices.size() / numHypos;
-  std::vector<float> res;
-  res.reserve(numHypos * n);
-  //std::cerr << "n=" << n << std::endl;
-
-  // @TODO: we should rearrange lemmaHasFactorGroup as vector[groups[i] of float; then move this
-  // into FactoredVocab
-  for (size_t hypoIdx = 0; hypoIdx < numHypos; ++hypoIdx) {
-    for(size_t i = 0; i < n; i++) {
-      size_t idx = hypoIdx * n + i;
-      size_t lemma = indices.empty() ? i : (indices[idx] - factoredVocab_->getGroupRange(0).first);
-      res.push_back((float)factoredVocab_->lemmaHasFactorGroup(lemma, factorGroup));
-    }
-  }
+  std::vector<float> res(n);
+  factoredVocab_->getFactorMasks(factorGroup, indices.empty() ? nullptr : indices.data(), n, res.data());
   return res;
 }
 
@@ -28,6 +28,8 @@ public:
       Ptr<data::Shortlist> shortlist = nullptr,
       const std::vector<IndexType>& hypIndices = {},
       size_t beamSize = 0) const;  // get logits for only one factor group, with optional reshuffle
+  Expr getLemmaLogits() const;   // lemma logits without the factor maxima that getFactoredLogits(0) adds
+  Expr getFactorMaxima() const;  // [B..., numGroups - 1] maxima of the secondary factor groups, float32
   // Ptr<RationalLoss> getRationalLoss() const; // assume it holds a loss: get that
   Expr applyLossFunction(
       const Words& labels,
@@ -77,7 +79,6 @@ private:
   }  // actually the same as constant(data) for this data type
   std::vector<float> getFactorMasks(size_t factorGroup,
                                     const std::vector<WordIndex>& indices) const;
-  std::vector<float> getFactorMasks(size_t factorGroup, Expr indicesExpr) const; // same as above but separate indices for each batch and beam 
 
 private:
   // members
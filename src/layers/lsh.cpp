@@ -2,8 +2,9 @@
 #include "tensors/tensor_operators.h"
 #include "common/utils.h"
 
+#include "tensors/cpu/hamming.h"
+
 #include "3rd_party/faiss/utils/hamming.h"
-#include "3rd_party/faiss/Index.h"
 
 #if BLAS_FOUND
 #include "3rd_party/faiss/VectorTransform.h"
@@ -109,13 +110,12 @@ Expr rotator(Expr weights, int nBits) {
   return lambda({weights}, {dim, nBits}, Type::float32, rotator, rotatorHash);
 }
 
-Expr searchEncoded(Expr encodedQuery, Expr encodedWeights, int k, int firstNRows) {
+Expr searchEncoded(Expr encodedQuery, Expr encodedWeights, int k, int firstNRows, ThreadPool* pool) {
   ABORT_IF(encodedQuery->shape()[-1] != encodedWeights->shape()[-1],
            "Query and index bit vectors need to be of same size ({} != {})", encodedQuery->shape()[-1], encodedWeights->shape()[-1]);
 
   int currBeamSize = encodedQuery->shape()[0];
   int batchSize    = encodedQuery->shape()[2];
-  int numHypos = currBeamSize * batchSize;
 
   auto search = [=](Expr out, const std::vector<Expr>& inputs) {
     Expr encodedQuery   = inputs[0];
@@ -130,32 +130,19 @@ Expr searchEncoded(Expr encodedQuery, Expr encodedWeights, int k, int firstNRows
 
     int qRows = encodedQuery->shape().elements() / bytesPerVector;
 
-    uint8_t* qCodes = encodedQuery->val()->data<uint8_t>();
-    uint8_t* wCodes = encodedWeights->val()->data<uint8_t>();
-
-    // use actual faiss code for performing the hamming search. 
-    std::vector<int> distances(qRows * k);
-    std::vector<faiss::Index::idx_t> ids(qRows * k);
-    faiss::int_maxheap_array_t res = {(size_t)qRows, (size_t)k, ids.data(), distances.data()};
-    faiss::hammings_knn_hc(&res, qCodes, wCodes, (size_t)wRows, (size_t)bytesPerVector, 0);
-
-    // Copy int64_t indices to Marian index type and sort by increasing index value per hypothesis.
+    // Indices are returned sorted by increasing index value per hypothesis.
     // The sorting is required as we later do a binary search on those values for reverse look-up.
-    uint32_t* outData = out->val()->data<uint32_t>();
-    for (size_t hypoIdx = 0; hypoIdx < numHypos; ++hypoIdx) {
-      size_t startIdx = k * hypoIdx;
-      size_t endIdx = startIdx + k;
-      for(size_t i = startIdx; i < endIdx; ++i)
-        outData[i] = (uint32_t)ids[i];
-      std::sort(outData + startIdx, outData + endIdx);
-    }
+    cpu::hammingTopK(out->val()->data<uint32_t>(),
+                     encodedQuery->val()->data<uint8_t>(), (size_t)qRows,
+                     encodedWeights->val()->data<uint8_t>(), (size_t)wRows,
+                     (size_t)bytesPerVector, (size_t)k, pool);
   };
 
   Shape kShape({currBeamSize, batchSize, k});
   return lambda({encodedQuery, encodedWeights}, kShape, Type::uint32, search);
 }
 
-Expr search(Expr query, Expr weights, int k, int nBits, int firstNRows, bool abortIfDynamic) {
+Expr search(Expr query, Expr weights, int k, int nBits, int firstNRows, bool abortIfDynamic, ThreadPool* pool) {
   int dim = weights->shape()[-1];
   
   Expr rotMat = nullptr;
@@ -179,7 +166,7 @@ Expr search(Expr query, Expr weights, int k, int nBits, int firstNRows, bool abo
     encodedWeights = encode(weights, rotMat);
   }
   
-  return searchEncoded(encode(query, rotMat), encodedWeights, k, firstNRows);
+  return searchEncoded(encode(query, rotMat), encodedWeights, k, firstNRows, pool);
 }
 
 class RandomRotation : public inits::NodeInitializer {
@@ -16,6 +16,9 @@
  */
 
 namespace marian {
+
+class ThreadPool;
+
 namespace lsh {
 
   // return the number of full bytes required to encoded that many bits
@@ -27,12 +30,13 @@ namespace lsh {
   // compute the rotation matrix (maps weights->shape()[-1] to nbits floats)
   Expr rotator(Expr weights, int nbits);
 
-  // perform the LSH search on fully encoded input and weights, return k results (indices) per input row
+  // perform the LSH search on fully encoded input and weights, return k results (indices) per input row.
+  // If a thread pool is given, the input rows are searched in parallel.
   // @TODO: add a top-k like operator that also returns the bitwise computed distances
-  Expr searchEncoded(Expr encodedQuery, Expr encodedWeights, int k, int firstNRows = 0);
+  Expr searchEncoded(Expr encodedQuery, Expr encodedWeights, int k, int firstNRows = 0, ThreadPool* pool = nullptr);
 
   // same as above, but performs encoding on the fly
-  Expr search(Expr query, Expr weights, int k, int nbits, int firstNRows = 0, bool abortIfDynamic = false);
+  Expr search(Expr query, Expr weights, int k, int nbits, int firstNRows = 0, bool abortIfDynamic = false, ThreadPool* pool = nullptr);
   
   // These are helper functions for encoding the LSH into the binary Marian model, used by marian-conv
   void addDummyParameters(Ptr<ExpressionGraph> graph, std::string weightsName, int nBits);
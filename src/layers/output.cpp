@@ -23,10 +23,24 @@ namespace mlp {
   if(tiedParam_) {
     Wt_ = tiedParam_;
   } else {
+    auto intgemmWt = graph_->get(name + "_Wt");
     if(graph_->get(name + "_W")) {  // support of legacy models that did not transpose
       Wt_ = graph_->param(
           name + "_W", {inputDim, numOutputClasses}, inits::glorotUniform(true, false));
       isLegacyUntransposedW = true;
+    } else if(intgemmWt && isIntgemm(intgemmWt->value_type())) {
+      // intgemm output matrices are stored untransposed as B [inputDim x numOutputClasses], which allows
+      // the shortlist to select columns directly from the packed matrix
+      ABORT_IF(factoredVocab_, "Factored vocabularies are not supported with intgemm output matrices");
+      // older versions of marian-conv stored the packed matrix as [numOutputClasses x inputDim], the packed
+      // memory is specific to the CPU and can not be transposed when loading
+      ABORT_IF(numOutputClasses != inputDim && intgemmWt->shape() == Shape({numOutputClasses, inputDim}),
+               "Intgemm output matrix {} has the shape {} of an older version of marian-conv. "
+               "Convert the float32 model again with marian-conv",
+               name + "_Wt", intgemmWt->shape());
+      Wt_ = graph_->param(
+          name + "_Wt", {inputDim, numOutputClasses}, inits::dummy(), intgemmWt->value_type());
+      isLegacyUntransposedW = true;
     } else  // this is the regular case:
       Wt_ = graph_->param(
           name + "_Wt", {numOutputClasses, inputDim}, inits::glorotUniform(false, true));
@@ -312,6 +326,9 @@ Logits Output::applyAsLogits(Expr input) /*override final*/ {
       }
     }
     return Logits(std::move(allLogits), factoredVocab_);
+  } else if(shortlist_ && shortlist_->isPerSentence()) {
+    // every batch entry has its own candidate set: [beam, 1, batch, dim] -> [beam, 1, batch, k]
+    return Logits(gatherAffine(input, Wt_, shortlist_->getIndicesExpr(), b_));
   } else if(shortlist_) {
     return Logits(affineOrDot(input,
                               shortlist_->getCachedShortWt(),
@@ -2,6 +2,7 @@
 #include "common/cli_helper.h"
 #include "common/filesystem.h"
 #include "common/version.h"
+#include "tensors/cpu/integer_common.h"
 
 namespace marian {
 
@@ -144,7 +145,16 @@ std::string EncoderDecoder::getModelParametersAsString() {
 void EncoderDecoder::load(Ptr<ExpressionGraph> graph,
                           const std::string& name,
                           bool markedReloaded) {
-  graph->load(name, markedReloaded && !opt<bool>("ignore-model-config", false));
+  markedReloaded = markedReloaded && !opt<bool>("ignore-model-config", false);
+  // quantize float32 models on the fly instead of requiring a model converted with marian-conv
+  if(opt<bool>("int8-on-load", false) && graph->getDeviceId().type == DeviceType::cpu) {
+    ABORT_IF(graph->getDefaultElementType() != Type::float32,
+             "--int8-on-load requires --precision float32, not {}", graph->getDefaultElementType());
+    auto items = cpu::integer::loadItemsQuantized(name, Type::intgemm8);
+    graph->load(std::move(items), markedReloaded);
+  } else {
+    graph->load(name, markedReloaded);
+  }
 }
 
 void EncoderDecoder::mmap(Ptr<ExpressionGraph> graph,
@@ -197,6 +207,10 @@ Ptr<DecoderState> EncoderDecoder::step(Ptr<ExpressionGraph> graph,
                                        int beamSize) {
   // create updated state that reflects reordering and dropping of hypotheses
   state = hypIndices.empty() ? state : state->select(hypIndices, batchIndices, beamSize);
+  // per-sentence shortlists have to drop the same batch entries
+  auto shortlist = decoders_[0]->getShortlist();
+  if(shortlist && !hypIndices.empty())
+    shortlist->selectBatchEntries(batchIndices);
 
   // Fill state with embeddings based on last prediction
   decoders_[0]->embeddingsFromPrediction(graph, state, words, (int) batchIndices.size(), beamSize);
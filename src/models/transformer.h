@@ -10,6 +10,7 @@
 #include "models/encoder.h"
 #include "models/states.h"
 #include "models/transformer_factory.h"
+#include "models/transformer_options.h"
 #include "rnn/constructors.h"
 #define _USE_MATH_DEFINES  // enables math constants. We need M_PI_2
 #include <math.h>
@@ -39,6 +40,15 @@ protected:
   // It can be accessed by getAlignments(). @TODO: move into a state or return-value object
   std::vector<Expr> alignments_; // [max tgt len or 1][beam depth, max src length, batch size, 1]
 
+  mutable/*lazy*/ Ptr<const TransformerOptions> cfg_; // options used while building the graph, see cfg()
+
+  // Options snapshot, taken on first use so that it is also available for inheriting constructors
+  const TransformerOptions& cfg() const {
+    if(!cfg_)
+      cfg_ = New<TransformerOptions>(options_, inference_);
+    return *cfg_;
+  }
+
   // @TODO: make this go away
   template <typename T> 
   T opt(const char* const key) const { Ptr<Options> options = options_; return options->get<T>(key); }  
@@ -64,7 +74,7 @@ public:
     Expr embeddings = input;
 
     if(trainPosEmbeddings) {
-      int maxLength = opt<int>("max-length");
+      int maxLength = cfg().maxLength;
 
       // Hack for translating with length longer than trained embeddings
       // We check if the embedding matrix "Wpos" already exist so we can
@@ -118,7 +128,7 @@ public:
   }
 
   virtual Expr addSpecialEmbeddings(Expr input, int start = 0, Ptr<data::CorpusBatch> /*batch*/ = nullptr) const {
-    bool trainPosEmbeddings = opt<bool>("transformer-train-positions", false);
+    bool trainPosEmbeddings = cfg().trainPositions;
     return addPositionalEmbeddings(input, start, trainPosEmbeddings);
   }
 
@@ -261,7 +271,7 @@ public:
       collectOneHead(weights, dimBeam);
 
     // optional dropout for attention weights
-    weights = dropout(weights, inference_ ? 0 : opt<float>("transformer-dropout-attention"));
+    weights = dropout(weights, cfg().dropoutAttention);
 
     // apply attention weights to values
     auto output = bdot_legacy(weights, v);   // [-4: beam depth * batch size, -3: num heads, -2: max tgt length, -1: split vector dim]
@@ -327,7 +337,7 @@ public:
 
     int dimAtt = output->shape()[-1];
 
-    bool project = !opt<bool>("transformer-no-projection");
+    bool project = !cfg().noProjection;
     if(project || dimAtt != dimOut) {
       auto Wo = graph_->param(prefix + "_Wo", {dimAtt, dimOut}, inits::glorotUniform(true, true, depthScaling_ ? 1.f / sqrtf((float)depth_) : 1.f));
       auto bo = graph_->param(prefix + "_bo", {1, dimOut}, inits::zeros());
@@ -346,14 +356,14 @@ public:
     auto output = slice(values, -2, 0); // Select first word [-4: beam depth, -3: batch size, -2: 1, -1: vector dim]
 
     int dimPool = output->shape()[-1];
-    bool project = !opt<bool>("transformer-no-projection");
+    bool project = !cfg().noProjection;
     if(project || dimPool != dimModel) {
       auto Wo = graph_->param(prefix + "_Wo", {dimPool, dimModel}, inits::glorotUniform(true, true, depthScaling_ ? 1.f / sqrtf((float)depth_) : 1.f));
       auto bo = graph_->param(prefix + "_bo", {1, dimModel}, inits::zeros());
       output = affine(output, Wo, bo);  // [-4: beam depth, -3: batch size, -2: 1, -1: vector dim]
     }
 
-    auto opsPost = opt<std::string>("transformer-postprocess");
+    const auto& opsPost = cfg().postprocess;
     output = postProcess(prefix + "_Wo", opsPost, output, input, 0.f);
 
     return output;
@@ -369,14 +379,14 @@ public:
                       bool saveAttentionWeights = false) {
     int dimModel = input->shape()[-1];
 
-    float dropProb = inference_ ? 0 : opt<float>("transformer-dropout");
-    auto opsPre = opt<std::string>("transformer-preprocess");
+    float dropProb = cfg().dropout;
+    const auto& opsPre = cfg().preprocess;
     auto output = preProcess(prefix + "_Wo", opsPre, input, dropProb);
 
     // multi-head self-attention over previous input
     output = MultiHead(prefix, dimModel, dimHeads, output, keys, values, mask, cache, saveAttentionWeights);
     
-    auto opsPost = opt<std::string>("transformer-postprocess");
+    const auto& opsPost = cfg().postprocess;
     output = postProcess(prefix + "_Wo", opsPost, output, input, dropProb);
 
     return output;
@@ -397,21 +407,20 @@ public:
     decoderLayerState.output = values;
 
     return LayerAttention(prefix, input, values, values, selfMask,
-                          opt<int>("transformer-heads"), /*cache=*/false);
+                          cfg().heads, /*cache=*/false);
   }
 
   Expr LayerFFN(std::string prefix, Expr input) const {
     int dimModel = input->shape()[-1];
 
-    float dropProb = inference_ ? 0 : opt<float>("transformer-dropout");
-    auto opsPre = opt<std::string>("transformer-preprocess");
+    float dropProb = cfg().dropout;
+    const auto& opsPre = cfg().preprocess;
     auto output = preProcess(prefix + "_ffn", opsPre, input, dropProb);
 
-    auto actName = opt<std::string>("transformer-ffn-activation");
-    int dimFfn = opt<int>("transformer-dim-ffn");
-    int depthFfn = opt<int>("transformer-ffn-depth");
-    float ffnDropProb
-      = inference_ ? 0 : opt<float>("transformer-dropout-ffn");
+    const auto& actName = cfg().ffnActivation;
+    int dimFfn = cfg().dimFfn;
+    int depthFfn = cfg().ffnDepth;
+    float ffnDropProb = cfg().dropoutFfn;
 
     ABORT_IF(depthFfn < 1, "Filter depth {} is smaller than 1", depthFfn);
 
@@ -422,7 +431,7 @@ public:
       output = denseInline(output, prefix, /*suffix=*/std::to_string(i), dimFfn, initFn, actName, ffnDropProb);
     output = denseInline(output, prefix, /*suffix=*/std::to_string(depthFfn), dimModel, initFn);
 
-    auto opsPost = opt<std::string>("transformer-postprocess");
+    const auto& opsPost = cfg().postprocess;
     output = postProcess(prefix + "_ffn", opsPost, output, input, dropProb);
 
     return output;
@@ -433,16 +442,16 @@ public:
   Expr LayerAAN(std::string prefix, Expr x, Expr y) const {
     int dimModel = x->shape()[-1];
 
-    float dropProb = inference_ ? 0 : opt<float>("transformer-dropout");
-    auto opsPre = opt<std::string>("transformer-preprocess");
+    float dropProb = cfg().dropout;
+    const auto& opsPre = cfg().preprocess;
 
     y = preProcess(prefix + "_ffn", opsPre, y, dropProb);
 
     // FFN
-    int dimAan   = opt<int>("transformer-dim-aan");
-    int depthAan = opt<int>("transformer-aan-depth");
-    auto actName = opt<std::string>("transformer-aan-activation");
-    float aanDropProb = inference_ ? 0 : opt<float>("transformer-dropout-ffn");
+    int dimAan   = cfg().dimAan;
+    int depthAan = cfg().aanDepth;
+    const auto& actName = cfg().aanActivation;
+    float aanDropProb = cfg().dropoutFfn;
 
     auto initFn = inits::glorotUniform(true, true, depthScaling_ ? 1.f / sqrtf((float)depth_) : 1.f);
 
@@ -452,14 +461,14 @@ public:
     if(y->shape()[-1] != dimModel) // bring it back to the desired dimension if needed
       y = denseInline(y, prefix, std::to_string(depthAan), dimModel, initFn);
 
-    bool noGate = opt<bool>("transformer-aan-nogate");
+    bool noGate = cfg().aanNoGate;
     if(!noGate) {
       auto gi = denseInline(x, prefix, /*suffix=*/"i", dimModel, initFn, "sigmoid");
       auto gf = denseInline(y, prefix, /*suffix=*/"f", dimModel, initFn, "sigmoid");
       y = gi * x + gf * y;
     }
 
-    auto opsPost = opt<std::string>("transformer-postprocess");
+    const auto& opsPost = cfg().postprocess;
     y = postProcess(prefix + "_ffn", opsPost, y, x, dropProb);
 
     return y;
@@ -513,8 +522,8 @@ public:
 
     auto rnn = perLayerRnn[prefix];
 
-    float dropProb = inference_ ? 0 : opt<float>("transformer-dropout");
-    auto opsPre = opt<std::string>("transformer-preprocess");
+    float dropProb = cfg().dropout;
+    const auto& opsPre = cfg().preprocess;
     auto output = preProcess(prefix, opsPre, input, dropProb);
 
     output = transposeTimeBatch(output);
@@ -522,7 +531,7 @@ public:
     decoderState = rnn->lastCellStates()[0];
     output = transposeTimeBatch(output);
 
-    auto opsPost = opt<std::string>("transformer-postprocess");
+    const auto& opsPost = cfg().postprocess;
     output = postProcess(prefix + "_ffn", opsPost, output, input, dropProb);
 
     return output;
@@ -566,8 +575,8 @@ public:
 
     auto prevLayer = layer; // keep handle to untransformed embeddings, potentially used for a final skip connection
 
-    auto opsEmb = opt<std::string>("transformer-postprocess-emb");
-    float dropProb = inference_ ? 0 : opt<float>("transformer-dropout");
+    const auto& opsEmb = cfg().postprocessEmb;
+    float dropProb = cfg().dropout;
     layer = preProcess(prefix_ + "_emb", opsEmb, layer, dropProb);
 
     // LayerAttention expects mask in a different layout
@@ -576,7 +585,7 @@ public:
 
     // apply encoder layers
     // This is the Transformer Encoder stack.
-    auto encDepth = opt<int>("enc-depth");
+    auto encDepth = cfg().encDepth;
     for(int i = 1; i <= encDepth; ++i) {
       depth_ = i;
 
@@ -585,7 +594,7 @@ public:
                              layer, // keys
                              layer, // values
                              layerMask, // [batch size, num heads broadcast=1, max length broadcast=1, max length]
-                             opt<int>("transformer-heads"));
+                             cfg().heads);
       layer = LayerFFN(prefix_ + "_l" + std::to_string(i) + "_ffn", layer);
       checkpoint(layer); // sets a manually specified checkpoint if gradient checkpointing is enabled, does nothing otherwise.
     }
@@ -593,7 +602,7 @@ public:
     // this allows to run a final layernorm operation after going through the transformer layer stack.
     // By default the operations are empty, but with prenorm (--transformer-preprocess n --transformer-postprocess da) 
     // it is recommended to normalize here. Can also be used to add a skip connection from the very bottom if requested.
-    auto opsTop = opt<std::string>("transformer-postprocess-top", "");
+    const auto& opsTop = cfg().postprocessTop;
     layer = postProcess(prefix_ + "_top", opsTop, layer, prevLayer, dropProb);
 
     // restore organization of batch and time steps. This is currently required
@@ -681,8 +690,7 @@ public:
       std::vector<Ptr<EncoderState>>& encStates) override {
     graph_ = graph;
 
-    std::string layerType = opt<std::string>("transformer-decoder-autoreg", "self-attention");
-    if (layerType == "rnn") {
+    if (cfg().decoderAutoreg == "rnn") {
       int dimBatch = (int)batch->size();
       int dim = opt<int>("dim-emb");
 
@@ -729,8 +737,8 @@ public:
 
     auto prevQuery = query; // keep handle to untransformed embeddings, potentially used for a final skip connection
 
-    auto opsEmb = opt<std::string>("transformer-postprocess-emb");
-    float dropProb = inference_ ? 0 : opt<float>("transformer-dropout");
+    const auto& opsEmb = cfg().postprocessEmb;
+    float dropProb = cfg().dropout;
 
     query = preProcess(prefix_ + "_emb", opsEmb, query, dropProb);
 
@@ -779,9 +787,8 @@ public:
     rnn::States prevDecoderStates = state->getStates();
     rnn::States decoderStates;
     // apply decoder layers
-    auto decDepth = opt<int>("dec-depth");
-    std::vector<size_t> tiedLayers = opt<std::vector<size_t>>("transformer-tied-layers",
-                                                              std::vector<size_t>());
+    auto decDepth = cfg().decDepth;
+    const auto& tiedLayers = cfg().tiedLayers;
     ABORT_IF(!tiedLayers.empty() && tiedLayers.size() != decDepth,
              "Specified layer tying for {} layers, but decoder has {} layers",
              tiedLayers.size(),
@@ -799,7 +806,7 @@ public:
         prevDecoderState = prevDecoderStates[i];
 
       // self-attention
-      std::string layerType = opt<std::string>("transformer-decoder-autoreg", "self-attention");
+      const auto& layerType = cfg().decoderAutoreg;
       rnn::State decoderState;
       if(layerType == "self-attention")
         query = DecoderLayerSelfAttention(decoderState, prevDecoderState, prefix_ + "_l" + layerNo + "_self", query, selfMask, startPos);
@@ -825,21 +832,9 @@ public:
           // if training is performed with guided_alignment or if alignment is requested during
           // decoding or scoring return the attention weights of one head of the last layer.
           // @TODO: maybe allow to return average or max over all heads?
-          bool saveAttentionWeights = false;
-          if(j == 0 && (options_->get("guided-alignment", std::string("none")) != "none" || options_->hasAndNotEmpty("alignment"))) {
-            size_t attLayer = decDepth - 1;
-            std::string gaStr = options_->get<std::string>("transformer-guided-alignment-layer", "last");
-            if(gaStr != "last")
-              attLayer = std::stoull(gaStr) - 1;
-
-            ABORT_IF(attLayer >= decDepth,
-                     "Chosen layer for guided attention ({}) larger than number of layers ({})",
-                     attLayer + 1, decDepth);
-
-            saveAttentionWeights = i == attLayer;
-          }
+          bool saveAttentionWeights = j == 0 && i == cfg().alignmentLayer;
 
-          if(options_->get<bool>("transformer-pool", false)) {
+          if(cfg().pool) {
             query = LayerPooling(prefix,
                                  query,
                                  encoderContexts[j]); // values
@@ -849,7 +844,7 @@ public:
                                    encoderContexts[j], // keys
                                    encoderContexts[j], // values
                                    encoderMasks[j],
-                                   opt<int>("transformer-heads"),
+                                   cfg().heads,
                                    /*cache=*/true,
                                    saveAttentionWeights);
           }
@@ -869,7 +864,7 @@ public:
     // This allows to run a final layernorm operation after going through the transformer layer stack.
     // By default the operations are empty, but with prenorm (--transformer-preprocess n --transformer-postprocess da) 
     // it is recommended to normalize here. Can also be used to add a skip connection from the very bottom if requested.
-    auto opsTop = opt<std::string>("transformer-postprocess-top", "");
+    const auto& opsTop = cfg().postprocessTop;
     query = postProcess(prefix_ + "_top", opsTop, query, prevQuery, dropProb);
 
     auto decoderContext = transposeTimeBatch(query); // [-4: beam depth=1, -3: max length, -2: batch size, -1: vector dim]
@@ -883,7 +878,7 @@ public:
     
     // return unormalized(!) probabilities
     Ptr<DecoderState> nextState;
-    if (opt<std::string>("transformer-decoder-autoreg", "self-attention") == "rnn") {
+    if (cfg().decoderAutoreg == "rnn") {
       nextState = New<DecoderState>(
         decoderStates, logits, state->getEncoderStates(), state->getBatch());
     } else {
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "common/options.h"
+
+#include <string>
+#include <vector>
+
+namespace marian {
+
+// Snapshot of the options the transformer reads while building its graph. The graph is rebuilt for
+// every batch and during translation for every decoding step, where every layer used to look up its
+// options by name (key hashing, YAML conversion, string and vector copies). The snapshot is taken
+// once per encoder or decoder, see Transformer::cfg().
+struct TransformerOptions {
+  // dropout probabilities, always 0 for inference
+  float dropout{0.f};
+  float dropoutAttention{0.f};
+  float dropoutFfn{0.f};
+
+  int heads;
+  bool noProjection;
+  bool pool;
+
+  bool trainPositions;
+  int maxLength{0}; // only used with trainPositions
+
+  std::string preprocess;
+  std::string postprocess;
+  std::string postprocessEmb;
+  std::string postprocessTop;
+
+  std::string ffnActivation;
+  int dimFfn;
+  int ffnDepth;
+
+  // type of the auto-regressive decoder layer: self-attention, average-attention or rnn
+  std::string decoderAutoreg;
+
+  // only used with average-attention
+  std::string aanActivation;
+  int dimAan{0};
+  int aanDepth{0};
+  bool aanNoGate{false};
+
+  int encDepth;
+  int decDepth;
+  std::vector<size_t> tiedLayers;
+
+  // 0-based decoder layer whose cross-attention weights are returned for guided alignment
+  // or --alignment, -1 if alignments are not needed
+  int alignmentLayer{-1};
+
+  TransformerOptions(Ptr<Options> options, bool inference) {
+    if(!inference) {
+      dropout          = options->get<float>("transformer-dropout");
+      dropoutAttention = options->get<float>("transformer-dropout-attention");
+      dropoutFfn       = options->get<float>("transformer-dropout-ffn");
+    }
+
+    heads        = options->get<int>("transformer-heads");
+    noProjection = options->get<bool>("transformer-no-projection");
+    pool         = options->get<bool>("transformer-pool", false);
+
+    trainPositions = options->get<bool>("transformer-train-positions", false);
+    if(trainPositions)
+      maxLength = options->get<int>("max-length");
+
+    preprocess     = options->get<std::string>("transformer-preprocess");
+    postprocess    = options->get<std::string>("transformer-postprocess");
+    postprocessEmb = options->get<std::string>("transformer-postprocess-emb");
+    postprocessTop = options->get<std::string>("transformer-postprocess-top", "");
+
+    ffnActivation = options->get<std::string>("transformer-ffn-activation");
+    dimFfn        = options->get<int>("transformer-dim-ffn");
+    ffnDepth      = options->get<int>("transformer-ffn-depth");
+
+    decoderAutoreg = options->get<std::string>("transformer-decoder-autoreg", "self-attention");
+    if(decoderAutoreg == "average-attention") {
+      aanActivation = options->get<std::string>("transformer-aan-activation");
+      dimAan        = options->get<int>("transformer-dim-aan");
+      aanDepth      = options->get<int>("transformer-aan-depth");
+      aanNoGate     = options->get<bool>("transformer-aan-nogate");
+    }
+
+    encDepth   = options->get<int>("enc-depth");
+    decDepth   = options->get<int>("dec-depth");
+    tiedLayers = options->get<std::vector<size_t>>("transformer-tied-layers", std::vector<size_t>());
+
+    if(options->get("guided-alignment", std::string("none")) != "none" || options->hasAndNotEmpty("alignment")) {
+      alignmentLayer = decDepth - 1;
+      std::string gaStr = options->get<std::string>("transformer-guided-alignment-layer", "last");
+      if(gaStr != "last")
+        alignmentLayer = std::stoi(gaStr) - 1;
+
+      ABORT_IF(alignmentLayer < 0 || alignmentLayer >= decDepth,
+               "Chosen layer for guided attention ({}) larger than number of layers ({})",
+               alignmentLayer + 1, decDepth);
+    }
+  }
+};
+
+}  // namespace marian
@@ -1,6 +1,7 @@
 #include <cmath>
 
 #include "optimizers/quantizer.h"
+#include "tensors/cpu/integer_common.h"
 #include "tensors/tensor_allocator.h"
 #include "tensors/tensor_operators.h"
 
@@ -83,7 +84,10 @@ static void logQuantization(Tensor data, Tensor res, int numCenters, float S, fl
 void ModelQuantizer::quantize(Ptr<ExpressionGraph> graph) {
   // lazily allocate tensor for error feedback mechanism
   if(!errorResidual_) {
-    LOG(info, "Quantizing the model to {}-bits", bits_);
+    if(intgemm_)
+      LOG(info, "Quantizing the model to {}-bits with intgemm8 scaling", bits_);
+    else
+      LOG(info, "Quantizing the model to {}-bits", bits_);
 
     int numElements = (int)graph->params()->vals()->size();
     auto allocator = New<TensorAllocator>(graph->getBackend());
@@ -104,8 +108,13 @@ void ModelQuantizer::quantize(Ptr<ExpressionGraph> graph) {
   }
 
   for(auto p : *graph->params()) {
+    if(intgemm_) {
+      // only the matrices that become intgemm8 at inference, with their scale 127/max|W|
+      if(p->val()->shape().size() == 2 && cpu::integer::isIntgemmWeightName(p->name()))
+        quantizeImpl(p->val());
+    }
     // quantize weight tensors, biases optional
-    if(quantBias_ || p->val()->shape()[0] > 1)
+    else if(quantBias_ || p->val()->shape()[0] > 1)
       quantizeImpl(p->val());
   }
 
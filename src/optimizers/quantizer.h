@@ -26,7 +26,12 @@ public:
       : bits_{options->get<size_t>("quantize-bits")},
         optSteps_{options->get<size_t>("quantize-optimization-steps")},
         quantBias_{options->get<bool>("quantize-biases")},
-        logQuant_{options->get<bool>("quantize-log-based")} {}
+        logQuant_{options->get<bool>("quantize-log-based")},
+        intgemm_{options->get<bool>("quantize-intgemm", false)} {
+    ABORT_IF(intgemm_ && (bits_ != 8 || optSteps_ > 0 || logQuant_ || quantBias_),
+             "--quantize-intgemm emulates intgemm8 and requires --quantize-bits 8 without "
+             "--quantize-optimization-steps, --quantize-log-based or --quantize-biases");
+  }
 
   void quantize(Ptr<ExpressionGraph> graph);
 
@@ -37,6 +42,7 @@ protected:
   size_t optSteps_;
   bool 	quantBias_;
   bool logQuant_;
+  bool intgemm_;  // quantize only intgemm weight matrices, exactly like marian-conv --gemm-type intgemm8
   bool isFirstError_;
 
   std::vector<Ptr<TensorAllocator>> allocators_;
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <deque>
 #include <memory>
 #include <set>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -78,6 +80,35 @@ public:
   Gap rest(size_t offset) const { return Gap(data_ + offset, size_ - offset); }
 };
 
+// Strategy used by the Allocator to manage the reserved memory.
+// FirstFit: best-fitting gap from a set of free gaps, adjacent gaps are merged when freed.
+// SizeClasses: allocations are rounded up to a power of two and recycled via one free list
+//   per size class, new memory is taken from a bump arena which is reset by clear() (e.g. for
+//   every batch). This trades memory for constant-time alloc/free, which pays off for graphs
+//   with many small tensors like CPU decoding with small models.
+enum class AllocationStrategy { FirstFit, SizeClasses };
+
+static inline AllocationStrategy allocationStrategyFromString(const std::string& name) {
+  if(name == "first-fit")
+    return AllocationStrategy::FirstFit;
+  else if(name == "size-classes")
+    return AllocationStrategy::SizeClasses;
+  ABORT("Unknown allocation strategy '{}', expected first-fit or size-classes", name);
+}
+
+// Allocation statistics, see Allocator::stats()
+struct AllocatorStats {
+  size_t capacity{0};      // reserved bytes
+  size_t inUse{0};         // currently allocated bytes
+  size_t peak{0};          // high-water mark of allocated bytes since the last resetStats()
+  size_t extent{0};        // high-water mark of the end of the used memory since the last resetStats(), i.e. the
+                           // reserved bytes needed for the same allocations including padding to size classes
+                           // and fragmentation
+  size_t allocations{0};   // number of allocations since the last resetStats()
+  size_t growEvents{0};    // number of times the reserved memory had to be extended since the last resetStats()
+  float fragmentation{0};  // 1 - largest free block / free bytes, 0 if all free memory is contiguous
+};
+
 class Allocator {
 private:
   Ptr<Device> device_;
@@ -87,28 +118,47 @@ private:
 
   bool throw_{false};
 
+  AllocationStrategy strategy_{AllocationStrategy::FirstFit};
+
+  // AllocationStrategy::FirstFit
   std::set<Gap> gaps_;
+
+  // AllocationStrategy::SizeClasses
+  std::vector<std::vector<uint8_t*>> freeLists_; // free blocks of size alignment_ * 2^i for size class i
+  size_t arenaOffset_{0};                        // start of the unused tail of the memory
+
   std::unordered_map<uint8_t*, MemoryPiece::PtrType> allocated_;
 
+  AllocatorStats stats_;
+
   void grow(size_t add) {
     add = alignedSize(add);
     uint8_t* oldData = device_->data();
     size_t oldSize = device_->size();
 
     device_->reserve(oldSize + add);
-
-    std::set<Gap> oldGaps;
-    gaps_.swap(oldGaps);
-
-    for(auto gap : oldGaps)
-      gaps_.insert(Gap(device_->data() + std::distance(oldData, gap.data()),
-                       gap.size()));
-    insertGap(Gap(device_->data() + oldSize, add));
+    stats_.growEvents++;
+
+    auto relocate = [&](uint8_t* ptr) { return device_->data() + std::distance(oldData, ptr); };
+
+    if(strategy_ == AllocationStrategy::FirstFit) {
+      std::set<Gap> oldGaps;
+      gaps_.swap(oldGaps);
+
+      for(auto gap : oldGaps)
+        gaps_.insert(Gap(relocate(gap.data()), gap.size()));
+      insertGap(Gap(device_->data() + oldSize, add));
+    } else {
+      for(auto& freeList : freeLists_)
+        for(auto& ptr : freeList)
+          ptr = relocate(ptr);
+      available_ += add;
+    }
 
     std::unordered_map<uint8_t*, MemoryPiece::PtrType> oldAllocated;
     allocated_.swap(oldAllocated);
     for(auto it : oldAllocated) {
-      uint8_t* newPtr = device_->data() + std::distance(oldData, it.first);
+      uint8_t* newPtr = relocate(it.first);
       allocated_[newPtr] = oldAllocated[it.first];
       allocated_[newPtr]->setPtr(newPtr);
     }
@@ -154,6 +204,63 @@ private:
     gaps_.insert(gap);
   }
 
+  // index i of the smallest size class alignment_ * 2^i that holds the (aligned) size
+  size_t sizeClass(size_t size) const {
+    size_t sizeClass = 0;
+    while((alignment_ << sizeClass) < size)
+      sizeClass++;
+    return sizeClass;
+  }
+
+  uint8_t* allocFromSizeClass(size_t size) {
+    size_t index = sizeClass(size);
+    size_t classSize = alignment_ << index;
+
+    if(index < freeLists_.size() && !freeLists_[index].empty()) {
+      uint8_t* ptr = freeLists_[index].back();
+      freeLists_[index].pop_back();
+      available_ -= classSize;
+      return ptr;
+    }
+
+    if(arenaOffset_ + classSize > device_->size()) {
+      if(throw_)
+        throw AllocationException(available_, classSize);
+      grow(std::max(step_, arenaOffset_ + classSize - device_->size()));
+    }
+
+    uint8_t* ptr = device_->data() + arenaOffset_;
+    arenaOffset_ += classSize;
+    available_ -= classSize;
+    return ptr;
+  }
+
+  void freeToSizeClass(uint8_t* ptr, size_t size) {
+    size_t index = sizeClass(size);
+    if(freeLists_.size() <= index)
+      freeLists_.resize(index + 1);
+    freeLists_[index].push_back(ptr);
+    available_ += alignment_ << index;
+  }
+
+  // offset of the end of an allocation, for size classes the whole class is taken from the arena
+  size_t usedEnd(uint8_t* ptr, size_t bytes) const {
+    if(strategy_ == AllocationStrategy::SizeClasses)
+      bytes = alignment_ << sizeClass(bytes);
+    return (size_t)std::distance(device_->data(), ptr) + bytes;
+  }
+
+  size_t largestFreeBlock() const {
+    if(strategy_ == AllocationStrategy::FirstFit)
+      return gaps_.empty() ? 0 : gaps_.rbegin()->size();
+
+    size_t largest = device_->size() - arenaOffset_;
+    for(size_t i = 0; i < freeLists_.size(); ++i)
+      if(!freeLists_[i].empty())
+        largest = std::max(largest, alignment_ << i);
+    return largest;
+  }
+
 public:
   Allocator(DeviceId deviceId,
             size_t bytes,
@@ -181,6 +288,15 @@ public:
   }
 
   void throwAtReallocation(bool throwRealloc) { throw_ = throwRealloc; }
+  bool throwsAtReallocation() const { return throw_; }
+
+  // Changing the strategy frees all allocations
+  void setStrategy(AllocationStrategy strategy) {
+    strategy_ = strategy;
+    clear();
+  }
+
+  AllocationStrategy getStrategy() const { return strategy_; }
 
   void reserve(size_t bytes) {
     bytes = alignedSize(bytes);
@@ -201,15 +317,26 @@ public:
 
   MemoryPiece::PtrType alloc(size_t bytes) {
     bytes = alignedSize(bytes);
-    Gap gap = getGap(bytes);
 
-    if(gap.size() > bytes) {
-      insertGap(gap.rest(bytes), false);
+    uint8_t* ptr;
+    if(strategy_ == AllocationStrategy::FirstFit) {
+      Gap gap = getGap(bytes);
+
+      if(gap.size() > bytes) {
+        insertGap(gap.rest(bytes), false);
+      }
+      ptr = gap.data();
+    } else {
+      ptr = allocFromSizeClass(bytes);
     }
 
-    auto ptr = gap.data();
     auto mp = MemoryPiece::New(ptr, bytes);
     allocated_[ptr] = mp;
+
+    stats_.allocations++;
+    stats_.inUse += bytes;
+    stats_.peak = std::max(stats_.peak, stats_.inUse);
+    stats_.extent = std::max(stats_.extent, usedEnd(ptr, bytes));
     return mp;
   }
 
@@ -224,7 +351,11 @@ public:
     auto it = allocated_.find(ptr);
     if(it != allocated_.end()) {
       allocated_.erase(ptr);
-      insertGap(Gap(ptr, bytes), true);
+      if(strategy_ == AllocationStrategy::FirstFit)
+        insertGap(Gap(ptr, bytes), true);
+      else
+        freeToSizeClass(ptr, bytes);
+      stats_.inUse -= bytes;
       return true;
     }
     return false;
@@ -241,8 +372,14 @@ public:
   void clear() {
     available_ = 0;
     gaps_.clear();
+    freeLists_.clear();
+    arenaOffset_ = 0;
     allocated_.clear();
-    insertGap({device_->data(), device_->size()}, false);
+    stats_.inUse = 0;
+    if(strategy_ == AllocationStrategy::FirstFit)
+      insertGap({device_->data(), device_->size()}, false);
+    else
+      available_ = device_->size();
   }
 
   MemoryPiece::PtrType memory() {
@@ -254,5 +391,22 @@ public:
   size_t available() { return available_; }
 
   DeviceId getDeviceId() { return device_->getDeviceId(); }
+
+  AllocatorStats stats() const {
+    AllocatorStats stats = stats_;
+    stats.capacity = device_->size();
+    stats.fragmentation = available_ > 0 ? 1.f - (float)largestFreeBlock() / available_ : 0.f;
+    return stats;
+  }
+
+  // Reset peak, number of allocations and grow events, e.g. before measuring a representative workload
+  void resetStats() {
+    stats_.peak = stats_.inUse;
+    stats_.extent = 0;
+    for(const auto& it : allocated_)
+      stats_.extent = std::max(stats_.extent, usedEnd(it.first, it.second->size()));
+    stats_.allocations = 0;
+    stats_.growEvents = 0;
+  }
 };
 }  // namespace marian
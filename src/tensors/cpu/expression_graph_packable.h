@@ -2,7 +2,11 @@
 
 #include "graph/expression_graph.h"
 #include "fbgemm/packed_gemm.h"
+#include "tensors/cpu/int4_gemm.h"
 #include "tensors/cpu/integer_common.h"
+#include "common/regex.h"
+
+#include <tuple>
 
 namespace marian {
   namespace cpu {
@@ -20,15 +24,83 @@ namespace marian {
 // So, we make a subclass of ExpressionGraph and put those immature codes in this class.
 // We will improve this in the near future. 
 class ExpressionGraphPackable : public ExpressionGraph {
+private:
+  // Abort packing if the relative quantization error of any int8 or int4 matrix exceeds this, 0 means no check
+  float maxQuantizationError_{0.f};
+  std::vector<std::pair<regex::regex, Type>> precisionMap_; // per-parameter GEMM types, see setPrecisionMap(...)
+
+  Type precisionFor(const std::string& pName, Type gemmElementType) const {
+    for(const auto& rule : precisionMap_)
+      if(regex::regex_search(pName, rule.first))
+        return rule.second;
+    return gemmElementType;
+  }
+
+  // Same naming heuristic as for intgemm, but without the transposed output matrix "_Wt"
+  // which is also used for the shortlist and hence stays in an intgemm or float format
+  static bool isInt4Quantizable(const std::string& pName, const Shape& shape) {
+    bool isWeight = pName.find("_W") == pName.length() - 2
+                    || (pName.find("_W") == pName.length() - 3 && !cpu::integer::isTransposedB(pName));
+    return isWeight && shape.size() == 2 && cpu::int4::canQuantize(shape[-2], shape[-1]);
+  }
+
 public:
   ExpressionGraphPackable()
     : ExpressionGraph( /* inference =  */ true) {} // Packable expression graph only supports inference
 
   virtual ~ExpressionGraphPackable() {}
 
+  void setMaxQuantizationError(float maxError) { maxQuantizationError_ = maxError; }
+
+  // Per-parameter GEMM types given as "regex:type", the first rule whose regex matches the parameter
+  // name decides, e.g. "ffn_W[12]$:int4" "Wemb:float32". Other parameters use the --gemm-type.
+  void setPrecisionMap(const std::vector<std::string>& rules) {
+    precisionMap_.clear();
+    for(const auto& rule : rules) {
+      auto pos = rule.rfind(':');
+      ABORT_IF(pos == std::string::npos, "Precision rule '{}' is not of the form regex:type", rule);
+      precisionMap_.emplace_back(regex::regex(rule.substr(0, pos)), typeFromString(rule.substr(pos + 1)));
+    }
+  }
+
+  // Logs the relative quantization error of all quantizable matrices for int8 (per output column) and
+  // int4 (groups of cpu::int4::GROUP_SIZE), most sensitive first, as a guide for setPrecisionMap(...).
+  void reportSensitivity() {
+    std::vector<std::tuple<float, float, std::string>> errors;
+    auto allocator = New<TensorAllocator>(getBackend());
+    for(auto p : paramsByElementType_[Type::float32]->getMap()) {
+      const auto& pName = p.first;
+      Tensor val = p.second->val();
+      if(!isInt4Quantizable(pName, val->shape()))
+        continue;
+      int K = val->shape()[-2];
+      int N = val->shape()[-1];
+      Tensor tmp;
+      allocator->allocate(tmp, {N, K}, Type::float32);
+      cpu::Transpose10(tmp, val);
+      errors.emplace_back(cpu::int4::quantizationError(tmp->data(), N, K, /*bits=*/4, cpu::int4::GROUP_SIZE),
+                          cpu::int4::quantizationError(tmp->data(), N, K, /*bits=*/8, /*groupSize=*/K),
+                          pName);
+      allocator->free(tmp);
+    }
+    std::sort(errors.rbegin(), errors.rend());
+
+    LOG(info, "Relative quantization error per matrix (int4, int8):");
+    for(const auto& e : errors)
+      LOG(info, "  {:.6f} {:.6f} {}", std::get<0>(e), std::get<1>(e), std::get<2>(e));
+    if(maxQuantizationError_ > 0.f) {
+      for(const auto& e : errors)
+        if(std::get<0>(e) > maxQuantizationError_)
+          LOG(info, "Suggested precision rule for {}: '{}$:{}'", std::get<2>(e), std::get<2>(e),
+              std::get<1>(e) > maxQuantizationError_ ? "float32" : "intgemm8");
+    }
+  }
+
   // Convert model weights into packed format and save to IO items.
   std::vector<io::Item> pack(Type gemmElementType = Type::float32, Type saveElementType = Type::float32) {
     std::vector<io::Item> ioItems;
+    float worstQuantError = 0.f; // largest relative quantization error of int8 packed matrices
+    std::string worstQuantErrorName;
 
     // handle packable parameters first (a float32 parameter is packable)
     auto packableParameters = paramsByElementType_[Type::float32];
@@ -44,12 +116,13 @@ public:
       }
 
       Tensor val = p.second->val();
+      Type gemmType = precisionFor(pName, gemmElementType);
 
       // save as packed format
       // @TODO Hardcoded to find packable weights
       // int8 - all the weights used for affine op and dot op
       // fp16 - all the weights used for affine op
-      if ((gemmElementType == Type::packed8avx2 || gemmElementType == Type::packed8avx512)
+      if ((gemmType == Type::packed8avx2 || gemmType == Type::packed8avx512)
         && (pName.find("_W") == pName.length() - 3 || pName.find("_W") == pName.length() - 2)) {
 #if USE_FBGEMM
         using namespace marian::cpu::variant;
@@ -59,7 +132,7 @@ public:
         uint64_t packsize;
 
         fbgemmPacked8PackInfo(val->shape(),
-                              gemmElementType,
+                              gemmType,
                               pName.find("Wemb") != std::string::npos,
                               nrow,
                               ncol,
@@ -71,18 +144,26 @@ public:
         Tensor packedTensor;
         allocator->allocate(packedTensor, { 1, (int32_t)packsize }, Type::uint8);
 
-        //Pack B matrix into int8
+        //Pack B matrix into int8, quantized per output channel (column)
+        float quantError = 0.f;
         fbgemmPacked8Pack(packedTensor,
                           val->data(),
-                          gemmElementType,
+                          gemmType,
                           pName.find("Wemb") != std::string::npos,
                           nrow,
                           ncol,
-                          packsize);
+                          packsize,
+                          getBackend()->getQuantizeRange(),
+                          &quantError);
+        LOG(info, "Packed {} into {}, relative quantization error {:.6f}", pName, gemmType, quantError);
+        if(quantError > worstQuantError) {
+          worstQuantError = quantError;
+          worstQuantErrorName = pName;
+        }
         io::Item item;
         item.name = pName;
         item.shape = val->shape();
-        item.type = gemmElementType;
+        item.type = gemmType;
 
         // Use the actual memory as this will be aligned and padded.
         // When memory mapping this is required. Shape keeps track of
@@ -93,10 +174,10 @@ public:
 
         ioItems.emplace_back(std::move(item));
 #else
-        ABORT("Packed type {} only supported when compiled with -DUSE_FBGEMM=on", gemmElementType);
+        ABORT("Packed type {} only supported when compiled with -DUSE_FBGEMM=on", gemmType);
 #endif
       // fp16 quantization option
-      } else if (gemmElementType == Type::packed16 && pName.find("_W") == pName.length() - 3) {
+      } else if (gemmType == Type::packed16 && pName.find("_W") == pName.length() - 3) {
 #if USE_FBGEMM
         using namespace marian::cpu::variant;
 
@@ -148,108 +229,138 @@ public:
 
         ioItems.emplace_back(std::move(item));
 #else
-        ABORT("Packed type {} only supported when compiled with -DUSE_FBGEMM=on", gemmElementType);
+        ABORT("Packed type {} only supported when compiled with -DUSE_FBGEMM=on", gemmType);
 #endif
-      } else if (isIntgemm(gemmElementType) &&
+      } else if (gemmType == Type::int4 && isInt4Quantizable(pName, val->shape())) {
+        // int4 matrices are stored with the inner dimension contiguous for each output column
+        int K = val->shape()[-2];
+        int N = val->shape()[-1];
+        auto allocator = New<TensorAllocator>(getBackend());
+        Tensor tmp;
+        allocator->allocate(tmp, {N, K}, Type::float32);
+        cpu::Transpose10(tmp, val);
+
+        io::Item item;
+        item.name = pName;
+        item.shape = val->shape();
+        item.type = Type::int4;
+        item.bytes.resize(requiredBytes(item.shape, item.type));
+        float quantError = cpu::int4::quantize(tmp->data(), N, K, item.bytes.data());
+        LOG(info, "Quantized {} into int4, relative quantization error {:.6f}", pName, quantError);
+        if(quantError > worstQuantError) {
+          worstQuantError = quantError;
+          worstQuantErrorName = pName;
+        }
+        ioItems.emplace_back(std::move(item));
+      } else if (isIntgemm(gemmType) &&
       (pName.find("_W") == pName.length() - 3 || pName.find("_W") == pName.length() - 2 /* || pName.find("Wemb") != std::string::npos*/)) {
 #if COMPILE_CPU
         using cpu::integer::cols;
         using cpu::integer::rows;
         auto allocator = New<TensorAllocator>(getBackend());
 
-        Tensor paramMat; //This allocates extra 4 bytes at the end because of gemmElementType
-        allocator->allocate(paramMat, val->shape(), gemmElementType);
+        // The output layer matrix "_Wt" [n x k] is already transposed and gets stored as intgemm B [k x n],
+        // so that columns can be selected for the shortlist without re-packing.
+        bool transposedB = cpu::integer::isTransposedB(pName);
+        Shape bShape = transposedB ? Shape({val->shape()[-1], val->shape()[-2]}) : val->shape();
+
+        Tensor paramMat; //This allocates extra 4 bytes at the end because of gemmType
+        allocator->allocate(paramMat, bShape, gemmType);
 
         // Compute QuantMultiplier, compress matrix and store quantMult at the end.
         // We need to tranpose first, because of our architecture independet format requiring a transposed matrix
         Tensor tmp;
-        allocator->allocate(tmp, val->shape(), val->type());
-        cpu::Transpose10(tmp, val);
+        if(transposedB) {
+          tmp = val;
+        } else {
+          allocator->allocate(tmp, val->shape(), val->type());
+          cpu::Transpose10(tmp, val);
+        }
   
-        if(sizeOf(gemmElementType) == 1) { // is 8-bit Intgemm type
+        if(sizeOf(gemmType) == 1) { // is 8-bit Intgemm type
           float quantMult = cpu::integer::computeQuantMult<Type::intgemm8>(val);
 
           // Hardware-specific conversions which allow to implement memory-mapping and avoid conversion at runtime
-          cpu::integer::passOrAbort(gemmElementType); // Check if the hardware supports the GEMM type
-          if(isSsse3(gemmElementType)) {
+          cpu::integer::passOrAbort(gemmType); // Check if the hardware supports the GEMM type
+          if(isSsse3(gemmType)) {
             intgemm::ssse3::Kernels8::PrepareBTransposed(tmp->data(), /*input*/
                                                     paramMat->data<int8_t>(), /*output*/
                                                     quantMult, /*Quant Mult*/
-                                                    rows(val),
-                                                    cols(val));
-          } else if(isAvx2(gemmElementType)) {
+                                                    rows(bShape),
+                                                    cols(bShape));
+          } else if(isAvx2(gemmType)) {
             intgemm::avx2::Kernels8::PrepareBTransposed(tmp->data(), /*input*/
                                                    paramMat->data<int8_t>(), /*output*/
                                                    quantMult, /*Quant Mult*/
-                                                   rows(val),
-                                                   cols(val));
-          } else if(isAvx512(gemmElementType)) {
+                                                   rows(bShape),
+                                                   cols(bShape));
+          } else if(isAvx512(gemmType)) {
             intgemm::avx512bw::Kernels8::PrepareBTransposed(tmp->data(), /*input*/
                                                      paramMat->data<int8_t>(), /*output*/
                                                      quantMult, /*Quant Mult*/
-                                                     rows(val),
-                                                     cols(val));
+                                                     rows(bShape),
+                                                     cols(bShape));
           } else {
-            ABORT_IF(gemmElementType != Type::intgemm8, "Type {} is not supported", gemmElementType); // shouldn't really happen, but let's make sure
+            ABORT_IF(gemmType != Type::intgemm8, "Type {} is not supported", gemmType); // shouldn't really happen, but let's make sure
             intgemm::Int8::PrepareA(tmp->data(), /*input*/
                                     paramMat->data<int8_t>(), /*output*/
                                     quantMult, /*Quant Mult*/
-                                    rows(val),
-                                    cols(val));
+                                    rows(bShape),
+                                    cols(bShape));
           }
           //Put the quantMult at the back of the tensor
           cpu::integer::getQuantMult<Type::intgemm8>(paramMat) = quantMult;
 
-        } else if(sizeOf(gemmElementType) == 2) { // is 16-bit Intgemm type
+        } else if(sizeOf(gemmType) == 2) { // is 16-bit Intgemm type
           float quantMult = cpu::integer::computeQuantMult<Type::intgemm16>(val);
 
            // Hardware-specific conversions which allow to implement memory-mapping and avoid conversion at runtime
-           cpu::integer::passOrAbort(gemmElementType); // Check if the hardware supports the GEMM type
-          if(isSse2(gemmElementType)) {
+           cpu::integer::passOrAbort(gemmType); // Check if the hardware supports the GEMM type
+          if(isSse2(gemmType)) {
             intgemm::sse2::Kernels16::PrepareBTransposed(tmp->data(), /*input*/
                                                     paramMat->data<int16_t>(), /*output*/
                                                     quantMult, /*Quant Mult*/
-                                                    rows(val),
-                                                    cols(val));
-          } else if(isAvx2(gemmElementType)) {
+                                                    rows(bShape),
+                                                    cols(bShape));
+          } else if(isAvx2(gemmType)) {
             intgemm::avx2::Kernels16::PrepareBTransposed(tmp->data(), /*input*/
                                                     paramMat->data<int16_t>(), /*output*/
                                                     quantMult, /*Quant Mult*/
-                                                    rows(val),
-                                                    cols(val));
-          } else if(isAvx512(gemmElementType)) {
+                                                    rows(bShape),
+                                                    cols(bShape));
+          } else if(isAvx512(gemmType)) {
             intgemm::avx512bw::Kernels16::PrepareBTransposed(tmp->data(), /*input*/
                                                       paramMat->data<int16_t>(), /*output*/
                                                       quantMult, /*Quant Mult*/
-                                                      rows(val),
-                                                      cols(val));
+                                                      rows(bShape),
+                                                      cols(bShape));
           } else {
-            ABORT_IF(gemmElementType != Type::intgemm16, "Type {} is not supported", gemmElementType); // shouldn't really happen, but let's make sure
+            ABORT_IF(gemmType != Type::intgemm16, "Type {} is not supported", gemmType); // shouldn't really happen, but let's make sure
             intgemm::Int16::PrepareA(tmp->data(), /*input*/
                                      paramMat->data<int16_t>(), /*output*/
                                      quantMult, /*Quant Mult*/
-                                     rows(val),
-                                     cols(val));
+                                     rows(bShape),
+                                     cols(bShape));
           }
           //Put the quantMult at the back of the tensor
           cpu::integer::getQuantMult<Type::intgemm16>(paramMat) = quantMult;
           
         } else {
-          ABORT("Incorrect Intgemm type size: {}", sizeOf(gemmElementType));
+          ABORT("Incorrect Intgemm type size: {}", sizeOf(gemmType));
         }
 
         //Save... Same as the fbgemm case
         io::Item item;
         item.name = pName;
-        item.shape = val->shape();
-        item.type = gemmElementType;
+        item.shape = bShape;
+        item.type = gemmType;
 
         auto mem = paramMat->memory();
         item.bytes.resize(mem->size());
         copy(backend_, mem->data<char>(), mem->data<char>() + mem->size(), item.bytes.data());
         ioItems.emplace_back(std::move(item));
 #else
-        ABORT("Packed type {} only supported when compiled with -DCOMPILE_CPU=on", gemmElementType);
+        ABORT("Packed type {} only supported when compiled with -DCOMPILE_CPU=on", gemmType);
 #endif
       } else {
         ABORT_IF(saveElementType != Type::float32, "We currently do not know how to save matrices as {}", saveElementType);
@@ -282,14 +393,23 @@ public:
       }
     }
 
+    if(!worstQuantErrorName.empty()) {
+      LOG(info, "Largest relative quantization error {:.6f} in {}", worstQuantError, worstQuantErrorName);
+      ABORT_IF(maxQuantizationError_ > 0.f && worstQuantError > maxQuantizationError_,
+               "Relative quantization error {} of {} exceeds --max-quantization-error {}",
+               worstQuantError, worstQuantErrorName, maxQuantizationError_);
+    }
+
     return ioItems;
   }
 
-  void packAndSave(const std::string& name, const std::string& meta, Type gemmElementType = Type::float32, Type saveElementType = Type::float32) {
+  void packAndSave(const std::string& name, const std::string& meta, Type gemmElementType = Type::float32, Type saveElementType = Type::float32, bool compressed = false, bool deduplicate = false) {
     auto ioItems = pack(gemmElementType, saveElementType);
+    if(deduplicate)
+      io::deduplicateItems(ioItems);
     if (!meta.empty())
       io::addMetaToItems(meta, "special:model.yml", ioItems);
-    io::saveItems(name, ioItems);
+    io::saveItems(name, ioItems, compressed);
   }
 };
 
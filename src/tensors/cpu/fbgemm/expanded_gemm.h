@@ -285,6 +285,7 @@ public:
 // size_t k_: the number of columns in A and the number of rows in C
 // bool transA_: transpose A
 // bool transB_: transpose B
+// bool relu_: apply ReLU after adding the bias, fused into the output stage of the GEMM
 class FbgemmPacked8AffineNodeOp : public NaryNodeOp {
 private:
   size_t m_;
@@ -292,6 +293,7 @@ private:
   size_t k_;
   bool transA_;
   bool transB_;
+  bool relu_;
   Type elementType_;
 
 public:
@@ -300,8 +302,10 @@ public:
                             Shape bShape,
                             bool transA,
                             bool transB,
-                            float /*scalar*/)
+                            float /*scalar*/,
+                            bool relu = false)
       : NaryNodeOp(nodes, newShape(nodes[0], bShape, transA, transB), Type::float32),
+        relu_(relu),
         elementType_(elementType) {
     transA_ = transA;
     transB_ = transB;
@@ -339,29 +343,18 @@ public:
   NodeOps forwardOps() override {
     NodeOps nodeOps;
 #if USE_FBGEMM
-    // Do addBias only if it has a bias term
-    if (children().size() > 2) {
-      nodeOps = { NodeOp(fbgemmPacked8Gemm(elementType_,
-                                           val_,
-                                           child(0)->val(),
-                                           child(1)->val(),
-                                           m_,
-                                           n_,
-                                           k_,
-                                           transA_,
-                                           transB_);
-                       marian::cpu::integer::AddBias(val_, child(2)->val())) };
-    } else {
-      nodeOps = { NodeOp(fbgemmPacked8Gemm(elementType_,
-                                           val_,
-                                           child(0)->val(),
-                                           child(1)->val(),
-                                           m_,
-                                           n_,
-                                           k_,
-                                           transA_,
-                                           transB_)) };
-    }
+    // Bias addition and ReLU are done in the output stage of the GEMM
+    nodeOps = { NodeOp(fbgemmPacked8Gemm(elementType_,
+                                         val_,
+                                         child(0)->val(),
+                                         child(1)->val(),
+                                         m_,
+                                         n_,
+                                         k_,
+                                         transA_,
+                                         transB_,
+                                         children().size() > 2 ? child(2)->val() : nullptr, // pass only if it has a bias
+                                         relu_)) };
 #else // USE_FBGEMM
     ABORT("FbgemmPacked8AffineNodeOp can only be used with FBGEMM enabled.");
 #endif  // USE_FBGEMM
@@ -374,7 +367,7 @@ public:
     return {NodeOp(0)};
   }
 
-  const std::string type() override { return "gemmPacked8"; }
+  const std::string type() override { return relu_ ? "gemmPacked8Relu" : "gemmPacked8"; }
 };
 
 static inline Expr affine(Type elementType,
@@ -384,14 +377,16 @@ static inline Expr affine(Type elementType,
                           Expr c,
                           bool transA,
                           bool transB,
-                          float scalar) {
+                          float scalar,
+                          bool relu = false) {
   std::vector<Expr> nodes = {a, b, c};
 
-  if (elementType == Type::packed16)
+  if (elementType == Type::packed16) {
+    ABORT_IF(relu, "Fused ReLU is only available for int8 packed GEMM, not {}", elementType);
     return Expression<FbgemmPacked16AffineNodeOp>(nodes, bShape, transA, transB, scalar);
-  else if (isPacked(elementType) && sizeOf(elementType) == 1)
+  } else if (isPacked(elementType) && sizeOf(elementType) == 1)
     return Expression<cpu::variant::FbgemmPacked8AffineNodeOp>(
-        elementType, nodes, bShape, transA, transB, scalar);
+        elementType, nodes, bShape, transA, transB, scalar, relu);
   else {
     ABORT("Only int8 and fp16 are available. {}", elementType);
     return nullptr;
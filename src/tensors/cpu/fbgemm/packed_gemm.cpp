@@ -342,6 +342,7 @@ void fbgemmPacked16Pack(marian::Tensor out,
 //                    https://intel.github.io/mkl-dnn/dev_guide_int8_computations.html
 //                    (e.g. 3.f means the original tensor is quantized
 //                    from [mean - 3.f * standard deviation, mean + 3.f * standard deviation] to [-64, 63])
+// quantError (out): if not null, the relative squared error of the quantized matrix ||B - dequant(quant(B))||^2 / ||B||^2
 void fbgemmPacked8Pack(marian::Tensor out,
                        const float* inData,
                        const marian::Type packType,
@@ -349,7 +350,8 @@ void fbgemmPacked8Pack(marian::Tensor out,
                        const int nrow,
                        const int ncol,
                        const uint64_t packsize,
-                       const float quantRangeStdDevs) {
+                       const float quantRangeStdDevs,
+                       /*out*/float* quantError) {
   int k = nrow;
   int n = ncol;
   int len = k * n;
@@ -421,6 +423,21 @@ void fbgemmPacked8Pack(marian::Tensor out,
     }
   }
 
+  // quality check: compare the dequantized values with the original ones
+  if(quantError) {
+    double sqrErr = 0, sqrSum = 0;
+    for(int jj = 0; jj < n; jj++) {
+      for(int ii = 0; ii < k; ii++) {
+        float orig = getVal2dArr(data, ii, jj, k, n, transpose);
+        int8_t q = transpose ? quantized[jj * k + ii] : quantized[ii * n + jj];
+        float diff = orig - quantScaleB[jj] * (q - quantZeropointB[jj]);
+        sqrErr += diff * diff;
+        sqrSum += orig * orig;
+      }
+    }
+    *quantError = sqrSum > 0 ? (float)(sqrErr / sqrSum) : 0.f;
+  }
+
   // 3. compute column offsets
   int32_t* colOffsets = new int32_t[n];
   colOffsetsWithZeroPtS8acc32(transpose, k, n, quantized, quantZeropointB, colOffsets, 1);
@@ -536,6 +553,8 @@ void fbgemmPacked16Gemm(marian::Tensor C,
 // k: the number of columns in A and the number of rows in B
 // transA: whether A matrix is transposed or not
 // transB: whether B matrix is transposed or not
+// bias: bias vector of size n added in the output stage of the GEMM (or nullptr)
+// relu: apply ReLU in the output stage of the GEMM
 void fbgemmPacked8Gemm(Type packType,
                        marian::Tensor C,
                        const marian::Tensor A,
@@ -544,7 +563,9 @@ void fbgemmPacked8Gemm(Type packType,
                        const size_t n,
                        const size_t k,
                        const int transA,
-                       const int transB) {
+                       const int transB,
+                       const marian::Tensor bias,
+                       const bool relu) {
   const fbgemm::BlockingFactors* params = getBlockingFactors(packType);
 
   // Check if the packed format matches with the available AVX instruction set in the machine
@@ -617,23 +638,40 @@ void fbgemmPacked8Gemm(Type packType,
     colOffsetsB.resize(n);
   memcpy(colOffsetsB.data(), dataB + packSizeB + n * (sizeof(float) + sizeof(int32_t)), n * sizeof(int32_t));
 
-  DoNothing<float, float> doNothingObj{};
-  ReQuantizeForFloat<false, QuantizationGranularity::OUT_CHANNEL> outputProcObj(
-      doNothingObj,
-      quantScaleA,
-      quantScaleB.data(),
-      quantZeropointA,
-      quantZeropointB.data(),
-      packA.getRowOffsetBuffer(),
-      colOffsetsB.data(),
-      nullptr,
-      (std::uint32_t) n);
-
   PackBMatrix<int8_t> repackedB(
     transB ? matrix_op_t::Transpose : matrix_op_t::NoTranspose, (int32_t) k, (int32_t) n, dataB, (int32_t) (transB ? k : n), 1, params);
 
-  // gemm computation
-  fbgemmPacked(packA, repackedB, C->data(), (int32_t*)C->data(), (int32_t) n, outputProcObj, 0, 1, params);
+  // The output stage dequantizes with the per-column (output channel) scales and zero points of B
+  // and fuses the bias addition and ReLU, so the output is written only once.
+  DoNothing<float, float> doNothingObj{};
+  const float* dataBias = bias ? bias->data() : nullptr;
+  if(relu) {
+    ReQuantizeForFloat<true, QuantizationGranularity::OUT_CHANNEL> outputProcObj(
+        doNothingObj,
+        quantScaleA,
+        quantScaleB.data(),
+        quantZeropointA,
+        quantZeropointB.data(),
+        packA.getRowOffsetBuffer(),
+        colOffsetsB.data(),
+        dataBias,
+        (std::uint32_t) n);
+
+    fbgemmPacked(packA, repackedB, C->data(), (int32_t*)C->data(), (int32_t) n, outputProcObj, 0, 1, params);
+  } else {
+    ReQuantizeForFloat<false, QuantizationGranularity::OUT_CHANNEL> outputProcObj(
+        doNothingObj,
+        quantScaleA,
+        quantScaleB.data(),
+        quantZeropointA,
+        quantZeropointB.data(),
+        packA.getRowOffsetBuffer(),
+        colOffsetsB.data(),
+        dataBias,
+        (std::uint32_t) n);
+
+    fbgemmPacked(packA, repackedB, C->data(), (int32_t*)C->data(), (int32_t) n, outputProcObj, 0, 1, params);
+  }
 }
 
 #endif // USE_FBGEMM
@@ -101,6 +101,7 @@ void fbgemmPacked16Pack(marian::Tensor out,
 //                    https://intel.github.io/mkl-dnn/dev_guide_int8_computations.html
 //                    (e.g. 3.f means the original tensor is quantized
 //                    from [mean - 3.f * standard deviation, mean + 3.f * standard deviation] to [-64, 63])
+// quantError (out): if not null, the relative squared error of the quantized matrix ||B - dequant(quant(B))||^2 / ||B||^2
 void fbgemmPacked8Pack(marian::Tensor out,
                        const float* inData,
                        const marian::Type packType,
@@ -108,7 +109,8 @@ void fbgemmPacked8Pack(marian::Tensor out,
                        const int nrow,
                        const int ncol,
                        const uint64_t packsize,
-                       const float quantRangeStdDevs = 0.f); // @TODO: change to size_t where appropriate
+                       const float quantRangeStdDevs = 0.f,
+                       /*out*/float* quantError = nullptr); // @TODO: change to size_t where appropriate
 
 // GEMM operation on the packed B matrix
 // C: output matrix
@@ -135,6 +137,8 @@ void fbgemmPacked16Gemm(marian::Tensor C,
 // k: the number of columns in A and rows in B
 // transA: transpose of A matrix
 // transB: transpose of B matrix
+// bias: bias vector added in the output stage (optional)
+// relu: apply ReLU in the output stage
 void fbgemmPacked8Gemm(Type packType,
                        marian::Tensor C,
                        const marian::Tensor A,
@@ -143,7 +147,9 @@ void fbgemmPacked8Gemm(Type packType,
                        const size_t n,
                        const size_t k,
                        const int transA = 0,
-                       const int transB = 0);
+                       const int transB = 0,
+                       const marian::Tensor bias = nullptr,
+                       const bool relu = false);
 
 }  // namespace variant
 }  // namespace cpu
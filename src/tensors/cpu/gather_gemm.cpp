@@ -0,0 +1,44 @@
+#include "tensors/cpu/gather_gemm.h"
+#include "tensors/cpu/prod_blas.h"
+
+#include <cstring>
+#include <vector>
+
+namespace marian {
+namespace cpu {
+
+void gatherAffine(marian::Tensor C, const marian::Tensor A, const marian::Tensor W, const marian::Tensor indices, const marian::Tensor bias) {
+  int batch = indices->shape()[0];
+  int k     = indices->shape()[1];
+  int dim   = A->shape()[-1];
+  ABORT_IF(A->shape()[-2] != batch, "Batch dimension of A {} does not match indices {}", A->shape(), indices->shape());
+  ABORT_IF(W->shape()[-1] != dim, "Inner dimensions of A {} and W {} do not match", A->shape(), W->shape());
+  int R = A->shape().elements() / (batch * dim);
+
+  const IndexType* idx = indices->data<IndexType>();
+  const float* w = W->data();
+  float* a = A->data();
+  float* c = C->data();
+
+  std::vector<float> buffer((size_t)k * dim);
+  for(int b = 0; b < batch; ++b) {
+    const IndexType* rowIdx = idx + (size_t)b * k;
+    for(int j = 0; j < k; ++j)
+      std::memcpy(buffer.data() + (size_t)j * dim, w + (size_t)rowIdx[j] * dim, dim * sizeof(float));
+
+    // rows of A and C that belong to batch entry b are batch * dim (batch * k) elements apart
+    sgemm(/*transA=*/false, /*transB=*/true, R, k, dim, 1.f, a + (size_t)b * dim, batch * dim, buffer.data(), dim, 0.f, c + (size_t)b * k, batch * k);
+
+    if(bias) {
+      const float* bs = bias->data();
+      for(int r = 0; r < R; ++r) {
+        float* cr = c + ((size_t)r * batch + b) * k;
+        for(int j = 0; j < k; ++j)
+          cr[j] += bs[rowIdx[j]];
+      }
+    }
+  }
+}
+
+}  // namespace cpu
+}  // namespace marian
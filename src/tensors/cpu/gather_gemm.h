@@ -0,0 +1,15 @@
+#pragma once
+
+#include "tensors/tensor.h"
+
+namespace marian {
+namespace cpu {
+
+// C [R x batch x k] = A [R x batch x dim] * W[indices[b, :], :]^T + bias[indices[b, :]] with W [V x dim]
+// and indices [batch x k], i.e. each batch entry b is multiplied with its own subset of the rows of W.
+// The rows for one batch entry are gathered into a scratch buffer and multiplied with a single sgemm
+// for all R rows of A that belong to this batch entry, so the gathered matrices are never stored.
+void gatherAffine(marian::Tensor C, const marian::Tensor A, const marian::Tensor W, const marian::Tensor indices, const marian::Tensor bias);
+
+}  // namespace cpu
+}  // namespace marian
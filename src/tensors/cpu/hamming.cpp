@@ -0,0 +1,217 @@
+#include "tensors/cpu/hamming.h"
+#include "3rd_party/threadpool.h"
+#include "common/logging.h"
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__AVX512VPOPCNTDQ__)
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace marian {
+namespace cpu {
+
+namespace {
+
+inline uint32_t popcount64(uint64_t x) {
+#if defined(__GNUC__)
+  return (uint32_t)__builtin_popcountll(x);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  return (uint32_t)__popcnt64(x);
+#else
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (uint32_t)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Hamming distance of the bytes [from, bytes) of a and b, 8 bytes at a time
+inline uint32_t hammingTail(const uint8_t* a, const uint8_t* b, size_t from, size_t bytes) {
+  uint32_t dist = 0;
+  size_t i = from;
+  for(; i + 8 <= bytes; i += 8) {
+    uint64_t x, y;
+    std::memcpy(&x, a + i, 8);
+    std::memcpy(&y, b + i, 8);
+    dist += popcount64(x ^ y);
+  }
+  for(; i < bytes; ++i)
+    dist += popcount64((uint64_t)(a[i] ^ b[i]));
+  return dist;
+}
+
+#if defined(__AVX512VPOPCNTDQ__)
+
+inline uint32_t hamming(const uint8_t* a, const uint8_t* b, size_t bytes) {
+  __m512i acc = _mm512_setzero_si512();
+  size_t i = 0;
+  for(; i + 64 <= bytes; i += 64) {
+    __m512i x = _mm512_xor_si512(_mm512_loadu_si512((const void*)(a + i)), _mm512_loadu_si512((const void*)(b + i)));
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+  }
+  return (uint32_t)_mm512_reduce_add_epi64(acc) + hammingTail(a, b, i, bytes);
+}
+
+#elif defined(__AVX2__)
+
+// Per-byte popcount with a 4-bit lookup table, summed into four 64-bit lanes with vpsadbw
+inline __m256i popcount256(__m256i x) {
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                       0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i lowMask = _mm256_set1_epi8(0x0f);
+  __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(x, lowMask));
+  __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowMask));
+  return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+inline uint32_t hamming(const uint8_t* a, const uint8_t* b, size_t bytes) {
+  __m256i acc = _mm256_setzero_si256();
+  size_t i = 0;
+  for(; i + 32 <= bytes; i += 32) {
+    __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+    acc = _mm256_add_epi64(acc, popcount256(x));
+  }
+  __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+  return (uint32_t)_mm_cvtsi128_si64(sum) + hammingTail(a, b, i, bytes);
+}
+
+#else
+
+inline uint32_t hamming(const uint8_t* a, const uint8_t* b, size_t bytes) {
+  return hammingTail(a, b, 0, bytes);
+}
+
+#endif
+
+// Number of query rows that are compared to a code of the index while it is in L1. Each index code is read
+// once per tile instead of once per query, which otherwise makes the search bound by memory bandwidth.
+const size_t queryTile = 16;
+
+// Bytes is the code length if known at compile time (fully unrolled distance loop) or 0
+template <size_t Bytes>
+void hammingTopKRows(uint32_t* out,
+                     const uint8_t* qCodes,
+                     size_t qBegin,
+                     size_t qEnd,
+                     const uint8_t* wCodes,
+                     size_t wRows,
+                     size_t bytesPerVector,
+                     size_t k) {
+  const size_t bytes = Bytes ? Bytes : bytesPerVector;
+  const size_t bins = 8 * bytes + 1;
+  std::vector<uint16_t> distances(queryTile * wRows);
+  // four interleaved histograms per row, so that consecutive increments of the same bin do not wait for each other
+  std::vector<uint32_t> histograms(4 * bins);
+
+  for(size_t tileBegin = qBegin; tileBegin < qEnd; tileBegin += queryTile) {
+    const size_t rows = std::min(queryTile, qEnd - tileBegin);
+    const uint8_t* queries = qCodes + tileBegin * bytes;
+
+    for(size_t w = 0; w < wRows; ++w) {
+      const uint8_t* code = wCodes + w * bytes;
+      for(size_t q = 0; q < rows; ++q)
+        distances[q * wRows + w] = (uint16_t)hamming(queries + q * bytes, code, bytes);
+    }
+
+    for(size_t q = 0; q < rows; ++q) {
+      const uint16_t* rowDistances = distances.data() + q * wRows;
+
+      std::fill(histograms.begin(), histograms.end(), 0);
+      uint32_t* histogram = histograms.data();
+      size_t w = 0;
+      for(; w + 4 <= wRows; w += 4) {
+        histogram[rowDistances[w]]++;
+        histogram[bins + rowDistances[w + 1]]++;
+        histogram[2 * bins + rowDistances[w + 2]]++;
+        histogram[3 * bins + rowDistances[w + 3]]++;
+      }
+      for(; w < wRows; ++w)
+        histogram[rowDistances[w]]++;
+      for(size_t i = 0; i < bins; ++i)
+        histogram[i] += histogram[bins + i] + histogram[2 * bins + i] + histogram[3 * bins + i];
+
+      // all rows closer than threshold are among the k best, the remaining slots go to rows at exactly threshold
+      uint32_t threshold = 0;
+      size_t closer = 0;
+      while(closer + histogram[threshold] < k)
+        closer += histogram[threshold++];
+      size_t atThreshold = k - closer;
+
+      uint32_t* rowOut = out + (tileBegin + q) * k;
+      for(w = 0; w < wRows; ++w) {
+        uint32_t dist = rowDistances[w];
+        if(dist < threshold) {
+          *rowOut++ = (uint32_t)w;
+        } else if(dist == threshold && atThreshold > 0) {
+          *rowOut++ = (uint32_t)w;
+          atThreshold--;
+        }
+      }
+    }
+  }
+}
+
+void hammingTopKRows(uint32_t* out,
+                     const uint8_t* qCodes,
+                     size_t qBegin,
+                     size_t qEnd,
+                     const uint8_t* wCodes,
+                     size_t wRows,
+                     size_t bytesPerVector,
+                     size_t k) {
+  // common code lengths of 256 to 2048 bits
+  switch(bytesPerVector) {
+    case 32:  hammingTopKRows<32>(out, qCodes, qBegin, qEnd, wCodes, wRows, bytesPerVector, k); break;
+    case 64:  hammingTopKRows<64>(out, qCodes, qBegin, qEnd, wCodes, wRows, bytesPerVector, k); break;
+    case 128: hammingTopKRows<128>(out, qCodes, qBegin, qEnd, wCodes, wRows, bytesPerVector, k); break;
+    case 256: hammingTopKRows<256>(out, qCodes, qBegin, qEnd, wCodes, wRows, bytesPerVector, k); break;
+    default:  hammingTopKRows<0>(out, qCodes, qBegin, qEnd, wCodes, wRows, bytesPerVector, k); break;
+  }
+}
+
+}  // namespace
+
+void hammingTopK(uint32_t* out,
+                 const uint8_t* qCodes,
+                 size_t qRows,
+                 const uint8_t* wCodes,
+                 size_t wRows,
+                 size_t bytesPerVector,
+                 size_t k,
+                 ThreadPool* pool) {
+  ABORT_IF(k > wRows, "Cannot return {} nearest neighbours out of {} vectors", k, wRows);
+  ABORT_IF(8 * bytesPerVector > UINT16_MAX, "Hamming search supports codes of at most {} bits", UINT16_MAX);
+
+  size_t threads = pool ? pool->getNumThreads() + 1 : 1;
+  if(threads > qRows)
+    threads = qRows;
+  if(threads <= 1) {
+    hammingTopKRows(out, qCodes, 0, qRows, wCodes, wRows, bytesPerVector, k);
+    return;
+  }
+
+  // the calling thread searches the first slice of query rows itself
+  size_t rowsPerThread = (qRows + threads - 1) / threads;
+  std::vector<std::future<void>> slices;
+  for(size_t begin = rowsPerThread; begin < qRows; begin += rowsPerThread) {
+    size_t end = std::min(begin + rowsPerThread, qRows);
+    slices.emplace_back(pool->enqueue([=]() {
+      hammingTopKRows(out, qCodes, begin, end, wCodes, wRows, bytesPerVector, k);
+    }));
+  }
+  hammingTopKRows(out, qCodes, 0, rowsPerThread, wCodes, wRows, bytesPerVector, k);
+  for(auto& slice : slices)
+    slice.get();
+}
+
+}  // namespace cpu
+}  // namespace marian
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace marian {
+
+class ThreadPool;
+
+namespace cpu {
+
+// Exact k-nearest-neighbour search in Hamming space. For each of the qRows bit vectors in qCodes,
+// writes the indices of the k bit vectors among the first wRows in wCodes with the smallest Hamming
+// distance to out[row * k, (row + 1) * k), in increasing order of index. Ties are broken towards the
+// smaller index. All vectors are bytesPerVector bytes long.
+//
+// The top-k selection is fused with the distance computation: distances are integers in [0, 8 * bytesPerVector],
+// so a histogram of the distances of a query gives the largest distance that is still among the k best, and
+// one more pass over the distances, while they are still in cache, collects the indices in order without a
+// heap or sort. Distances use AVX-512 VPOPCNTDQ or AVX2 if the compiler targets them, scalar popcount otherwise.
+// If pool is given, query rows are split between the calling thread and the pool.
+void hammingTopK(uint32_t* out,
+                 const uint8_t* qCodes,
+                 size_t qRows,
+                 const uint8_t* wCodes,
+                 size_t wRows,
+                 size_t bytesPerVector,
+                 size_t k,
+                 ThreadPool* pool = nullptr);
+
+}  // namespace cpu
+}  // namespace marian
@@ -0,0 +1,115 @@
+#include "tensors/cpu/int4_gemm.h"
+#include "tensors/cpu/prod_blas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace marian {
+namespace cpu {
+namespace int4 {
+
+size_t requiredBytes(const Shape& shape) {
+  size_t elements = shape.elements();
+  return (elements + 1) / 2 + (elements / GROUP_SIZE) * sizeof(float);
+}
+
+float quantize(const float* in, int N, int K, char* out) {
+  ABORT_IF(!canQuantize(K, N), "Inner dimension {} is not a multiple of the int4 group size {}", K, GROUP_SIZE);
+  uint8_t* packed = (uint8_t*)out;
+  float* scales = (float*)(out + (size_t)N * K / 2);
+  int groups = K / GROUP_SIZE;
+
+  double sumSqErr = 0, sumSq = 0;
+  for(int n = 0; n < N; ++n) {
+    for(int g = 0; g < groups; ++g) {
+      const float* w = in + (size_t)n * K + g * GROUP_SIZE;
+      float maxAbs = 0.f;
+      for(int k = 0; k < GROUP_SIZE; ++k)
+        maxAbs = std::max(maxAbs, std::abs(w[k]));
+      float scale = maxAbs > 0.f ? maxAbs / 7.f : 1.f;
+      scales[(size_t)n * groups + g] = scale;
+
+      uint8_t* q = packed + ((size_t)n * K + g * GROUP_SIZE) / 2;
+      for(int k = 0; k < GROUP_SIZE; k += 2) {
+        int q0 = std::min(7, std::max(-8, (int)std::lround(w[k] / scale)));
+        int q1 = std::min(7, std::max(-8, (int)std::lround(w[k + 1] / scale)));
+        q[k / 2] = (uint8_t)((q0 + 8) | ((q1 + 8) << 4));
+        sumSqErr += (w[k] - q0 * scale) * (w[k] - q0 * scale) + (w[k + 1] - q1 * scale) * (w[k + 1] - q1 * scale);
+        sumSq += w[k] * w[k] + w[k + 1] * w[k + 1];
+      }
+    }
+  }
+  return sumSq > 0 ? (float)(sumSqErr / sumSq) : 0.f;
+}
+
+float quantizationError(const float* in, int N, int K, int bits, int groupSize) {
+  ABORT_IF(K % groupSize != 0, "Inner dimension {} is not a multiple of the group size {}", K, groupSize);
+  int maxQ = (1 << (bits - 1)) - 1;
+  double sumSqErr = 0, sumSq = 0;
+  for(int n = 0; n < N; ++n) {
+    for(int g = 0; g < K / groupSize; ++g) {
+      const float* w = in + (size_t)n * K + g * groupSize;
+      float maxAbs = 0.f;
+      for(int k = 0; k < groupSize; ++k)
+        maxAbs = std::max(maxAbs, std::abs(w[k]));
+      float scale = maxAbs > 0.f ? maxAbs / maxQ : 1.f;
+      for(int k = 0; k < groupSize; ++k) {
+        float q = std::min((float)maxQ, std::max((float)-maxQ - 1, std::round(w[k] / scale))) * scale;
+        sumSqErr += (w[k] - q) * (w[k] - q);
+        sumSq += w[k] * w[k];
+      }
+    }
+  }
+  return sumSq > 0 ? (float)(sumSqErr / sumSq) : 0.f;
+}
+
+void dequantize(const char* in, int N, int K, int n0, int n1, float* out) {
+  const uint8_t* packed = (const uint8_t*)in;
+  const float* scales = (const float*)(in + (size_t)N * K / 2);
+  int groups = K / GROUP_SIZE;
+
+  for(int n = n0; n < n1; ++n) {
+    const uint8_t* q = packed + (size_t)n * K / 2;
+    const float* s = scales + (size_t)n * groups;
+    float* o = out + (size_t)(n - n0) * K;
+    for(int g = 0; g < groups; ++g) {
+      float scale = s[g];
+      for(int k = 0; k < GROUP_SIZE / 2; ++k) {
+        uint8_t b = q[g * GROUP_SIZE / 2 + k];
+        o[g * GROUP_SIZE + 2 * k]     = ((int)(b & 0xF) - 8) * scale;
+        o[g * GROUP_SIZE + 2 * k + 1] = ((int)(b >> 4) - 8) * scale;
+      }
+    }
+  }
+}
+
+void affine(marian::Tensor C, const marian::Tensor A, const marian::Tensor B, const marian::Tensor bias, bool transB, float scale) {
+  // The packed layout is that of a [K x N] weight, a transposed one would be read with K and N swapped
+  ABORT_IF(transB, "Int4 GEMM does not support transposed weights, B has shape {}", B->shape());
+  int K = A->shape()[-1];
+  int M = A->shape().elements() / K;
+  int N = B->shape()[-1];
+  ABORT_IF(K != B->shape()[-2], "Inner dimensions of A {} and int4 B {} do not match", A->shape(), B->shape());
+
+  // Tiles of 64 output columns keep the dequantized part of B in cache while it is used
+  const int tile = 64;
+  std::vector<float> buffer((size_t)tile * K);
+  float* c = C->data();
+  for(int n0 = 0; n0 < N; n0 += tile) {
+    int nb = std::min(tile, N - n0);
+    dequantize(B->data<char>(), N, K, n0, n0 + nb, buffer.data());
+    sgemm(/*transA=*/false, /*transB=*/true, M, nb, K, scale, A->data(), K, buffer.data(), K, 0.f, c + n0, N);
+  }
+
+  if(bias) {
+    const float* b = bias->data();
+    for(int m = 0; m < M; ++m)
+      for(int n = 0; n < N; ++n)
+        c[(size_t)m * N + n] += b[n];
+  }
+}
+
+}  // namespace int4
+}  // namespace cpu
+}  // namespace marian
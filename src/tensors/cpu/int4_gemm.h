@@ -0,0 +1,39 @@
+#pragma once
+
+#include "tensors/tensor.h"
+
+namespace marian {
+namespace cpu {
+namespace int4 {
+
+// Group-wise symmetric 4-bit quantization of weight matrices. A matrix B [K x N] (or [N x K] when
+// used transposed) is stored with the inner (K) dimension contiguous for each of the N output columns:
+// first N * K / 2 bytes with two 4-bit values per byte (low nibble first), followed by N * K / GROUP_SIZE
+// float scales, one for each group of GROUP_SIZE consecutive values along K.
+const static int GROUP_SIZE = 64;
+
+// Bytes required for a Type::int4 tensor with the given shape
+size_t requiredBytes(const Shape& shape);
+
+// Whether a float32 matrix with inner dimension K can be quantized to int4
+static inline bool canQuantize(int K, int N) { return K % GROUP_SIZE == 0 && N > 0; }
+
+// Quantizes in [N x K] (row-major, K contiguous) into out with requiredBytes({K, N}) bytes.
+// Returns the relative squared quantization error sum((w - q(w))^2) / sum(w^2).
+float quantize(const float* in, int N, int K, char* out);
+
+// Relative squared error of symmetric group-wise quantization of in [N x K] with the given number of bits,
+// used to compare int4 and int8 precision per matrix without converting.
+float quantizationError(const float* in, int N, int K, int bits, int groupSize);
+
+// Dequantizes rows [n0, n1) of a quantized [N x K] matrix into out [(n1 - n0) x K]
+void dequantize(const char* in, int N, int K, int n0, int n1, float* out);
+
+// C = scale * A * B + bias with A [M x K] float32 and B [K x N] of Type::int4. B is dequantized in tiles of
+// output columns which are then multiplied with sgemm. marian-conv only quantizes untransposed weights,
+// hence transB has to be false.
+void affine(marian::Tensor C, const marian::Tensor A, const marian::Tensor B, const marian::Tensor bias, bool transB, float scale);
+
+}  // namespace int4
+}  // namespace cpu
+}  // namespace marian
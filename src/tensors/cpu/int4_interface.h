@@ -0,0 +1,41 @@
+#pragma once
+
+#include "graph/expression_operators.h"
+#include "graph/node_operators_unary.h"
+#include "tensors/cpu/int4_gemm.h"
+
+namespace marian {
+namespace cpu {
+namespace int4 {
+
+/*
+ * Affine or dot product with a float32 activation matrix A and a weight matrix B of Type::int4,
+ * as created by marian-conv --gemm-type int4. The weights stay quantized in memory and are
+ * dequantized tile by tile inside of the product, see cpu::int4::affine(...).
+ */
+static inline Expr affineOrDot(Expr a, Expr b, Expr bias, bool transA, bool transB, float scale) {
+  ABORT_IF(!isFloat(a->value_type()), "Int4 GEMM expects type of A to be float32 not {}", a->value_type());
+  ABORT_IF(!isInt4(b->value_type()), "Int4 GEMM expects type of B to be int4 not {}", b->value_type());
+  ABORT_IF(transB, "Int4 GEMM does not support transposed weights, B has shape {}", b->shape());
+
+  if(transA)
+    a = transpose(a);
+
+  Shape outShape = a->shape();
+  outShape.set(-1, b->shape()[-1]);
+
+  auto dotOrAffineNodeOp = [=](Expr out, const std::vector<Expr>& children) {
+    Tensor bias = children.size() > 2 ? children[2]->val() : nullptr;
+    cpu::int4::affine(out->val(), children[0]->val(), children[1]->val(), bias, transB, scale);
+  };
+
+  std::vector<Expr> children = {a, b};
+  if(bias)
+    children.push_back(bias);
+
+  return lambda(children, outShape, Type::float32, dotOrAffineNodeOp); // inference-only Lambda node
+}
+
+}  // namespace int4
+}  // namespace cpu
+}  // namespace marian
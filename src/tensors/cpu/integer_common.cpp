@@ -1,4 +1,14 @@
 #include "integer_common.h"
+#include "common/filesystem.h"
+#include "common/io.h"
+#include "common/utils.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <sstream>
 
 namespace marian {
 namespace cpu {
@@ -37,6 +47,133 @@ void AddBias(marian::Tensor C, const marian::Tensor Bias) {
   }
 }
 
+bool isTransposedB(const std::string& name) {
+  return name.length() >= 3 && name.substr(name.length() - 3) == "_Wt";
+}
+
+bool isIntgemmWeightName(const std::string& name) {
+  // Same naming heuristic as in ExpressionGraphPackable::pack(...)
+  return name.find("_W") == name.length() - 3 || name.find("_W") == name.length() - 2;
+}
+
+bool isQuantizableOnLoad(const io::Item& item) {
+  if(item.type != Type::float32 || item.shape.size() != 2)
+    return false;
+  const auto& name = item.name;
+  if(!isIntgemmWeightName(name))
+    return false;
+  // intgemm requires the inner dimension to be a multiple of 64 and the number of columns of B to be a multiple of 8
+  int inner = isTransposedB(name) ? item.shape[1] : item.shape[0];
+  int outer = isTransposedB(name) ? item.shape[0] : item.shape[1];
+  return inner % 64 == 0 && outer % 8 == 0;
+}
+
+// Quantize and reorder a float32 matrix item into the intgemm format of vtype. This does the same as
+// ExpressionGraphPackable::pack(...) followed by prepareAndTransposeB(...), but in one go.
+template <Type vtype>
+static void prepareItemOnLoad(io::Item& item) {
+  // A transposed matrix [n x k] (output layer "_Wt") is stored as B [k x n] after conversion
+  bool transposedB = isTransposedB(item.name);
+  if(transposedB)
+    item.shape = Shape({cols(item.shape), rows(item.shape)});
+
+  // Pad to 256 bytes like tensor memory, so the item can be memory-mapped after saving
+  size_t bytes = ((requiredBytes(item.shape, vtype) + 255) / 256) * 256;
+  void* output = genericMalloc(512, bytes);
+  std::memset(output, 0, bytes);
+  prepareB<vtype>(reinterpret_cast<const float*>(item.data()), transposedB, rows(item.shape), cols(item.shape), output);
+
+  std::vector<char> newBytes((const char*)output, (const char*)output + bytes);
+  genericFree(output);
+
+  item.bytes.swap(newBytes);
+  item.ptr = nullptr;
+  item.mapped = false;
+  item.type = vtype;
+}
+
+size_t prepareItemsOnLoad(std::vector<io::Item>& items, Type vtype) {
+  Type hardwareType = getIntgemmType(vtype);
+  size_t converted = 0;
+  for(auto& item : items) {
+    if(!isQuantizableOnLoad(item))
+      continue;
+    switch(hardwareType) {
+      case Type::intgemm8ssse3      : prepareItemOnLoad<Type::intgemm8ssse3>(item);      break;
+      case Type::intgemm8avx2       : prepareItemOnLoad<Type::intgemm8avx2>(item);       break;
+      case Type::intgemm8avx512     : prepareItemOnLoad<Type::intgemm8avx512>(item);     break;
+      case Type::intgemm8avx512vnni : prepareItemOnLoad<Type::intgemm8avx512vnni>(item); break;
+      case Type::intgemm16sse2      : prepareItemOnLoad<Type::intgemm16sse2>(item);      break;
+      case Type::intgemm16avx2      : prepareItemOnLoad<Type::intgemm16avx2>(item);      break;
+      case Type::intgemm16avx512    : prepareItemOnLoad<Type::intgemm16avx512>(item);    break;
+      default: ABORT("Unsupported type {} for quantization on load", hardwareType);
+    }
+    converted++;
+  }
+  return converted;
+}
+
+std::vector<io::Item> loadItemsQuantized(const std::string& fileName, Type vtype) {
+  // Several graphs (e.g. one per CPU thread) load the same model concurrently, the first one
+  // creates the cache file and the others read from it.
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+
+  std::stringstream cacheName;
+  cacheName << fileName << "." << getIntgemmType(vtype) << ".bin";
+  std::string cacheFile = cacheName.str();
+  // A retrained model usually has the same size as the one it replaces, hence also the modification time
+  std::string sourceKey = std::to_string(filesystem::fileSize(fileName)) + ","
+                          + std::to_string((long long)filesystem::lastModified(fileName));
+  const std::string sourceVar = "special:int8-on-load.source";
+
+  if(filesystem::exists(cacheFile)) {
+    auto items = io::loadItems(cacheFile);
+    for(const auto& item : items) {
+      if(item.name == sourceVar && std::string(item.data()) == sourceKey) {
+        LOG(info, "Loaded quantized model from cache {}", cacheFile);
+        return items;
+      }
+    }
+    LOG(warn, "Cache {} has not been created from {}, quantizing again", cacheFile, fileName);
+  }
+
+  LOG(info, "Loading model from {}", fileName);
+  auto items = io::loadItems(fileName);
+  size_t converted = prepareItemsOnLoad(items, vtype);
+  LOG(info, "Quantized {} parameters to {}", converted, getIntgemmType(vtype));
+
+  if(converted > 0) {
+    // Write to a temporary file first, so that no other process ever reads a partial cache. The name is unique
+    // per host, process and call, as several processes may quantize the same model into a shared directory at
+    // once. A model directory might be read-only, in that case we just continue without caching.
+    auto hostPid = utils::hostnameAndProcessId();
+    std::string tempFile = cacheFile + ".tmp." + hostPid.first + "." + std::to_string(hostPid.second) + "."
+                           + std::to_string(std::random_device()());
+    FILE* f = fopen(tempFile.c_str(), "wb");
+    if(f == nullptr) {
+      LOG(warn, "Cannot write quantized model cache {}: {}", tempFile, strerror(errno));
+    } else {
+      fclose(f);
+      auto cacheItems = items;
+      io::addMetaToItems(sourceKey, sourceVar, cacheItems);
+      io::saveItems(tempFile, cacheItems);
+      bool renamed = std::rename(tempFile.c_str(), cacheFile.c_str()) == 0;
+      if(!renamed && filesystem::exists(cacheFile)) { // rename() does not replace an outdated cache on Windows
+        std::remove(cacheFile.c_str());
+        renamed = std::rename(tempFile.c_str(), cacheFile.c_str()) == 0;
+      }
+      if(renamed)
+        LOG(info, "Saved quantized model to cache {}", cacheFile);
+      else {
+        LOG(warn, "Cannot rename {} to {}: {}", tempFile, cacheFile, strerror(errno));
+        std::remove(tempFile.c_str());
+      }
+    }
+  }
+  return items;
+}
+
 //template void prepareAndTranspose<intgemm8>;//(io::Item& item, const char * input);
 //template void prepareAndTranspose<intgemm16>(io::Item&, const char *);
 
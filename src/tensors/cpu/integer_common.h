@@ -179,9 +179,61 @@ static inline float computeQuantMult(marian::Tensor val) {
 #endif
 }
 
+// Quantize and reorder a float matrix B [inner x numCols] into the intgemm format of vtype. If transposed is
+// true, the input is B^T [numCols x inner] instead. The output needs to be 64-byte aligned with space for
+// the quantization multiplier, which is stored after the matrix like for all intgemm tensors.
+template <Type vtype>
+void prepareB(const float* input, bool transposed, int inner, int numCols, void* output) {
+#if COMPILE_CPU
+  typedef typename intgemm_<vtype>::type Integer;
+  size_t elements = (size_t)inner * numCols;
+
+  // PrepareBTransposed expects the transposed float matrix in aligned memory
+  float* inputT = reinterpret_cast<float*>(genericMalloc(512, elements * sizeof(float)));
+  if(transposed) {
+    std::copy(input, input + elements, inputT);
+  } else {
+    for(int i = 0; i < inner; ++i)
+      for(int j = 0; j < numCols; ++j)
+        inputT[j * inner + i] = input[i * numCols + j];
+  }
+
+  float quantMult = sizeOf(vtype) == 1 ? 127.0f / intgemm::MaxAbsolute(inputT, inputT + elements) : 1024.0f;
+  intgemm_<vtype>::width::PrepareBTransposed(inputT, reinterpret_cast<Integer*>(output), quantMult, inner, numCols);
+  *reinterpret_cast<float*>(reinterpret_cast<Integer*>(output) + elements) = quantMult;
+
+  genericFree(inputT);
+#else
+  input, transposed, inner, numCols, output;
+  ABORT("Using intgemm binary models is only supported when compiling marian with -DCOMPILE_CPU=ON.");
+#endif
+}
+
 // This operates on floats after processing so doesn't care about int8_t vs int16_t.
 void AddBias(marian::Tensor C, const marian::Tensor Bias);
 
+// Output layer matrices are stored transposed as "_Wt" [n x k]. When converted to intgemm they are
+// stored as a regular intgemm B matrix [k x n] which allows to select columns for the shortlist.
+bool isTransposedB(const std::string& name);
+
+// Naming heuristic ("_W" or "_Wx" suffix) for the weight matrices that marian-conv --gemm-type intgemm* converts.
+// Also used by quantization-aware training (--quantize-intgemm) to pick the same matrices.
+bool isIntgemmWeightName(const std::string& name);
+
+// For quantizing float32 models at load time (--int8-on-load). Checks if the item is a float32 weight
+// matrix that would also be converted by marian-conv --gemm-type intgemm*, i.e. by name ("_W") and shape.
+bool isQuantizableOnLoad(const io::Item& item);
+
+// Quantizes all eligible float32 items in-place into the hardware-specific intgemm format of vtype
+// (Type::intgemm8 or Type::intgemm16) for the current CPU. Returns the number of converted items.
+size_t prepareItemsOnLoad(std::vector<io::Item>& items, Type vtype);
+
+// Loads the model and quantizes it with prepareItemsOnLoad(...). The result is cached as a binary model
+// next to the original file, named <fileName>.<hardware-specific type>.bin, and read from there instead
+// if the cache exists and has been created from a model file of the same size and modification time.
+// Otherwise the model is quantized again and the cache is replaced.
+std::vector<io::Item> loadItemsQuantized(const std::string& fileName, Type vtype);
+
 // For loading architecture agnostic models. We do PrepareAndTranpose, because we already transposed
 // in our binary format. Then we copy the quantizationMultiplier information at the end
 template<Type vtype>
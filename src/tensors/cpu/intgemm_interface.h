@@ -13,6 +13,10 @@ namespace integer {
 /*
  * Prepare an activation matrix into intgemm8/16 format. For now the activation matrix is just quantized.
  * Expr input: The input tensor
+ *
+ * The node is identified by a fixed hash per vtype, so the graph memoizes it like any other operation:
+ * affines that consume the same input with the same intgemm type (e.g. Q, K and V projections of
+ * self-attention) share a single quantized copy of the input instead of quantizing it once per affine.
  */
 template<Type vtype>
 static inline Expr prepareA(Expr a) {
@@ -28,9 +32,114 @@ static inline Expr prepareA(Expr a) {
     getQuantMult<vtype>(out->val()) = quantMult;
   };
 
-  return lambda({a}, a->shape(), vtype, nodeOp);
+  static const size_t prepareAHash = std::hash<std::string>()("intgemm::prepareA") + (size_t)vtype;
+  return lambda({a}, a->shape(), vtype, nodeOp, prepareAHash);
 }
+
+/*
+ * Prepare a float parameter matrix into intgemm8/16 format on the fly, e.g. for auto-tuning float32 models.
+ * Expr b: The parameter matrix [k x n], or [n x k] if transB
+ * The node only depends on a parameter, so it gets memoized and is only computed once per graph.
+ */
+template<Type vtype>
+static inline Expr prepareBTyped(Expr b, bool transB) {
+  auto nodeOp = [transB](Expr out, const std::vector<Expr>& children) {
+    Expr in = children[0];
+    prepareB<vtype>(in->val()->data(), transB, rows(out->val()), cols(out->val()), out->val()->data<char>());
+  };
+
+  Shape outShape = b->shape();
+  if(transB) {
+    outShape.set(-1, b->shape()[-2]);
+    outShape.set(-2, b->shape()[-1]);
+  }
+  static const size_t prepareBHash = std::hash<std::string>()("intgemm::prepareB") + (size_t)vtype;
+  return lambda({b}, outShape, vtype, nodeOp, prepareBHash + (size_t)transB);
+}
+
+/*
+ * Select columns from a prepared intgemm B matrix, e.g. the output layer with a shortlist. This is a gather
+ * on the packed memory, no re-quantization is required and the quantization multiplier is kept.
+ * Expr b: The parameter matrix in intgemm format [k x n]
+ * Expr indices: The column indices, the number of indices needs to be a multiple of 8
+ */
+template<Type vtype>
+static inline Expr selectColumnsBTyped(Expr b, Expr indices) {
+  auto nodeOp = [](Expr out, const std::vector<Expr>& children) {
+    Expr in      = children[0];
+    Expr indices = children[1];
+    typedef typename intgemm_<vtype>::type Integer;
+    const IndexType* colsBegin = indices->val()->data<IndexType>();
+    const IndexType* colsEnd   = colsBegin + indices->shape().elements();
+    intgemm_<vtype>::width::SelectColumnsB(in->val()->data<Integer>(), /*input*/
+                                           out->val()->data<Integer>(), /*output*/
+                                           rows(in->val()),
+                                           colsBegin,
+                                           colsEnd);
+    getQuantMult<vtype>(out->val()) = getQuantMult<vtype>(in->val());
+  };
+
+  int numCols = indices->shape().elements();
+  ABORT_IF(numCols % 8 != 0, "Number of selected columns ({}) of an intgemm matrix needs to be a multiple of 8", numCols);
+  Shape outShape = b->shape();
+  outShape.set(-1, numCols);
+  return lambda({b, indices}, outShape, vtype, nodeOp);
+}
+#endif
+
+// Dispatch on-the-fly preparation of B for the given hardware-specific intgemm type, see prepareBTyped(...)
+static inline Expr prepareB(Expr b, bool transB, Type vtype) {
+#if COMPILE_CPU
+  switch(vtype) {
+    case Type::intgemm8ssse3 :
+      return cpu::integer::prepareBTyped<Type::intgemm8ssse3>(b, transB);
+    case Type::intgemm8avx2 :
+      return cpu::integer::prepareBTyped<Type::intgemm8avx2>(b, transB);
+    case Type::intgemm8avx512 :
+      return cpu::integer::prepareBTyped<Type::intgemm8avx512>(b, transB);
+    case Type::intgemm8avx512vnni :
+      return cpu::integer::prepareBTyped<Type::intgemm8avx512vnni>(b, transB);
+    case Type::intgemm16sse2 :
+      return cpu::integer::prepareBTyped<Type::intgemm16sse2>(b, transB);
+    case Type::intgemm16avx2 :
+      return cpu::integer::prepareBTyped<Type::intgemm16avx2>(b, transB);
+    case Type::intgemm16avx512 :
+      return cpu::integer::prepareBTyped<Type::intgemm16avx512>(b, transB);
+    default:
+      ABORT("Unsupported type {} for Intgemm type??", vtype);
+  }
+#else
+  b, transB, vtype;
+  ABORT("You need to enable CPU compilation to use this feature. Use cmake .. -DCOMPILE_CPU=ON");
+#endif
+}
+
+// Dispatch column selection for hardware-specific intgemm types, see selectColumnsBTyped(...)
+static inline Expr selectColumnsB(Expr b, Expr indices) {
+#if COMPILE_CPU
+  switch(b->value_type()) {
+    case Type::intgemm8ssse3 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm8ssse3>(b, indices);
+    case Type::intgemm8avx2 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm8avx2>(b, indices);
+    case Type::intgemm8avx512 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm8avx512>(b, indices);
+    case Type::intgemm8avx512vnni :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm8avx512vnni>(b, indices);
+    case Type::intgemm16sse2 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm16sse2>(b, indices);
+    case Type::intgemm16avx2 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm16avx2>(b, indices);
+    case Type::intgemm16avx512 :
+      return cpu::integer::selectColumnsBTyped<Type::intgemm16avx512>(b, indices);
+    default:
+      ABORT("Unsupported type {} for Intgemm type??", b->value_type());
+  }
+#else
+  b, indices;
+  ABORT("You need to enable CPU compilation to use this feature. Use cmake .. -DCOMPILE_CPU=ON");
 #endif
+}
 
 /*	
  * This computes A*B (+ bias if available) in intgemm.	
@@ -16,6 +16,14 @@
 #include <mkl.h>
 #endif
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
 namespace marian {
 
 namespace cpu {
@@ -567,6 +575,25 @@ void LogSoftmaxGrad(Tensor grad_, Tensor adj_, Tensor val_) {
   }
 }
 
+// Hint the CPU to load the cache lines of [ptr, ptr + bytes) ahead of their use.
+static inline void prefetchRange(const void* ptr, size_t bytes) {
+#if defined(__GNUC__)
+  for(size_t i = 0; i < bytes; i += 64)
+    __builtin_prefetch((const char*)ptr + i, /*rw=*/0, /*locality=*/3);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  for(size_t i = 0; i < bytes; i += 64)
+    _mm_prefetch((const char*)ptr + i, _MM_HINT_T0);
+#else
+  (void)ptr; (void)bytes; // no prefetch
+#endif
+}
+
+// Gather rows, e.g. the embeddings of a batch. For large vocabularies the matrix is far larger
+// than the caches, so the gather is dominated by memory latency. Hence the rows are gathered in
+// the order of their source index: each distinct row is read from the matrix only once (padding
+// and frequent tokens repeat a lot within a batch) and its duplicates are copied from the output,
+// which is still in the cache, reads move through memory in one direction, and the next distinct
+// row is prefetched while the current one is copied.
 void CopyRows(Tensor out_,
               const Tensor in_,
               const Tensor indices) {
@@ -579,19 +606,40 @@ void CopyRows(Tensor out_,
   // note: may also be applied to IndexType; works by luck. Fix with fp16
   float* out = out_->data();
   const float* in = in_->data();
+  const IndexType* idx = indices->data<IndexType>();
 
-#pragma omp parallel for
-  for(size_t j = 0; j < rows; ++j) {
-    size_t dst = j;
+  // few rows, or rows already in source order (e.g. shortlists): copy in place, sorting would not pay off
+  if(rows < 32 || std::is_sorted(idx, idx + rows)) {
+    for(size_t j = 0; j < rows; ++j) {
+      if(j + 1 < rows)
+        prefetchRange(in + (size_t)idx[j + 1] * cols, cols * sizeof(float));
+      const float* rowIn = in + (size_t)idx[j] * cols;
+      std::copy(rowIn, rowIn + cols, out + j * cols);
+    }
+    return;
+  }
 
-    // @TODO: consider moving type checking to this function
-    // instead of matchOrAbort above
-    size_t src = (size_t)indices->data<IndexType>()[j];
+  std::vector<IndexType> order(rows); // output rows in order of their source rows
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [idx](IndexType a, IndexType b) { return idx[a] < idx[b]; });
 
-    float* rowOut = out + dst * cols;
-    const float* rowIn = in + src * cols;
+  for(size_t k = 0; k < rows;) {
+    size_t src = (size_t)idx[order[k]];
+
+    // order[k, end) are the output rows of this source row, order[end] has the next source row
+    size_t end = k + 1;
+    while(end < rows && idx[order[end]] == src)
+      ++end;
+    if(end < rows)
+      prefetchRange(in + (size_t)idx[order[end]] * cols, cols * sizeof(float));
 
+    const float* rowIn = in + src * cols;
+    float* rowOut = out + (size_t)order[k] * cols;
     std::copy(rowIn, rowIn + cols, rowOut);
+    for(size_t j = k + 1; j < end; ++j)
+      std::copy(rowOut, rowOut + cols, out + (size_t)order[j] * cols);
+
+    k = end;
   }
 }
 
@@ -34,6 +34,11 @@ public:
     allocator_->throwAtReallocation(throwRealloc);
   }
 
+  // Select the memory management of the underlying allocator, frees all allocations
+  void setAllocationStrategy(AllocationStrategy strategy) {
+    allocator_->setStrategy(strategy);
+  }
+
   void reserve(size_t bytes = 0) {
     auto mult = bytes / GROW + 1;
     LOG(info,
@@ -69,6 +74,18 @@ public:
 
   void clear() { allocator_->clear(); }
 
+  // Replace the memory by a new allocation of exactly `bytes`, which unlike reserve() may also
+  // shrink it. Frees all allocations and resets the statistics, keeps the allocation strategy and
+  // whether to throw at reallocation.
+  void resize(size_t bytes) {
+    auto strategy = allocator_->getStrategy();
+    bool throwRealloc = allocator_->throwsAtReallocation();
+    allocator_ = New<Allocator>(backend_->getDeviceId(), 0, GROW, ALIGN);
+    allocator_->setStrategy(strategy);
+    allocator_->throwAtReallocation(throwRealloc);
+    reserveExact(bytes);
+  }
+
   size_t capacity(Shape shape, Type type = Type::float32) {
     return allocator_->capacity<char>(requiredBytes(shape, type));
   }
@@ -0,0 +1,177 @@
+#include "marian.h"
+#include "common/timer.h"
+#include "layers/lsh.h"
+#include "layers/hnsw.h"
+#include "tensors/cpu/integer_common.h"
+#include "3rd_party/threadpool.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+// Benchmark for the approximate output layers, LSH (--output-approx-knn) and HNSW (--output-hnsw): latency
+// of the search compared with the exact float32 and intgemm8 output layers over the full vocabulary, and how
+// many of the exact best words per hypothesis are among the k candidates returned by the search (recall).
+int main(int /*argc*/, char** /*argv*/) {
+  using namespace marian;
+
+  createLoggers();
+
+  const int dimModel = 512;
+  const int numHypos = 64; // e.g. beam size 8 x batch size 8
+  const int k = 100;
+  const int iterations = 20;
+
+  std::mt19937 gen(1234);
+  std::normal_distribution<float> dist(0.f, 1.f);
+
+  for(int dimVocab : {32000, 64000, 128000}) {
+    io::Item item;
+    item.name = "out_W";
+    item.shape = Shape({dimModel, dimVocab});
+    item.type = Type::float32;
+    item.bytes.resize(item.shape.elements() * sizeof(float));
+    float* data = (float*)item.bytes.data();
+    for(int i = 0; i < item.shape.elements(); ++i)
+      data[i] = dist(gen);
+
+    auto g = New<ExpressionGraph>(true);
+    g->setDevice({0, DeviceType::cpu});
+    g->reserveWorkspaceMB(512);
+
+    // float32 model stores the output layer transposed [vocab x dim]
+    std::vector<float> transposed(item.shape.elements());
+    for(int i = 0; i < dimModel; ++i)
+      for(int j = 0; j < dimVocab; ++j)
+        transposed[j * dimModel + i] = data[i * dimVocab + j];
+    auto Wt = g->param("out_Wt", {dimVocab, dimModel}, inits::fromVector(transposed));
+    auto b  = g->param("out_b", {1, dimVocab}, inits::zeros());
+
+    std::vector<io::Item> items = {item};
+    cpu::integer::prepareItemsOnLoad(items, Type::intgemm8);
+    auto Wq = g->param(items[0].name, items[0].shape, inits::fromItem(items[0]), items[0].type);
+    g->forward();
+
+    std::vector<float> hypos(numHypos * dimModel);
+    for(auto& h : hypos)
+      h = dist(gen);
+
+    // exact output layers, the float32 one also gives the reference for the recall
+    std::vector<float> logits;
+    for(bool int8 : {false, true}) {
+      timer::Timer timer;
+      for(int i = 0; i < iterations; ++i) {
+        g->clear();
+        auto input = g->constant({numHypos, dimModel}, inits::fromVector(hypos));
+        auto out = int8 ? affine(input, Wq, b) : affine(input, Wt, b, false, /*transB=*/true);
+        g->forward();
+        if(!int8 && i == 0)
+          out->val()->get(logits);
+      }
+      std::cout << "vocab " << dimVocab << ", exact " << (int8 ? "intgemm8" : "float32") << ": "
+                << timer.elapsed<std::chrono::milliseconds>() / iterations << " ms" << std::endl;
+    }
+
+    std::vector<std::vector<WordIndex>> best(numHypos);
+    for(int h = 0; h < numHypos; ++h) {
+      std::vector<WordIndex> order(dimVocab);
+      std::iota(order.begin(), order.end(), 0);
+      const float* row = logits.data() + (size_t)h * dimVocab;
+      std::partial_sort(order.begin(), order.begin() + 10, order.end(),
+                        [row](WordIndex a, WordIndex b) { return row[a] > row[b]; });
+      best[h].assign(order.begin(), order.begin() + 10);
+    }
+
+    auto recall = [&](const std::vector<IndexType>& indices) {
+      size_t found1 = 0, found10 = 0;
+      for(int h = 0; h < numHypos; ++h) {
+        auto begin = indices.begin() + (size_t)h * k;
+        for(int i = 0; i < 10; ++i) {
+          bool found = std::binary_search(begin, begin + k, best[h][i]);
+          found10 += found;
+          if(i == 0)
+            found1 += found;
+        }
+      }
+      return "recall of best 1 and 10 in " + std::to_string(k) + " candidates: "
+             + std::to_string((float)found1 / numHypos) + " " + std::to_string((float)found10 / (10 * numHypos));
+    };
+
+#if BLAS_FOUND
+    std::vector<int> nBitsList = {256, 512, 1024, 2048};
+#else
+    std::vector<int> nBitsList = {dimModel}; // other lengths need a rotation matrix
+#endif
+    for(int nBits : nBitsList) {
+      // the encoded output layer and rotation are memoized per graph and do not depend on the number of bits
+      // in a way the graph can see, hence a new graph for every length
+      auto gl = New<ExpressionGraph>(true);
+      gl->setDevice({0, DeviceType::cpu});
+      gl->reserveWorkspaceMB(512);
+      auto Wl = gl->param("out_Wt", {dimVocab, dimModel}, inits::fromVector(transposed));
+      gl->forward();
+
+      for(size_t threads : {1, 4}) {
+        auto pool = threads > 1 ? New<ThreadPool>(threads - 1) : nullptr;
+
+        std::vector<IndexType> indices;
+        auto search = [&]() {
+          gl->clear();
+          auto input = gl->constant({1, 1, numHypos, dimModel}, inits::fromVector(hypos));
+          auto out = lsh::search(input, Wl, k, nBits, /*firstNRows=*/0, /*abortIfDynamic=*/false, pool.get());
+          gl->forward();
+          return out;
+        };
+        search()->val()->get(indices); // encodes the output layer once, it is memoized afterwards
+
+        timer::Timer timer;
+        for(int i = 0; i < iterations; ++i)
+          search();
+        double ms = timer.elapsed<std::chrono::milliseconds>() / iterations;
+
+        std::cout << "vocab " << dimVocab << ", lsh " << nBits << " bits, " << threads << " thread(s): " << ms << " ms, "
+                  << recall(indices) << std::endl;
+      }
+    }
+
+    {
+      auto gh = New<ExpressionGraph>(true);
+      gh->setDevice({0, DeviceType::cpu});
+      gh->reserveWorkspaceMB(512);
+      auto Wh = gh->param("out_Wt", {dimVocab, dimModel}, inits::fromVector(transposed));
+      gh->forward();
+
+      timer::Timer buildTimer;
+      gh->clear();
+      hnsw::index(Wh, /*M=*/16, /*efConstruction=*/100); // the same index the search builds ad-hoc, memoized afterwards
+      gh->forward();
+      std::cout << "vocab " << dimVocab << ", hnsw build: " << buildTimer.elapsed<std::chrono::milliseconds>() << " ms" << std::endl;
+
+      for(int ef : {100, 200, 400}) {
+        for(size_t threads : {1, 4}) {
+          auto pool = threads > 1 ? New<ThreadPool>(threads - 1) : nullptr;
+
+          std::vector<IndexType> indices;
+          auto search = [&]() {
+            gh->clear();
+            auto input = gh->constant({1, 1, numHypos, dimModel}, inits::fromVector(hypos));
+            auto out = hnsw::search(input, Wh, k, ef, /*firstNRows=*/0, /*abortIfDynamic=*/false, pool.get());
+            gh->forward();
+            return out;
+          };
+          search()->val()->get(indices);
+
+          timer::Timer timer;
+          for(int i = 0; i < iterations; ++i)
+            search();
+          double ms = timer.elapsed<std::chrono::milliseconds>() / iterations;
+
+          std::cout << "vocab " << dimVocab << ", hnsw ef " << ef << ", " << threads << " thread(s): " << ms << " ms, "
+                    << recall(indices) << std::endl;
+        }
+      }
+    }
+  }
+
+  return 0;
+}
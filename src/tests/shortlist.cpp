@@ -0,0 +1,74 @@
+#include "marian.h"
+#include "common/timer.h"
+#include "data/shortlist.h"
+#include "tensors/cpu/integer_common.h"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+// Benchmark for the output layer with a shortlist: float32 output matrix with row gather versus intgemm8
+// output matrix with column selection on the packed memory.
+int main(int /*argc*/, char** /*argv*/) {
+  using namespace marian;
+
+  createLoggers();
+
+  const int dimModel = 512;
+  const int dimVocab = 32000;
+  const int numHypos = 64; // e.g. beam size 8 x batch size 8
+  const int iterations = 100;
+
+  std::mt19937 gen(1234);
+  std::uniform_real_distribution<float> dist(-0.1f, 0.1f);
+
+  io::Item item;
+  item.name = "out_W";
+  item.shape = Shape({dimModel, dimVocab});
+  item.type = Type::float32;
+  item.bytes.resize(item.shape.elements() * sizeof(float));
+  float* data = (float*)item.bytes.data();
+  for(int i = 0; i < item.shape.elements(); ++i)
+    data[i] = dist(gen);
+
+  auto g = New<ExpressionGraph>(true);
+  g->setDevice({0, DeviceType::cpu});
+  g->reserveWorkspaceMB(512);
+
+  // float32 model stores the output layer transposed [vocab x dim]
+  std::vector<float> transposed(item.shape.elements());
+  for(int i = 0; i < dimModel; ++i)
+    for(int j = 0; j < dimVocab; ++j)
+      transposed[j * dimModel + i] = data[i * dimVocab + j];
+  auto Wt = g->param("out_Wt", {dimVocab, dimModel}, inits::fromVector(transposed));
+  auto b  = g->param("out_b", {1, dimVocab}, inits::zeros());
+
+  std::vector<io::Item> items = {item};
+  cpu::integer::prepareItemsOnLoad(items, Type::intgemm8);
+  auto Wq = g->param(items[0].name, items[0].shape, inits::fromItem(items[0]), items[0].type);
+  g->forward();
+
+  for(int k : {500, 1000, 2000, 3000, 4000, 5000}) {
+    std::vector<WordIndex> all(dimVocab);
+    std::iota(all.begin(), all.end(), 0);
+    std::shuffle(all.begin(), all.end(), gen);
+    std::vector<WordIndex> indices(all.begin(), all.begin() + k);
+    std::sort(indices.begin(), indices.end());
+
+    for(bool int8 : {false, true}) {
+      timer::Timer timer;
+      for(int i = 0; i < iterations; ++i) {
+        g->clear();
+        auto input = g->constant({numHypos, dimModel}, inits::glorotUniform());
+        auto shortlist = New<data::Shortlist>(indices);
+        shortlist->filter(input, int8 ? Wq : Wt, /*isLegacyUntransposedW=*/int8, b, nullptr);
+        auto logits = affine(input, shortlist->getCachedShortWt(), shortlist->getCachedShortb(), false, /*transB=*/!int8);
+        g->forward();
+      }
+      std::cout << "shortlist " << k << " " << (int8 ? "intgemm8" : "float32") << ": "
+                << timer.elapsed<std::chrono::milliseconds>() / iterations << " ms" << std::endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,62 @@
+#include "marian.h"
+#include "common/timer.h"
+#include "models/transformer_options.h"
+
+// Benchmark for the transformer options snapshot: time of the option lookups the decoder layers of a
+// 6-layer model did in every decoding step, compared with reading them from a TransformerOptions.
+int main(int /*argc*/, char** /*argv*/) {
+  using namespace marian;
+
+  auto options = New<Options>(YAML::Load("{"
+      "transformer-heads: 8,"
+      "transformer-no-projection: false,"
+      "transformer-preprocess: '',"
+      "transformer-postprocess: dan,"
+      "transformer-postprocess-emb: d,"
+      "transformer-ffn-activation: relu,"
+      "transformer-dim-ffn: 2048,"
+      "transformer-ffn-depth: 2,"
+      "transformer-decoder-autoreg: self-attention,"
+      "enc-depth: 6,"
+      "dec-depth: 6,"
+      "transformer-tied-layers: []"
+      "}"));
+
+  const int steps = 1000;
+  size_t sink = 0;
+
+  timer::Timer lookupTimer;
+  for(int step = 0; step < steps; ++step) {
+    for(int layer = 0; layer < options->get<int>("dec-depth"); ++layer) {
+      sink += options->get<std::string>("transformer-decoder-autoreg", "self-attention").size();
+      sink += options->get<std::string>("transformer-preprocess").size();
+      sink += options->get<std::string>("transformer-postprocess").size() * 3;
+      sink += options->get<int>("transformer-heads") * 2;
+      sink += options->get<bool>("transformer-no-projection") ? 1 : 2;
+      sink += options->get<std::string>("transformer-ffn-activation").size();
+      sink += options->get<int>("transformer-dim-ffn") + options->get<int>("transformer-ffn-depth");
+      sink += options->get<std::vector<size_t>>("transformer-tied-layers", {}).size();
+    }
+  }
+  double lookupTime = lookupTimer.elapsed();
+
+  TransformerOptions cfg(options, /*inference=*/true); // taken once per model
+  timer::Timer snapshotTimer;
+  for(int step = 0; step < steps; ++step) {
+    for(int layer = 0; layer < cfg.decDepth; ++layer) {
+      sink += cfg.decoderAutoreg.size();
+      sink += cfg.preprocess.size();
+      sink += cfg.postprocess.size() * 3;
+      sink += cfg.heads * 2;
+      sink += cfg.noProjection ? 1 : 2;
+      sink += cfg.ffnActivation.size();
+      sink += cfg.dimFfn + cfg.ffnDepth;
+      sink += cfg.tiedLayers.size();
+    }
+  }
+  double snapshotTime = snapshotTimer.elapsed();
+
+  std::cout << steps << " decoding steps, option lookups: " << lookupTime << "s, snapshot: " << snapshotTime
+            << "s (" << sink << ")" << std::endl;
+  return 0;
+}
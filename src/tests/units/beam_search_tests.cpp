@@ -0,0 +1,86 @@
+#include "catch.hpp"
+#include "data/factored_vocab.h"
+#include "graph/expression_graph.h"
+#include "graph/expression_operators.h"
+#include "layers/logits.h"
+#include "layers/loss.h"
+#include "translator/beam_search.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+
+using namespace marian;
+
+TEST_CASE("Lazy factor scoring selects the same N-best list as the full lemma scores (cpu)", "[beam_search]") {
+  std::string path = "beam_search_tests.tmp.fsv";
+  {
+    std::ofstream out(path);
+    out << "_lemma\n"
+           "_c\n"
+           "_has_c\n"
+           "_lemma <->\n"
+           "_c <-> _has_c\n"
+           "ca : _c\n"
+           "ci : _c\n"
+           "</s> : _lemma\n"
+           "<unk> : _lemma\n"
+           "hello : _lemma _has_c\n"
+           ", : _lemma\n";
+  }
+  auto vocab = New<FactoredVocab>();
+  vocab->load(path);
+  std::remove(path.c_str());
+
+  const int beamSize = 3, dimBatch = 2, numLemmas = (int)vocab->lemmaSize(), numFactors = 2;
+  const float weight = 0.5f;
+
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+
+  // the factor logits of some hypotheses are all negative, so that adding the maxima changes the ranking
+  std::vector<float> vLemma(beamSize * dimBatch * numLemmas), vFactor(beamSize * dimBatch * numFactors), vPath(beamSize * dimBatch);
+  for(size_t i = 0; i < vLemma.size(); ++i)  vLemma[i]  = 2.f * std::sin(0.7f * i + 0.3f);
+  for(size_t i = 0; i < vFactor.size(); ++i) vFactor[i] = 3.f * std::cos(1.3f * i) - 1.f;
+  for(size_t i = 0; i < vPath.size(); ++i)   vPath[i]   = -0.25f * i;
+
+  auto lemma  = graph->constant({beamSize, 1, dimBatch, numLemmas}, inits::fromVector(vLemma));
+  auto factor = graph->constant({beamSize, 1, dimBatch, numFactors}, inits::fromVector(vFactor));
+  auto prev   = graph->constant({beamSize, 1, dimBatch, 1}, inits::fromVector(vPath));
+
+  std::vector<Ptr<RationalLoss>> losses = {New<RationalLoss>(lemma, nullptr), New<RationalLoss>(factor, nullptr)};
+  Logits logits(std::move(losses), vocab);
+
+  // as in BeamSearch::search(): path scores plus the weighted log probs, with the beams made continuous
+  auto full    = swapAxes(prev + weight * logits.getFactoredLogits(0), 0, 2); // [dimBatch, 1, beamSize, numLemmas]
+  auto lazy    = swapAxes(prev + weight * logits.getLemmaLogits(), 0, 2);
+  auto maxima  = logits.getFactorMaxima();                                     // [beamSize, 1, dimBatch, 1]
+  graph->forward();
+
+  std::vector<float> fullScores;
+  full->val()->get(fullScores);
+  const size_t rowSize = beamSize * numLemmas;
+
+  for(size_t N : {1, 3, 6}) {
+    std::vector<float> pathScores;
+    std::vector<unsigned> keys;
+    BeamSearch::getNBestListLazyFactors(lazy->val(), {maxima->val()}, {weight}, vocab, /*shortlist=*/nullptr, N,
+                                        pathScores, keys);
+    REQUIRE( keys.size() == N * dimBatch );
+    REQUIRE( pathScores.size() == N * dimBatch );
+
+    for(size_t batchIdx = 0; batchIdx < dimBatch; ++batchIdx) {
+      std::vector<unsigned> expected(rowSize);
+      std::iota(expected.begin(), expected.end(), (unsigned)(batchIdx * rowSize));
+      std::stable_sort(expected.begin(), expected.end(),
+                       [&](unsigned a, unsigned b) { return fullScores[a] > fullScores[b]; });
+      for(size_t k = 0; k < N; ++k) {
+        CHECK( keys[batchIdx * N + k] == expected[k] );
+        CHECK( pathScores[batchIdx * N + k] == Approx(fullScores[expected[k]]).epsilon(1e-5) );
+      }
+    }
+  }
+}
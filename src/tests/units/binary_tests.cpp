@@ -1,6 +1,7 @@
 #include "catch.hpp"
 #include "common/binary.h"
 #include "common/file_stream.h"
+#include "common/io.h"
 
 #include "3rd_party/mio/mio.hpp"
 
@@ -58,4 +59,111 @@ TEST_CASE("a few operations on binary files", "[binary]") {
       CHECK( std::equal(item2.data(), item2.data() + item2.size(), items[1].data()) );
     }
   }
+
+  SECTION("Save items compressed and load them") {
+    io::TemporaryFile temp("/tmp/", /*earlyUnlink=*/false);
+
+    std::vector<float> v1(1000);
+    for(size_t i = 0; i < v1.size(); ++i)
+      v1[i] = 0.001f * i;
+
+    io::Item item1, item2;
+    item1.name  = "item1";
+    item1.shape = { 10, 100 };
+    item1.type  = Type::float32;
+    item1.bytes.assign((char*)v1.data(), (char*)v1.data() + v1.size() * sizeof(float));
+
+    item2.name  = "item2";
+    item2.shape = { 3 };
+    item2.type  = Type::int8;
+    item2.bytes = { 'a', 'b', 'c' };
+
+    std::vector<io::Item> items = {item1, item2};
+    io::binary::saveItems(temp.getFileName(), items, /*compressed=*/true);
+    CHECK( filesystem::fileSize(temp.getFileName()) < item1.bytes.size() );
+
+    std::vector<io::Item> loaded;
+    io::binary::loadItems(temp.getFileName(), loaded);
+    REQUIRE( loaded.size() == 2 );
+    CHECK( item1.name == loaded[0].name );
+    CHECK( item1.shape == loaded[0].shape );
+    CHECK( item1.bytes == loaded[0].bytes );
+    CHECK( item2.bytes == loaded[1].bytes );
+
+    // compressed items cannot be mapped and are decompressed instead
+    mio::mmap_source mmap(temp.getFileName());
+    std::vector<io::Item> unmapped;
+    io::binary::loadItems(mmap.data(), unmapped, /*mapped=*/true);
+    CHECK( !unmapped[0].mapped );
+    CHECK( item1.bytes == unmapped[0].bytes );
+  }
+
+  SECTION("Deduplicate identical items and restore them as aliases") {
+    io::TemporaryFile temp("/tmp/", /*earlyUnlink=*/false);
+    std::string fileName = temp.getFileName() + ".bin";
+
+    std::vector<float> v(512, 0.5f);
+    io::Item item1;
+    item1.name  = "encoder_Wemb";
+    item1.shape = { 16, 32 };
+    item1.type  = Type::float32;
+    item1.bytes.assign((char*)v.data(), (char*)v.data() + v.size() * sizeof(float));
+
+    io::Item item2 = item1; // same content, different name
+    item2.name = "decoder_Wemb";
+
+    io::Item item3 = item1; // same bytes, different shape
+    item3.name  = "other";
+    item3.shape = { 32, 16 };
+
+    std::vector<io::Item> items = {item1, item2, item3};
+    io::deduplicateItems(items);
+    REQUIRE( items.size() == 3 ); // item2 replaced by special:aliases
+    CHECK( items[2].name == "special:aliases" );
+    io::saveItems(fileName, items);
+
+    auto loaded = io::loadItems(fileName);
+    REQUIRE( loaded.size() == 4 );
+    CHECK( loaded[3].name == "decoder_Wemb" );
+    CHECK( loaded[3].shape == item2.shape );
+    CHECK( std::equal(item2.data(), item2.data() + item2.size(), loaded[3].data()) );
+
+    { // mapped aliases point to the memory of their target
+      mio::mmap_source mmap(fileName);
+      auto mapped = io::mmapItems(mmap.data());
+      REQUIRE( mapped.size() == 4 );
+      CHECK( mapped[3].mapped );
+      CHECK( mapped[3].data() == mapped[0].data() );
+    }
+    std::remove(fileName.c_str());
+  }
+
+  SECTION("Save many items to npz file and load them in parallel") {
+    io::TemporaryFile temp("/tmp/", /*earlyUnlink=*/false);
+    std::string fileName = temp.getFileName() + ".npz";
+
+    std::vector<io::Item> saved;
+    for(int i = 0; i < 32; ++i) {
+      io::Item item;
+      item.name  = "item" + std::to_string(131 - i); // stored in reverse order of names
+      item.shape = { i + 1, 3 };
+      item.type  = Type::float32;
+      std::vector<float> v(item.shape.elements(), (float)i);
+      item.bytes.assign((char*)v.data(), (char*)v.data() + v.size() * sizeof(float));
+      saved.push_back(item);
+    }
+    io::saveItems(fileName, saved);
+
+    auto items = io::loadItems(fileName);
+    std::remove(fileName.c_str());
+
+    REQUIRE( items.size() == saved.size() );
+    for(size_t i = 0; i < items.size(); ++i) {
+      const auto& item = saved[saved.size() - 1 - i]; // loaded items are sorted by name
+      CHECK( item.name == items[i].name );
+      CHECK( item.shape == items[i].shape );
+      CHECK( item.type == items[i].type );
+      CHECK( std::equal(item.data(), item.data() + item.size(), items[i].data()) );
+    }
+  }
 }
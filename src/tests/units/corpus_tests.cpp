@@ -0,0 +1,62 @@
+#include "catch.hpp"
+#include "common/options.h"
+#include "data/batch_generator.h"
+#include "data/corpus.h"
+
+#include <cstdio>
+#include <fstream>
+
+using namespace marian;
+
+TEST_CASE("Corpus with --data-threads produces the same batches as a single thread", "[data]") {
+  std::vector<std::string> words = {"la", "casa", "roja", "el", "perro", "come", "pan", "y", "agua", "hoy"};
+  {
+    std::ofstream vocab("corpus_tests.vocab.txt");
+    vocab << "</s>\n<unk>\n";
+    for(const auto& word : words)
+      vocab << word << "\n";
+
+    // sentences of varying length; some are too long and skipped, the last one has an unknown word
+    std::ofstream src("corpus_tests.src"), trg("corpus_tests.trg");
+    for(size_t i = 0; i < 97; ++i) {
+      for(size_t j = 0; j < 1 + (i * 7) % 13; ++j) {
+        src << (j > 0 ? " " : "") << words[(i + j) % words.size()];
+        trg << (j > 0 ? " " : "") << words[(3 * i + j) % words.size()];
+      }
+      src << "\n";
+      trg << "\n";
+    }
+    src << "la bicicleta\n";
+    trg << "la casa\n";
+  }
+
+  auto readBatches = [&](size_t dataThreads) {
+    auto options = New<Options>("max-length", 10, "max-length-crop", false, "right-left", false,
+                                "mini-batch", 4, "maxi-batch", 3, "maxi-batch-sort", "src",
+                                "data-threads", dataThreads);
+    auto vocab = New<Vocab>(options, 0);
+    vocab->load("corpus_tests.vocab.txt");
+
+    auto corpus = New<data::Corpus>(std::vector<std::string>({"corpus_tests.src", "corpus_tests.trg"}),
+                                    std::vector<Ptr<Vocab>>({vocab, vocab}), options);
+    data::BatchGenerator<data::Corpus> batchGenerator(corpus, options);
+    batchGenerator.prepare();
+
+    std::vector<std::pair<std::vector<size_t>, std::vector<Words>>> batches; // sentence ids and words of each stream
+    for(auto batch : batchGenerator) {
+      std::vector<Words> streams;
+      for(size_t i = 0; i < batch->sets(); ++i)
+        streams.push_back((*batch)[i]->data());
+      batches.emplace_back(batch->getSentenceIds(), streams);
+    }
+    return batches;
+  };
+
+  auto expected = readBatches(1);
+  CHECK( expected.size() > 10 );
+  for(size_t dataThreads : {2, 4})
+    CHECK( readBatches(dataThreads) == expected );
+
+  for(auto path : {"corpus_tests.vocab.txt", "corpus_tests.src", "corpus_tests.trg"})
+    std::remove(path);
+}
@@ -1,6 +1,12 @@
 #include "catch.hpp"
 #include "graph/expression_graph.h"
 #include "graph/expression_operators.h"
+#include "common/file_stream.h"
+#include "common/io.h"
+
+#include "3rd_party/mio/mio.hpp"
+
+#include <cstdio>
 
 #ifdef CUDA_FOUND
 #include "tensors/gpu/backend.h"
@@ -121,3 +127,148 @@ TEST_CASE("Expression graph can be initialized with constant values (cpu)",
     REQUIRE(values == v);
   }
 }
+
+TEST_CASE("Lambda nodes with the same external hash are memoized (cpu)", "[graph]") {
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(4);
+
+  auto copy = [](Expr out, const std::vector<Expr>& inputs) { out->val()->copyFrom(inputs[0]->val()); };
+
+  auto input = graph->constant({2, 3}, inits::fromVector(std::vector<float>({1, 2, 3, 4, 5, 6})));
+  auto x = tanh(input); // not memoized itself, like activations in a model
+
+  SECTION("same external hash and inputs give the same node") {
+    auto a = lambda({x}, x->shape(), Type::float32, copy, /*hash=*/12345);
+    auto b = lambda({x}, x->shape(), Type::float32, copy, /*hash=*/12345);
+    CHECK(a == b);
+  }
+
+  SECTION("different external hashes give different nodes") {
+    auto a = lambda({x}, x->shape(), Type::float32, copy, /*hash=*/12345);
+    auto b = lambda({x}, x->shape(), Type::float32, copy, /*hash=*/54321);
+    CHECK(a != b);
+  }
+
+  SECTION("without external hash nodes are never shared") {
+    auto a = lambda({x}, x->shape(), Type::float32, copy);
+    auto b = lambda({x}, x->shape(), Type::float32, copy);
+    CHECK(a != b);
+  }
+}
+
+TEST_CASE("Mapped parameters in a namespace use the mapped memory (cpu)", "[graph]") {
+  io::TemporaryFile temp("/tmp/", /*earlyUnlink=*/false);
+  std::string fileName = temp.getFileName() + ".bin";
+
+  std::vector<float> v(64 * 32, 0.5f);
+  io::Item item;
+  item.name  = "decoder_W";
+  item.shape = { 64, 32 };
+  item.type  = Type::float32;
+  item.bytes.assign((char*)v.data(), (char*)v.data() + v.size() * sizeof(float));
+  std::vector<io::Item> items = {item};
+  io::saveItems(fileName, items);
+
+  {
+    mio::mmap_source mmap(fileName);
+    auto graph = New<ExpressionGraph>(/*inference=*/true);
+    graph->setDevice({0, DeviceType::cpu});
+    graph->reserveWorkspaceMB(4);
+    graph->switchParams("F0"); // as for the scorers of marian-decoder
+    graph->mmap(mmap.data());
+
+    auto W = graph->get("decoder_W");
+    REQUIRE(W);
+    CHECK(W->name() == "F0::decoder_W");
+    auto y = sum(W, /*ax=*/0);
+    graph->forward();
+
+    auto params = std::dynamic_pointer_cast<MappedParameters>(graph->params(Type::float32));
+    REQUIRE(params);
+    CHECK(params->unmappedBytes() == 0);
+    CHECK(W->val()->memory()->data<char>() >= mmap.data());
+    CHECK(W->val()->memory()->data<char>() < mmap.data() + mmap.size());
+  }
+  std::remove(fileName.c_str());
+}
+
+TEST_CASE("Workspace allocation strategies give the same results (cpu)", "[graph]") {
+  std::vector<float> v({1, 2, 3, 4, 5, 6});
+
+  auto run = [&](AllocationStrategy strategy, /*out*/ AllocatorStats& stats) {
+    auto graph = New<ExpressionGraph>(/*inference=*/true);
+    graph->setDevice({0, DeviceType::cpu});
+    graph->reserveWorkspaceMB(4);
+    graph->setWorkspaceAllocationStrategy(strategy);
+
+    auto x = graph->constant({2, 3}, inits::fromVector(v));
+    auto y = tanh(x) * 2.f + x;
+    graph->forward();
+
+    std::vector<float> values;
+    y->val()->get(values);
+    stats = graph->getWorkspaceStats();
+    return values;
+  };
+
+  AllocatorStats firstFitStats, sizeClassesStats;
+  auto firstFit    = run(AllocationStrategy::FirstFit, firstFitStats);
+  auto sizeClasses = run(AllocationStrategy::SizeClasses, sizeClassesStats);
+  CHECK(firstFit == sizeClasses);
+
+  for(auto& stats : {firstFitStats, sizeClassesStats}) {
+    CHECK(stats.allocations > 0);
+    CHECK(stats.peak > 0);
+    CHECK(stats.inUse <= stats.peak);
+    CHECK(stats.peak <= stats.extent);
+    CHECK(stats.extent <= stats.capacity);
+  }
+}
+
+TEST_CASE("Allocator extent includes the padding to size classes (cpu)", "[graph]") {
+  for(auto strategy : {AllocationStrategy::FirstFit, AllocationStrategy::SizeClasses}) {
+    Allocator allocator({0, DeviceType::cpu}, /*bytes=*/1024 * 1024, /*step=*/1024 * 1024);
+    allocator.setStrategy(strategy);
+
+    auto a = allocator.alloc(768);
+    auto b = allocator.alloc(256);
+    CHECK(allocator.stats().peak == 768 + 256);
+    // size classes take 1024 bytes for the first allocation
+    CHECK(allocator.stats().extent == (strategy == AllocationStrategy::SizeClasses ? 1024 + 256 : 768 + 256));
+
+    allocator.free(b);
+    allocator.resetStats(); // only a is still allocated
+    CHECK(allocator.stats().peak == 768);
+    CHECK(allocator.stats().extent == (strategy == AllocationStrategy::SizeClasses ? 1024 : 768));
+  }
+}
+
+TEST_CASE("Size-class allocator recycles freed blocks (cpu)", "[graph]") {
+  Allocator allocator({0, DeviceType::cpu}, /*bytes=*/1024 * 1024, /*step=*/1024 * 1024);
+  allocator.setStrategy(AllocationStrategy::SizeClasses);
+
+  auto a = allocator.alloc(300);  // 512 bytes size class
+  auto b = allocator.alloc(1000); // 1024 bytes size class
+  uint8_t* ptrA = a->data();
+  CHECK(allocator.stats().inUse == 256 * 2 + 256 * 4);
+
+  allocator.free(a);
+  auto c = allocator.alloc(500); // same size class as a
+  CHECK(c->data() == ptrA);
+
+  allocator.clear(); // resets the arena
+  auto d = allocator.alloc(2000);
+  CHECK(d->data() == ptrA);
+  CHECK(allocator.stats().growEvents == 0);
+}
+
+TEST_CASE("Resizing the tensor allocator keeps throwing at reallocation (cpu)", "[graph]") {
+  TensorAllocator allocator(BackendByDeviceId({0, DeviceType::cpu}, Config::seed));
+  allocator.throwAtReallocation(true);
+  allocator.resize(1024 * 1024);
+
+  Tensor a, b;
+  allocator.allocate(a, {256, 1024}); // exactly the resized capacity
+  CHECK_THROWS_AS(allocator.allocate(b, {16}), AllocationException);
+}
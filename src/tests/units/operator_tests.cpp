@@ -5,11 +5,21 @@
 #include "catch.hpp"
 #include "graph/expression_graph.h"
 #include "graph/expression_operators.h"
+#include "tensors/cpu/int4_gemm.h"
+#include "layers/lsh.h"
+#include "layers/hnsw.h"
+#include "data/shortlist.h"
+#include "3rd_party/threadpool.h"
 
 #ifdef CUDA_FOUND
 #include "tensors/gpu/backend.h"
 #endif
 
+#if USE_FBGEMM
+#include "tensors/cpu/fbgemm/expanded_gemm.h"
+#include "fbgemm/Utils.h"
+#endif
+
 #include <cmath>
 
 using namespace marian;
@@ -736,12 +746,21 @@ void tests(DeviceType device, Type floatType = Type::float32) {
     std::vector<IndexType> iB4({1, 1});         // repeated rows
     std::vector<IndexType> iB5({0, 1, 2, 3});   // identity
     std::vector<IndexType> iB6({});             // empty
+    std::vector<IndexType> iB7({2, 0, 2, 1, 0}); // scattered repeated rows
     std::vector<T> vB0({1, 2, 3});
     std::vector<T> vB1({1, 2, 3, 4, 5, 6, 7, 8, 9});
     std::vector<T> vB2({1, 2, 3, 7, 8, 9});
     std::vector<T> vB3({7, 8, 9, 4, 5, 6});
     std::vector<T> vB4({4, 5, 6, 4, 5, 6});
     std::vector<T> vB6;
+    std::vector<T> vB7({7, 8, 9, 1, 2, 3, 7, 8, 9, 4, 5, 6, 1, 2, 3});
+
+    std::vector<IndexType> iB8; // enough scattered repeated rows for the CPU kernel to sort them
+    std::vector<T> vB8;
+    for(IndexType i = 0; i < 40; ++i) {
+      iB8.push_back((3 * i + i / 4) % 4);
+      vB8.insert(vB8.end(), vA.begin() + iB8.back() * 3, vA.begin() + iB8.back() * 3 + 3);
+    }
 
     auto A = graph->param("A", {4, 3}, inits::fromVector(vA));
     auto B0 = rows(A, iB0);
@@ -751,6 +770,8 @@ void tests(DeviceType device, Type floatType = Type::float32) {
     auto B4 = rows(A, iB4);
     auto B5 = rows(A, iB5);
     auto B6 = rows(A, iB6);
+    auto B7 = rows(A, iB7);
+    auto B8 = rows(A, iB8);
     graph->forward();
 
     CHECK(B0->shape() == Shape({1, 3}));
@@ -780,6 +801,14 @@ void tests(DeviceType device, Type floatType = Type::float32) {
     CHECK(B6->shape() == Shape({0, 3}));
     B6->val()->get(values);
     CHECK( values == vB6 );
+
+    CHECK(B7->shape() == Shape({5, 3}));
+    B7->val()->get(values);
+    CHECK( values == vB7 );
+
+    CHECK(B8->shape() == Shape({40, 3}));
+    B8->val()->get(values);
+    CHECK( values == vB8 );
   }
 
   SECTION("columns selection from 2d matrix") {
@@ -1118,6 +1147,335 @@ TEST_CASE("Expression graph supports basic math operations (cpu)", "[operator]")
 }
 #endif
 
+#if defined(BLAS_FOUND) && USE_FBGEMM
+TEST_CASE("Packed int8 affine with fused bias and ReLU (cpu)", "[operator]") {
+  if(!fbgemm::fbgemmHasAvx2Support())
+    return;
+
+  Type packType = fbgemm::fbgemmHasAvx512Support() ? Type::packed8avx512 : Type::packed8avx2;
+
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+
+  std::vector<float> vA(8 * 64), vB(64 * 32), vBias(32);
+  for(size_t i = 0; i < vA.size(); ++i)    vA[i]    = std::sin(0.1f * i);
+  for(size_t i = 0; i < vB.size(); ++i)    vB[i]    = 0.1f * std::cos(0.37f * i) * (1 + i % 32); // column-dependent ranges
+  for(size_t i = 0; i < vBias.size(); ++i) vBias[i] = 0.05f * i - 0.8f;
+
+  auto A    = graph->param("A", {8, 64}, inits::fromVector(vA));
+  auto B    = graph->param("B", {64, 32}, inits::fromVector(vB));
+  auto bias = graph->param("bias", {1, 32}, inits::fromVector(vBias));
+
+  auto packedB = cpu::variant::pack(packType, B, cpu::variant::PackMatrix::B, /*transpose=*/false);
+  auto fused   = cpu::variant::affine(packType, A, packedB, B->shape(), bias, false, false, 1.f, /*relu=*/true);
+  auto unfused = relu(cpu::variant::affine(packType, A, packedB, B->shape(), bias, false, false, 1.f));
+  auto ref     = relu(affine(A, B, bias));
+
+  graph->forward();
+
+  std::vector<float> vFused, vUnfused, vRef;
+  fused->val()->get(vFused);
+  unfused->val()->get(vUnfused);
+  ref->val()->get(vRef);
+
+  auto sameApprox  = [](float x, float y) -> bool { return x == Approx(y).margin(1e-5f); };
+  auto quantApprox = [](float x, float y) -> bool { return x == Approx(y).margin(0.1f); };
+  CHECK(std::equal(vFused.begin(), vFused.end(), vUnfused.begin(), sameApprox));
+  CHECK(std::equal(vFused.begin(), vFused.end(), vRef.begin(), quantApprox));
+}
+#endif
+
+#ifdef BLAS_FOUND
+TEST_CASE("Int4 affine against dequantized float32 affine (cpu)", "[operator]") {
+  const int M = 4, K = 128, N = 40;
+
+  std::vector<float> vA(M * K), vW(K * N), vBias(N);
+  for(size_t i = 0; i < vA.size(); ++i) vA[i] = std::sin(0.1f * i);
+  for(size_t i = 0; i < vW.size(); ++i) vW[i] = 0.1f * std::cos(0.37f * i);
+  for(size_t i = 0; i < vBias.size(); ++i) vBias[i] = 0.05f * i - 1.f;
+
+  // int4 matrices are quantized with the inner dimension contiguous for each output column
+  std::vector<float> vWt(N * K);
+  for(int k = 0; k < K; ++k)
+    for(int n = 0; n < N; ++n)
+      vWt[n * K + k] = vW[k * N + n];
+
+  io::Item item;
+  item.name  = "W4";
+  item.shape = {K, N};
+  item.type  = Type::int4;
+  item.bytes.resize(requiredBytes(item.shape, item.type));
+  float quantError = cpu::int4::quantize(vWt.data(), N, K, item.bytes.data());
+  CHECK(quantError < 0.02f);
+
+  std::vector<float> vDequant(N * K), vWDequant(K * N);
+  cpu::int4::dequantize(item.bytes.data(), N, K, 0, N, vDequant.data());
+  for(int k = 0; k < K; ++k)
+    for(int n = 0; n < N; ++n)
+      vWDequant[k * N + n] = vDequant[n * K + k];
+
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+
+  auto A    = graph->param("A", {M, K}, inits::fromVector(vA));
+  auto W4   = graph->param("W4", {K, N}, inits::fromItem(item), Type::int4);
+  auto W    = graph->param("W", {K, N}, inits::fromVector(vWDequant));
+  auto bias = graph->param("bias", {1, N}, inits::fromVector(vBias));
+
+  auto out = affine(A, W4, bias);
+  auto ref = affine(A, W, bias);
+  graph->forward();
+
+  std::vector<float> vOut, vRef;
+  out->val()->get(vOut);
+  ref->val()->get(vRef);
+
+  auto floatApprox = [](float x, float y) -> bool { return x == Approx(y).margin(1e-4f); };
+  CHECK(out->shape() == Shape({M, N}));
+  CHECK(std::equal(vOut.begin(), vOut.end(), vRef.begin(), floatApprox));
+}
+#endif
+
+#ifdef BLAS_FOUND
+TEST_CASE("Fake-quantized intgemm8 inputs in affine (cpu)", "[operator]") {
+  const int M = 4, K = 64, N = 8;
+
+  std::vector<float> vA(M * K), vW(K * N), vBias(N, 0.5f);
+  for(size_t i = 0; i < vA.size(); ++i) vA[i] = std::sin(0.1f * i);
+  for(size_t i = 0; i < vW.size(); ++i) vW[i] = 0.1f * std::cos(0.37f * i);
+
+  // intgemm8 quantizes A per tensor with 127/max|A|
+  float maxAbs = 0.f;
+  for(auto a : vA) maxAbs = std::max(maxAbs, std::abs(a));
+  std::vector<float> vAq(vA.size());
+  for(size_t i = 0; i < vA.size(); ++i) vAq[i] = std::round(vA[i] * 127.f / maxAbs) * maxAbs / 127.f;
+
+  auto graph = New<ExpressionGraph>();
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+  graph->setQuantizeActivations(true);
+
+  auto A    = graph->param("A", {M, K}, inits::fromVector(vA));
+  auto Aq   = graph->param("Aq", {M, K}, inits::fromVector(vAq));
+  auto W    = graph->param("ff_W", {K, N}, inits::fromVector(vW)); // intgemm weight name, A is quantized
+  auto Wref = graph->param("Wref", {K, N}, inits::fromVector(vW)); // no intgemm weight name
+  auto bias = graph->param("bias", {1, N}, inits::fromVector(vBias));
+
+  auto out = affine(A, W, bias);
+  auto ref = affine(Aq, Wref, bias);
+  auto top = sum(flatten(out + ref));
+
+  graph->forward();
+  graph->backward();
+
+  auto floatApprox = [](float x, float y) -> bool { return x == Approx(y).margin(1e-5f); };
+
+  std::vector<float> vOut, vRef;
+  out->val()->get(vOut);
+  ref->val()->get(vRef);
+  CHECK(std::equal(vOut.begin(), vOut.end(), vRef.begin(), floatApprox));
+
+  // straight-through gradient
+  std::vector<float> gA, gAq;
+  A->grad()->get(gA);
+  Aq->grad()->get(gAq);
+  CHECK(std::equal(gA.begin(), gA.end(), gAq.begin(), floatApprox));
+}
+#endif
+
+#ifdef BLAS_FOUND
+TEST_CASE("Gather-affine with per-sentence shortlists (cpu)", "[operator]") {
+  const int beam = 2, batch = 3, dim = 16, V = 20, k = 4;
+
+  std::vector<float> vX(beam * batch * dim), vW(V * dim), vBias(V);
+  for(size_t i = 0; i < vX.size(); ++i) vX[i] = std::sin(0.3f * i);
+  for(size_t i = 0; i < vW.size(); ++i) vW[i] = 0.1f * std::cos(0.17f * i);
+  for(size_t i = 0; i < vBias.size(); ++i) vBias[i] = 0.01f * i;
+  std::vector<IndexType> vIdx = {0, 1, 5, 7,
+                                 0, 2, 3, 19,
+                                 1, 4, 11, 12};
+
+  std::vector<float> expected(beam * batch * k);
+  for(int r = 0; r < beam; ++r)
+    for(int b = 0; b < batch; ++b)
+      for(int j = 0; j < k; ++j) {
+        IndexType w = vIdx[b * k + j];
+        float sum = vBias[w];
+        for(int d = 0; d < dim; ++d)
+          sum += vX[(r * batch + b) * dim + d] * vW[w * dim + d];
+        expected[(r * batch + b) * k + j] = sum;
+      }
+
+  auto floatApprox = [](float x, float y) -> bool { return x == Approx(y).margin(1e-5f); };
+
+  // inference graphs use the fused CPU kernel, training graphs compose index_select and bdot
+  for(bool inference : {true, false}) {
+    auto graph = New<ExpressionGraph>(inference);
+    graph->setDevice({0, DeviceType::cpu});
+    graph->reserveWorkspaceMB(16);
+
+    auto x    = graph->constant({beam, 1, batch, dim}, inits::fromVector(vX));
+    auto W    = graph->constant({V, dim}, inits::fromVector(vW));
+    auto bias = graph->constant({1, V}, inits::fromVector(vBias));
+    auto idx  = graph->indices(vIdx);
+    auto out  = gatherAffine(x, W, reshape(idx, {batch, k}), bias);
+    graph->forward();
+
+    CHECK(out->shape() == Shape({beam, 1, batch, k}));
+    std::vector<float> vOut;
+    out->val()->get(vOut);
+    CHECK(std::equal(vOut.begin(), vOut.end(), expected.begin(), floatApprox));
+  }
+}
+#endif
+
+TEST_CASE("Shortlist cache of selected rows (cpu)", "[operator]") {
+  const int V = 8, dim = 65536; // one row takes 256 KB, hence four rows fit into the budget of 1 MB
+
+  std::vector<float> vW(V * dim);
+  for(size_t i = 0; i < vW.size(); ++i) vW[i] = (float)(i % 1000);
+
+  auto graph = New<ExpressionGraph>(/*inference=*/true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(32);
+
+  auto cache = New<data::ShortlistCache>(/*budgetMB=*/1);
+  auto lookup = [&](const std::vector<WordIndex>& indices, bool runForward = true) {
+    graph->clear(); // releases the nodes of the previous lookup, so that their entries can be evicted
+    auto W = graph->param("W", {V, dim}, inits::fromVector(vW));
+    auto out = cache->getOrSelect(W, indices, [&]() { return rows(W, indices); });
+    std::vector<float> values;
+    if(runForward) {
+      graph->forward();
+      out->val()->get(values);
+    }
+    return values;
+  };
+  auto expected = [&](const std::vector<WordIndex>& indices) {
+    std::vector<float> values;
+    for(auto i : indices)
+      values.insert(values.end(), vW.begin() + i * dim, vW.begin() + (i + 1) * dim);
+    return values;
+  };
+
+  CHECK( lookup({1}) == expected({1}) );
+  CHECK( cache->misses() == 1 );
+  CHECK( lookup({1}) == expected({1}) );
+  CHECK( cache->hits() == 1 );
+
+  // fill the budget, then the least recently used entry {1} is evicted for {5}
+  lookup({2});
+  lookup({3});
+  lookup({4});
+  CHECK( lookup({5}) == expected({5}) );
+  CHECK( cache->misses() == 5 );
+  CHECK( lookup({2}) == expected({2}) );
+  CHECK( cache->hits() == 2 );
+  CHECK( lookup({1}) == expected({1}) );
+  CHECK( cache->misses() == 6 );
+
+  // a selection larger than the budget is not cached and does not evict the others
+  std::vector<WordIndex> large = {0, 1, 2, 3, 4};
+  CHECK( lookup(large) == expected(large) );
+  CHECK( lookup(large) == expected(large) );
+  CHECK( cache->misses() == 8 );
+  CHECK( lookup({1}) == expected({1}) );
+  CHECK( cache->hits() == 3 );
+
+  // an entry whose graph has been cleared before running forward is selected again
+  lookup({6}, /*runForward=*/false);
+  CHECK( lookup({6}) == expected({6}) );
+  CHECK( cache->misses() == 10 );
+  CHECK( lookup({6}) == expected({6}) );
+  CHECK( cache->hits() == 4 );
+}
+
+TEST_CASE("LSH search of nearest hamming neighbours (cpu)", "[operator]") {
+  const int beam = 2, batch = 5, dim = 96, V = 300, k = 17;
+
+  std::vector<float> vQ(beam * batch * dim), vW(V * dim);
+  for(size_t i = 0; i < vQ.size(); ++i) vQ[i] = std::sin(0.7f * i + 0.1f);
+  for(size_t i = 0; i < vW.size(); ++i) vW[i] = std::cos(1.3f * i);
+
+  // without rotation, the bits are the signs of the inputs; ties go to the smaller index
+  std::vector<IndexType> expected;
+  for(int r = 0; r < beam * batch; ++r) {
+    std::vector<std::pair<int, IndexType>> distances;
+    for(int w = 0; w < V; ++w) {
+      int dist = 0;
+      for(int d = 0; d < dim; ++d)
+        dist += (vQ[r * dim + d] > 0) != (vW[w * dim + d] > 0);
+      distances.push_back({dist, (IndexType)w});
+    }
+    std::sort(distances.begin(), distances.end());
+    std::vector<IndexType> best;
+    for(int i = 0; i < k; ++i)
+      best.push_back(distances[i].second);
+    std::sort(best.begin(), best.end());
+    expected.insert(expected.end(), best.begin(), best.end());
+  }
+
+  for(size_t threads : {0, 3}) {
+    auto pool = threads ? New<ThreadPool>(threads) : nullptr;
+
+    auto graph = New<ExpressionGraph>(true);
+    graph->setDevice({0, DeviceType::cpu});
+    graph->reserveWorkspaceMB(16);
+
+    auto query   = graph->constant({beam, 1, batch, dim}, inits::fromVector(vQ));
+    auto weights = graph->constant({V, dim}, inits::fromVector(vW));
+    auto indices = lsh::search(query, weights, k, /*nbits=*/dim, /*firstNRows=*/0, /*abortIfDynamic=*/false, pool.get());
+    graph->forward();
+
+    CHECK(indices->shape() == Shape({beam, batch, k}));
+    std::vector<IndexType> vIndices;
+    indices->val()->get(vIndices);
+    CHECK(vIndices == expected);
+  }
+}
+
+TEST_CASE("HNSW search of largest inner products (cpu)", "[operator]") {
+  const int beam = 2, batch = 4, dim = 32, V = 400, k = 10, ef = 100;
+
+  std::vector<float> vQ(beam * batch * dim), vW(V * dim);
+  for(size_t i = 0; i < vQ.size(); ++i) vQ[i] = std::sin(0.7f * i + 0.1f);
+  for(size_t i = 0; i < vW.size(); ++i) vW[i] = std::cos(1.3f * i) * (1.f + (i / dim) % 3);
+
+  auto graph = New<ExpressionGraph>(true);
+  graph->setDevice({0, DeviceType::cpu});
+  graph->reserveWorkspaceMB(16);
+
+  auto query   = graph->constant({beam, 1, batch, dim}, inits::fromVector(vQ));
+  auto weights = graph->param("out_Wt", {V, dim}, inits::fromVector(vW));
+  auto indices = hnsw::search(query, weights, k, ef);
+  graph->forward();
+
+  CHECK(indices->shape() == Shape({beam, batch, k}));
+  std::vector<IndexType> vIndices;
+  indices->val()->get(vIndices);
+
+  // the search is approximate, but with this many candidates on a small graph nearly all of the best rows are found
+  int found = 0;
+  for(int r = 0; r < beam * batch; ++r) {
+    std::vector<std::pair<float, IndexType>> products;
+    for(int w = 0; w < V; ++w) {
+      float ip = 0.f;
+      for(int d = 0; d < dim; ++d)
+        ip += vQ[r * dim + d] * vW[w * dim + d];
+      products.push_back({-ip, (IndexType)w});
+    }
+    std::sort(products.begin(), products.end());
+
+    auto begin = vIndices.begin() + r * k;
+    CHECK(std::is_sorted(begin, begin + k));
+    for(int i = 0; i < k; ++i)
+      found += std::binary_search(begin, begin + k, products[i].second);
+  }
+  CHECK(found >= 0.95 * beam * batch * k);
+}
+
 #ifdef BLAS_FOUND
 #ifdef CUDA_FOUND
 
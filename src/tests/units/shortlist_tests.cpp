@@ -0,0 +1,82 @@
+#include "catch.hpp"
+#include "marian.h"
+#include "common/options.h"
+#include "data/shortlist.h"
+#include "data/shortlist_builder.h"
+
+#include <cstdio>
+#include <fstream>
+
+using namespace marian;
+
+TEST_CASE("ShortlistBuilder scores word pairs of a small corpus", "[data]") {
+  auto write = [](const std::string& path, const std::string& content) {
+    std::ofstream out(path);
+    out << content;
+  };
+  write("shortlist_tests.src.txt", "</s>\n<unk>\nla\ncasa\nroja\n");
+  write("shortlist_tests.trg.txt", "</s>\n<unk>\nthe\nhouse\nred\n");
+  write("shortlist_tests.src", "la casa\nla casa roja\n");
+  write("shortlist_tests.trg", "the house\nthe red house\n");
+  // the second line is in the format of marian-scorer --alignment hard, position 3 is the EOS
+  write("shortlist_tests.align", "0-0 1-1\n-1.5 ||| 0-0 1-2 2-1 3-3 ||| WordScores= -0.5 -0.5 -0.5\n");
+
+  auto options = New<Options>();
+  auto srcVocab = New<Vocab>(options, 0);
+  auto trgVocab = New<Vocab>(options, 1);
+  srcVocab->load("shortlist_tests.src.txt");
+  trgVocab->load("shortlist_tests.trg.txt");
+
+  const WordIndex la = 2, casa = 3, roja = 4, the = 2, house = 3, red = 4;
+
+  SECTION("aligned word pairs are scored with p(t|s)") {
+    data::ShortlistBuilder builder(srcVocab, trgVocab, /*threads=*/2, /*memoryMB=*/16);
+    builder.count("shortlist_tests.src", "shortlist_tests.trg", "shortlist_tests.align");
+    auto scores = builder.scores();
+
+    CHECK( scores[la].size() == 1 );
+    CHECK( scores[la][the] == Approx(1.f) );
+    CHECK( scores[casa].size() == 1 );
+    CHECK( scores[casa][house] == Approx(1.f) );
+    CHECK( scores[roja].size() == 1 );
+    CHECK( scores[roja][red] == Approx(1.f) );
+  }
+
+  SECTION("co-occurrences are scored with the Dice coefficient") {
+    data::ShortlistBuilder builder(srcVocab, trgVocab, /*threads=*/1, /*memoryMB=*/16);
+    builder.count("shortlist_tests.src", "shortlist_tests.trg");
+    auto scores = builder.scores();
+
+    CHECK( scores[la].size() == 3 );
+    CHECK( scores[la][the] == Approx(1.f) );          // 2 * 2 / (2 + 2)
+    CHECK( scores[la][red] == Approx(2.f / 3) );      // 2 * 1 / (2 + 1)
+    CHECK( scores[roja][red] == Approx(1.f) );
+    CHECK( scores[roja][house] == Approx(2.f / 3) );
+  }
+
+  for(auto path : {"shortlist_tests.src.txt", "shortlist_tests.trg.txt", "shortlist_tests.src", "shortlist_tests.trg", "shortlist_tests.align"})
+    std::remove(path);
+}
+
+TEST_CASE("SentenceShortlist maps the shared words in every sentence", "[data]") {
+  // </s>, <unk> and a special word are shared, the sets of the sentences overlap otherwise
+  std::vector<WordIndex> shared = {0, 1, 17};
+  std::vector<std::vector<WordIndex>> sentenceIndices = {{0, 3, 5, 9}, {2, 4, 17}, {1, 11, 12, 13, 14, 15, 16, 18}};
+  data::SentenceShortlist shortlist(sentenceIndices, shared, /*padFrom=*/2, /*vocabSize=*/20);
+
+  // 3 shared words and up to 8 other words, rounded up to a multiple of 8
+  const int k = 16;
+  for(int batchIdx = 0; batchIdx < 3; ++batchIdx) {
+    std::vector<WordIndex> row;
+    for(int idx = 0; idx < k; ++idx)
+      row.push_back(shortlist.reverseMap(/*beamIdx=*/0, batchIdx, idx));
+    CHECK( std::vector<WordIndex>(row.begin(), row.begin() + 3) == shared );
+    for(auto wIdx : sentenceIndices[batchIdx])
+      CHECK( std::count(row.begin(), row.end(), wIdx) == 1 );
+  }
+
+  CHECK( shortlist.tryForwardMap(0) == 0 );
+  CHECK( shortlist.tryForwardMap(1) == 1 );
+  CHECK( shortlist.tryForwardMap(17) == 2 );
+  CHECK( shortlist.tryForwardMap(3) == data::Shortlist::npos );
+}
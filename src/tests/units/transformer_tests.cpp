@@ -0,0 +1,35 @@
+#include "catch.hpp"
+#include "models/transformer_options.h"
+#include "3rd_party/yaml-cpp/yaml.h"
+
+using namespace marian;
+
+TEST_CASE("Transformer options snapshot", "[transformer]") {
+  auto options = New<Options>(YAML::Load("{"
+      "transformer-heads: 8,"
+      "transformer-no-projection: false,"
+      "transformer-preprocess: '',"
+      "transformer-postprocess: dan,"
+      "transformer-postprocess-emb: d,"
+      "transformer-ffn-activation: relu,"
+      "transformer-dim-ffn: 2048,"
+      "transformer-ffn-depth: 2,"
+      "transformer-decoder-autoreg: self-attention,"
+      "enc-depth: 6,"
+      "dec-depth: 6,"
+      "transformer-tied-layers: []"
+      "}"));
+
+  TransformerOptions cfg(options, /*inference=*/true);
+  CHECK( cfg.heads == 8 );
+  CHECK( cfg.postprocess == "dan" );
+  CHECK( cfg.ffnActivation == "relu" );
+  CHECK( cfg.decDepth == 6 );
+  CHECK( cfg.dropout == 0.f ); // no dropout options needed for inference
+  CHECK( cfg.alignmentLayer == -1 );
+
+  SECTION("alignment layer") {
+    options->set("alignment", "soft", "transformer-guided-alignment-layer", "2");
+    CHECK( TransformerOptions(options, true).alignmentLayer == 1 );
+  }
+}
@@ -0,0 +1,120 @@
+#include "catch.hpp"
+#include "data/factored_vocab.h"
+#include "data/string_table.h"
+#include "data/vocab_base.h"
+
+#include <cstdio>
+#include <fstream>
+
+using namespace marian;
+
+TEST_CASE("StringTable maps between strings and indices", "[vocab]") {
+  std::vector<std::string> strings = {"</s>", "<unk>", "", "foo", "bar", "foobar", "\xc3\xa4"};
+  StringTable table;
+  table.build(strings);
+
+  CHECK( table.size() == strings.size() );
+  for(WordIndex i = 0; i < strings.size(); ++i) {
+    CHECK( table[i] == strings[i] );
+    CHECK( table.length(i) == strings[i].size() );
+  }
+
+  WordIndex index;
+  CHECK( table.tryFind("foo", index) );
+  CHECK( index == 3 );
+  CHECK( table.tryFind("foobar", 3, index) ); // prefix of a longer string
+  CHECK( index == 3 );
+  CHECK( table.tryFind("\xc3\xa4", index) );
+  CHECK( index == 6 );
+
+  // unknown strings and unused indices cannot be found
+  CHECK_FALSE( table.tryFind("baz", index) );
+  CHECK_FALSE( table.tryFind("fo", index) );
+  CHECK_FALSE( table.tryFind("", index) );
+
+  // a larger table
+  std::vector<std::string> many;
+  for(int i = 0; i < 10000; ++i)
+    many.push_back("w" + std::to_string(i));
+  table.build(many);
+  bool allFound = true;
+  for(WordIndex i = 0; i < many.size(); ++i)
+    allFound &= table.tryFind(many[i], index) && index == i;
+  CHECK( allFound );
+  CHECK_FALSE( table.tryFind("w10000", index) );
+}
+
+TEST_CASE("DefaultVocab encodes and decodes", "[vocab]") {
+  std::string path = "vocab_tests.tmp.txt";
+  {
+    std::ofstream out(path);
+    out << "</s>\n<unk>\nthe\ncat\nsat\n";
+  }
+
+  auto vocab = createDefaultVocab();
+  vocab->load(path);
+  std::remove(path.c_str());
+
+  CHECK( vocab->size() == 5 );
+  CHECK( vocab->getEosId() == Word::fromWordIndex(0) );
+  CHECK( vocab->getUnkId() == Word::fromWordIndex(1) );
+  CHECK( (*vocab)["cat"] == Word::fromWordIndex(3) );
+  CHECK( (*vocab)["dog"] == vocab->getUnkId() );
+  CHECK( (*vocab)[Word::fromWordIndex(4)] == "sat" );
+
+  auto words = vocab->encode("  the cat  sat dog ", /*addEOS=*/true);
+  std::vector<WordIndex> ids;
+  for(auto word : words)
+    ids.push_back(word.toWordIndex());
+  CHECK( ids == std::vector<WordIndex>({2, 3, 4, 1, 0}) );
+
+  CHECK( vocab->decode(words, /*ignoreEOS=*/true) == "the cat sat <unk>" );
+  CHECK( vocab->decode(words, /*ignoreEOS=*/false) == "the cat sat <unk> </s>" );
+  CHECK( vocab->decode(Words(), /*ignoreEOS=*/true) == "" );
+}
+
+TEST_CASE("FactoredVocab keeps the factor groups of each lemma", "[vocab]") {
+  std::string path = "vocab_tests.tmp.fsv";
+  {
+    std::ofstream out(path);
+    out << "_lemma\n"
+           "_c\n"
+           "_has_c\n"
+           "_lemma <->\n"
+           "_c <-> _has_c\n"
+           "ca : _c\n"
+           "ci : _c\n"
+           "</s> : _lemma\n"
+           "<unk> : _lemma\n"
+           "hello : _lemma _has_c\n"
+           ", : _lemma\n";
+  }
+
+  auto vocab = New<FactoredVocab>();
+  vocab->load(path);
+  std::remove(path.c_str());
+
+  CHECK( vocab->getNumGroups() == 2 );
+  CHECK( vocab->lemmaSize() == 4 );
+  CHECK( vocab->lemmaHasFactorGroup(2, 0) );
+  CHECK( vocab->lemmaHasFactorGroup(2, 1) );
+  CHECK_FALSE( vocab->lemmaHasFactorGroup(3, 1) );
+  CHECK( vocab->size() == 5 ); // </s>, <unk>, hello|ca, hello|ci, ","
+
+  std::vector<float> masks(4);
+  vocab->getFactorMasks(1, nullptr, masks.size(), masks.data());
+  CHECK( masks == std::vector<float>({0, 0, 1, 0}) );
+
+  std::vector<WordIndex> units = {3, 2, 2}; // lemma units of a shortlist, in any order
+  units[0] += (WordIndex)vocab->getGroupRange(0).first;
+  units[1] += (WordIndex)vocab->getGroupRange(0).first;
+  units[2] += (WordIndex)vocab->getGroupRange(0).first;
+  masks.resize(units.size());
+  vocab->getFactorMasks(1, units.data(), units.size(), masks.data());
+  CHECK( masks == std::vector<float>({0, 1, 1}) );
+
+  auto word = vocab->string2word("hello|ci");
+  CHECK( vocab->getFactor(word, 0) == 2 );
+  CHECK( vocab->getFactor(word, 1) == 1 );
+  CHECK( vocab->word2string(vocab->lemma2Word(3)) == "," );
+}
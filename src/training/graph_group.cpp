@@ -1,4 +1,5 @@
 #include "training/graph_group.h"
+#include "tensors/cpu/expression_graph_packable.h"
 
 namespace marian {
 
@@ -425,6 +426,9 @@ void GraphGroup::save(bool isFinal,
       if(scheduler_)
         scheduler_->save(modelFileName);
     }
+
+    if(options_->get<bool>("quantize-intgemm", false))
+      saveIntgemm8(modelFileName);
   }
 
   swapWithSmoothed();
@@ -433,6 +437,35 @@ void GraphGroup::save(bool isFinal,
   barrier(); // (for better grouping of log messages)
 }
 
+// With --quantize-intgemm the weights are already on the intgemm8 grid, so converting them like
+// marian-conv --gemm-type intgemm8 is lossless. The result is saved as <model>.intgemm8.bin.
+// This does not hold for exponentially smoothed weights: the averages are quantized here for the
+// first time, like in a conversion of any float32 model.
+void GraphGroup::saveIntgemm8(const std::string& modelFileName) {
+#if COMPILE_CPU
+  if(options_->get<float>("exponential-smoothing", 0.f) > 0.f)
+    LOG_ONCE(warn,
+             "[training] The saved model holds the exponentially smoothed weights, which are not on the "
+             "intgemm8 grid of the quantized training. Its intgemm8 version is quantized again and can "
+             "differ from what has been trained, --exponential-smoothing 0 avoids that");
+  std::string intgemmFileName = modelFileName + ".intgemm8.bin";
+  LOG(info, "[training] Saving intgemm8 model to {}", intgemmFileName);
+
+  YAML::Node config;
+  std::stringstream configStr;
+  io::getYamlFromModel(config, "special:model.yml", modelFileName);
+  configStr << config;
+
+  auto graph = New<ExpressionGraphPackable>();
+  graph->setDevice(CPU0);
+  graph->load(modelFileName);
+  graph->forward();  // run the initializers
+  graph->packAndSave(intgemmFileName, configStr.str(), Type::intgemm8);
+#else
+  LOG_ONCE(warn, "[training] Saving intgemm8 models requires -DCOMPILE_CPU=on, use marian-conv to convert {}", modelFileName);
+#endif
+}
+
 void GraphGroup::swapWithSmoothed() {
   auto swap = [&](size_t i, size_t begin, size_t end) {
     auto curParam = graphs_[i]->params()->vals()->subtensor(begin, end-begin);
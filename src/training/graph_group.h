@@ -112,6 +112,8 @@ private:
   void saveCheckpoint(const std::string& modelFileName, 
                       const OptimizerBase::GatherStateFunc& gatherFn);
 
+  void saveIntgemm8(const std::string& modelFileName);
+
 public:
   void swapWithSmoothed();
 
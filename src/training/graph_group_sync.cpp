@@ -37,6 +37,11 @@ void SyncGraphGroup::initialize(const Ptr<data::Batch>& exampleBatch) {
   if (options_->get<size_t>("quantize-bits") > 0) {
     for (int idx = 0; idx < graphs_.size(); idx++)
       quantizers_.push_back(New<ModelQuantizer>(options_));
+
+    // simulate the int8 quantization of the affine inputs as well
+    if(options_->get<bool>("quantize-intgemm", false))
+      for(auto graph : graphs_)
+        graph->setQuantizeActivations(true);
     
     comm_->foreach([&](size_t idx, size_t /*begin*/, size_t /*end*/) { 
       quantizers_[idx]->quantize(graphs_[idx]); return true; 
@@ -6,6 +6,9 @@
 #include "data/shortlist.h"
 #include "common/utils.h"
 
+#include <algorithm>
+#include <numeric>
+
 namespace marian {
 
 // combine new expandedPathScores and previous beams into new set of beams
@@ -20,7 +23,7 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
                          const std::vector<bool>& dropBatchEntries, // [origDimBatch] - empty source batch entries are marked with true, should be cleared after first use.
                          const std::vector<IndexType>& batchIdxMap) const { // [origBatchIdx -> currentBatchIdx]
   std::vector<float> align; // collects alignment information from the last executed time step
-  if(options_->hasAndNotEmpty("alignment") && factorGroup == 0)
+  if(alignment_ && factorGroup == 0)
     align = scorers_[0]->getAlignment(); // [beam depth * max src length * current batch size] -> P(s|t); use alignments from the first scorer, even if ensemble,
 
   const auto origDimBatch = beams.size(); // see function search for definition of origDimBatch and currentDimBatch etc.
@@ -115,14 +118,14 @@ Beams BeamSearch::toHyps(const std::vector<unsigned int>& nBestKeys, // [current
       }
     }
     else if (shortlist)
-      word = Word::fromWordIndex(shortlist->reverseMap((int) prevBeamHypIdx, (int) origBatchIdx, wordIdx));
+      word = Word::fromWordIndex(shortlist->reverseMap((int) prevBeamHypIdx, (int) currentBatchIdx, wordIdx));
     else
       word = Word::fromWordIndex(wordIdx);
 
     auto hyp = Hypothesis::New(prevHyp, word, prevBeamHypIdx, pathScore);
 
     // Set score breakdown for n-best lists
-    if(options_->get<bool>("n-best")) {
+    if(nBest_) {
       auto breakDown = beam[beamHypIdx]->getScoreBreakdown();
       ABORT_IF(factoredVocab && factorGroup > 0 && !factoredVocab->canExpandFactoredWord(word, factorGroup),
                "A word without this factor snuck through to here??");
@@ -246,6 +249,96 @@ Beams BeamSearch::purgeBeams(const Beams& beams, /*in/out=*/std::vector<IndexTyp
   return newBeams;
 }
 
+// Top-N selection for the lemma step of factored decoding. The final score of a lemma is its path score plus the maxima
+// of all secondary factor groups the lemma has (see Logits::getFactoredLogits(0)), which would otherwise be added to all
+// lemmas of all hypotheses in every step. Here, scores hold the path scores with the plain lemma log probs, and the maxima
+// are only added to candidates. The candidates are the lemmas with the largest upper bound of their final score (path
+// score plus all positive maxima of the hypothesis); the candidate set is doubled until no other lemma can beat the N-th
+// best final score. The result is the same as selecting among all lemmas with the maxima added.
+void BeamSearch::getNBestListLazyFactors(Tensor scores,
+                                         const std::vector<Tensor>& factorMaxima,
+                                         const std::vector<float>& weights,
+                                         Ptr<FactoredVocab> factoredVocab,
+                                         Ptr<data::Shortlist> shortlist,
+                                         size_t N,
+                                         std::vector<float>& outPathScores,
+                                         std::vector<unsigned>& outKeys) {
+  const size_t vocabSize = scores->shape()[-1];
+  const size_t inputN    = scores->shape()[-2];
+  const size_t dimBatch  = scores->shape()[-4];
+  const size_t rowSize   = inputN * vocabSize;
+  const size_t numGroups = factoredVocab->getNumGroups();
+  const size_t lemmaOffset = factoredVocab->getGroupRange(0).first;
+
+  std::vector<std::vector<float>> maxima(factorMaxima.size()); // [scorer][(beamHypIdx, batchIdx, group - 1) flattened]
+  std::vector<size_t> maximaBeamSize(factorMaxima.size());     // [scorer] 1 if the maxima broadcast over the beam
+  for(size_t i = 0; i < factorMaxima.size(); ++i) {
+    const auto& shape = factorMaxima[i]->shape();
+    ABORT_IF((shape[-4] != inputN && shape[-4] != 1) || shape[-2] != dimBatch || shape[-1] != numGroups - 1,
+             "Unexpected shape of factor maxima {}", shape);
+    maximaBeamSize[i] = shape[-4];
+    factorMaxima[i]->get(maxima[i]);
+  }
+
+  std::vector<unsigned> idxs(rowSize); // re-used for each batch entry
+  std::vector<float> bounds(inputN);   // [beamHypIdx] sum of the positive maxima
+  std::vector<std::pair<float, unsigned>> candidates;
+
+  for(size_t batchIdx = 0; batchIdx < dimBatch; ++batchIdx) {
+    const float* row = scores->data() + batchIdx * rowSize;
+
+    auto maximum = [&](size_t i, size_t beamHypIdx, size_t g) {
+      return maxima[i][((beamHypIdx % maximaBeamSize[i]) * dimBatch + batchIdx) * (numGroups - 1) + g - 1];
+    };
+    for(size_t beamHypIdx = 0; beamHypIdx < inputN; ++beamHypIdx) {
+      bounds[beamHypIdx] = 0.f;
+      for(size_t i = 0; i < maxima.size(); ++i)
+        for(size_t g = 1; g < numGroups; ++g)
+          bounds[beamHypIdx] += weights[i] * std::max(maximum(i, beamHypIdx, g), 0.f);
+    }
+
+    auto upperBound = [&](unsigned idx) { return row[idx] + bounds[idx / vocabSize]; };
+    auto finalScore = [&](unsigned idx) {
+      size_t beamHypIdx = idx / vocabSize;
+      size_t wordIdx = idx % vocabSize;
+      size_t lemma = shortlist ? shortlist->reverseMap((int)beamHypIdx, (int)batchIdx, (int)wordIdx) - lemmaOffset : wordIdx;
+      float score = row[idx];
+      for(size_t i = 0; i < maxima.size(); ++i) {
+        float factors = 0.f;
+        for(size_t g = 1; g < numGroups; ++g)
+          if(factoredVocab->lemmaHasFactorGroup(lemma, g))
+            factors += maximum(i, beamHypIdx, g);
+        score += weights[i] * factors;
+      }
+      return score;
+    };
+
+    std::iota(idxs.begin(), idxs.end(), 0);
+    size_t numCandidates = std::min(2 * N, rowSize);
+    for(;;) {
+      if(numCandidates < rowSize)
+        std::nth_element(idxs.begin(), idxs.begin() + numCandidates, idxs.end(),
+                         [&](unsigned a, unsigned b) { return upperBound(a) > upperBound(b); });
+
+      candidates.clear();
+      for(size_t k = 0; k < numCandidates; ++k)
+        candidates.emplace_back(finalScore(idxs[k]), idxs[k]);
+      std::partial_sort(candidates.begin(), candidates.begin() + N, candidates.end(),
+                        [](const std::pair<float, unsigned>& a, const std::pair<float, unsigned>& b) { return a.first > b.first; });
+
+      // idxs[numCandidates] has the largest upper bound of all lemmas that are not candidates
+      if(numCandidates == rowSize || upperBound(idxs[numCandidates]) <= candidates[N - 1].first)
+        break;
+      numCandidates = std::min(2 * numCandidates, rowSize);
+    }
+
+    for(size_t k = 0; k < N; ++k) {
+      outKeys.push_back((unsigned)(candidates[k].second + batchIdx * rowSize));
+      outPathScores.push_back(candidates[k].first);
+    }
+  }
+}
+
 //**********************************************************************
 // main decoding function
 Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch> batch) {
@@ -261,6 +354,14 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
 
   auto getNBestList = createGetNBestListFn(beamSize_, origDimBatch, graph->getDeviceId());
 
+  // On the CPU, the maxima of the secondary factors are only added to the lemmas that can make it into the beam
+  // (see getNBestListLazyFactors()) instead of to all lemmas of all hypotheses.
+  bool lazyFactors = factoredVocab && graph->getDeviceId().type == DeviceType::cpu;
+  std::vector<Expr> factorMaxima(scorers_.size());
+  std::vector<float> scorerWeights;
+  for(auto scorer : scorers_)
+    scorerWeights.push_back(scorer->getWeight());
+
   for(auto scorer : scorers_) {
     scorer->clear(graph);
   }
@@ -269,8 +370,8 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
   for(int i = 0; i < origDimBatch; ++i) {
     size_t sentId = batch->getSentenceIds()[i];
     histories[i] = New<History>(sentId,
-                                options_->get<float>("normalize"),
-                                options_->get<float>("word-penalty"));
+                                normalize_,
+                                wordPenalty_);
   }
 
   // start states
@@ -311,6 +412,10 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
                                         return shortlist->tryForwardMap(i) == data::Shortlist::npos;
                                       }),
                        suppressed.end());
+    // the scores of a static shortlist are indexed by the position in the shortlist, not the word index
+    if(shortlist && !shortlist->isDynamic())
+      for(auto& wIdx : suppressed)
+        wIdx = shortlist->tryForwardMap(wIdx);
     
     if(!suppressed.empty())
       suppressedWordIndices = graph->indices(suppressed);
@@ -430,6 +535,9 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
           states[i] = scorers_[i]->step(graph, states[i], hypIndices, prevWords, batchIndices, (int)maxBeamSize);
           if (numFactorGroups == 1) { // @TODO: this branch can go away
             logProbs = states[i]->getLogProbs().getLogits(); // [maxBeamSize, 1, currentDimBatch, dimVocab]
+          } else if (lazyFactors) {
+            logProbs = states[i]->getLogProbs().getLemmaLogits();          // [maxBeamSize, 1, currentDimBatch, dimVocab]
+            factorMaxima[i] = states[i]->getLogProbs().getFactorMaxima();  // [maxBeamSize, 1, currentDimBatch, numGroups - 1]
           } else {
             auto shortlist = scorers_[i]->getShortlist();
             logProbs = states[i]->getLogProbs().getFactoredLogits(factorGroup, shortlist); // [maxBeamSize, 1, currentDimBatch, dimVocab]
@@ -471,11 +579,20 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
       // find N best amongst the (maxBeamSize * dimVocab) hypotheses
       std::vector<unsigned int> nBestKeys; // [currentDimBatch, maxBeamSize] flattened -> (batchIdx, beamHypIdx, word idx) flattened
       std::vector<float> nBestPathScores;  // [currentDimBatch, maxBeamSize] flattened
-      getNBestList(/*in*/   expandedPathScores->val(),   // [currentDimBatch, 1, maxBeamSize, dimVocab or dimShortlist]
-                  /*N=*/    maxBeamSize,                 // desired beam size
-                  /*out*/   nBestPathScores,
-                   /*out*/  nBestKeys,
-                  /*first=*/t == 0 && factorGroup == 0); // @TODO: this is only used for checking presently, and should be removed altogether
+      if(lazyFactors && factorGroup == 0) {
+        std::vector<Tensor> factorMaximaTensors;
+        for(auto maxima : factorMaxima)
+          factorMaximaTensors.push_back(maxima->val());
+        getNBestListLazyFactors(expandedPathScores->val(), factorMaximaTensors, scorerWeights,
+                                factoredVocab, scorers_[0]->getShortlist(), maxBeamSize,
+                                nBestPathScores, nBestKeys);
+      } else {
+        getNBestList(/*in*/   expandedPathScores->val(),   // [currentDimBatch, 1, maxBeamSize, dimVocab or dimShortlist]
+                    /*N=*/    maxBeamSize,                 // desired beam size
+                    /*out*/   nBestPathScores,
+                     /*out*/  nBestKeys,
+                    /*first=*/t == 0 && factorGroup == 0); // @TODO: this is only used for checking presently, and should be removed altogether
+      }
       // Now, nBestPathScores contain N-best expandedPathScores for each batch and beam,
       // and nBestKeys for each their original location (batchIdx, beamHypIdx, word).
 
@@ -503,7 +620,7 @@ Histories BeamSearch::search(Ptr<ExpressionGraph> graph, Ptr<data::CorpusBatch>
     for(int batchIdx = 0; batchIdx < origDimBatch; ++batchIdx) {
       // if this batch entry has surviving hyps then add them to the traceback grid
       if(!beams[batchIdx].empty()) { // if the beam is not empty expand the history object associated with the beam
-        if (histories[batchIdx]->size() >= options_->get<float>("max-length-factor") * batch->front()->batchWidth())
+        if (histories[batchIdx]->size() >= maxLengthFactor_ * batch->front()->batchWidth())
           maxLengthReached = true;
         histories[batchIdx]->add(beams[batchIdx], trgEosId, purgedNewBeams[batchIdx].empty() || maxLengthReached);
       }
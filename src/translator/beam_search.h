@@ -16,6 +16,13 @@ private:
   const float INVALID_PATH_SCORE;
   const bool PURGE_BATCH = true; // @TODO: diagnostic, to-be-removed once confirmed there are no issues.
 
+  // options used per step or hypothesis, read once per search
+  const bool nBest_;
+  const bool alignment_;
+  const float maxLengthFactor_;
+  const float normalize_;
+  const float wordPenalty_;
+
   static float chooseInvalidPathScore(Ptr<Options> options) {
     auto prec = options->get<std::vector<std::string>>("precision", {"float32"});
     auto computeType = typeFromString(prec[0]);
@@ -25,7 +32,12 @@ private:
 public:
   BeamSearch(Ptr<Options> options, const std::vector<Ptr<Scorer>>& scorers, const Ptr<const Vocab> trgVocab)
       : options_(options), scorers_(scorers), beamSize_(options_->get<size_t>("beam-size")), trgVocab_(trgVocab),
-        INVALID_PATH_SCORE{chooseInvalidPathScore(options)}
+        INVALID_PATH_SCORE{chooseInvalidPathScore(options)},
+        nBest_{options_->get<bool>("n-best")},
+        alignment_{options_->hasAndNotEmpty("alignment")},
+        maxLengthFactor_{options_->get<float>("max-length-factor")},
+        normalize_{options_->get<float>("normalize")},
+        wordPenalty_{options_->get<float>("word-penalty")}
   {}
 
   // combine new expandedPathScores and previous beams into new set of beams
@@ -48,6 +60,16 @@ public:
       int origBatchIdx,
       int currentDimBatch) const;
 
+  // top-N selection for the lemma step of factored decoding on the CPU, adds the factor maxima only to the lemma candidates
+  static void getNBestListLazyFactors(Tensor scores,                          // [currentDimBatch, 1, beamSize or 1, dimVocab or dimShortlist]
+                                      const std::vector<Tensor>& factorMaxima, // [scorer][beamSize or 1, 1, currentDimBatch, numGroups - 1]
+                                      const std::vector<float>& weights,       // [scorer]
+                                      Ptr<class FactoredVocab/*const*/> factoredVocab,
+                                      Ptr<data::Shortlist> shortlist,
+                                      size_t N,
+                                      std::vector<float>& outPathScores,
+                                      std::vector<unsigned>& outKeys);
+
   // remove all beam entries that have reached EOS
   Beams purgeBeams(const Beams& beams, /*in/out=*/std::vector<IndexType>& batchIdxMap);
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <deque>
+#include <numeric>
 #include <string>
 
 #include "data/batch_generator.h"
@@ -9,6 +11,7 @@
 
 #include "common/scheduling_parameter.h"
 #include "common/timer.h"
+#include "graph/auto_tuner.h"
 
 #include "3rd_party/threadpool.h"
 
@@ -19,16 +22,103 @@
 #include "models/model_task.h"
 #include "translator/scorers.h"
 
-// currently for diagnostics only, will try to mmap files ending in *.bin suffix when enabled.
-// @TODO: add this as an actual feature.
-#define MMAP 0
-
-#if MMAP
-#include "3rd_party/mio/mio.hpp"
-#endif
-
 namespace marian {
 
+// With --model-mmap, memory-map all models, which have to be binarized. Otherwise returns no maps.
+static inline std::vector<mio::mmap_source> mmapModels(Ptr<Options> options) {
+  std::vector<mio::mmap_source> mmaps;
+  if(options->get<bool>("model-mmap", false)) {
+    for(auto model : options->get<std::vector<std::string>>("models")) {
+      marian::filesystem::Path modelPath(model);
+      ABORT_IF(modelPath.extension() != marian::filesystem::Path(".bin"),
+              "Non-binarized models cannot be mmapped");
+      mmaps.push_back(std::move(mio::mmap_source(model)));
+    }
+  }
+  return mmaps;
+}
+
+// Number of sentences in a full mini-batch of source sentences with the given length, as bounded by
+// --mini-batch and --mini-batch-words.
+static inline size_t fakeBatchSize(Ptr<Options> options, size_t length) {
+  size_t batchSize = (size_t)options->get<int>("mini-batch");
+  if(options->get<int>("mini-batch-words", 0) > 0)
+    batchSize = std::max((size_t)1, std::min(batchSize, (size_t)options->get<int>("mini-batch-words") / length));
+  return batchSize;
+}
+
+// Translate a synthetic batch of batchSize source sentences with the given length each.
+template <class Search>
+void translateFakeBatch(Ptr<ExpressionGraph> graph,
+                        const std::vector<Ptr<Scorer>>& scorers,
+                        Ptr<Options> options,
+                        const std::vector<Ptr<Vocab>>& srcVocabs,
+                        Ptr<const Vocab> trgVocab,
+                        size_t length,
+                        size_t batchSize) {
+  auto batch = data::CorpusBatch::fakeBatch(std::vector<size_t>(srcVocabs.size(), length), srcVocabs, batchSize, options);
+  std::vector<size_t> sentenceIds(batchSize);
+  std::iota(sentenceIds.begin(), sentenceIds.end(), 0);
+  batch->setSentenceIds(sentenceIds);
+
+  auto search = New<Search>(options, scorers, trgVocab);
+  search->search(graph, batch);
+}
+
+// Translate a synthetic batch of the largest configured size with source sentences of the given length
+// and replace the workspace of the graph by the measured high-water mark plus a margin for the
+// allocation granularity (--auto-workspace).
+template <class Search>
+void calibrateWorkspace(Ptr<ExpressionGraph> graph,
+                        const std::vector<Ptr<Scorer>>& scorers,
+                        Ptr<Options> options,
+                        const std::vector<Ptr<Vocab>>& srcVocabs,
+                        Ptr<const Vocab> trgVocab,
+                        size_t length) {
+  size_t batchSize = fakeBatchSize(options, length);
+
+  graph->resetWorkspaceStats();
+  translateFakeBatch<Search>(graph, scorers, options, srcVocabs, trgVocab, length, batchSize);
+  auto stats = graph->getWorkspaceStats();
+
+  // the extent also covers the padding of size classes and fragmentation, unlike the peak of allocated bytes
+  size_t bytes = stats.extent + stats.extent / 10;
+  LOG(info,
+      "[memory] Calibrated workspace on {} with {} sentences of {} tokens: peak {:.2f} MB allocated, "
+      "{:.2f} MB used, using {:.2f} MB",
+      graph->getDeviceId(), batchSize, length, stats.peak / (1024.f * 1024.f),
+      stats.extent / (1024.f * 1024.f), bytes / (1024.f * 1024.f));
+  graph->clear();
+  graph->resizeWorkspace(bytes);
+}
+
+// Translate synthetic batches with source sentences of each of the given lengths, once as a single
+// sentence and once as a full mini-batch. Whatever the first batches would set up lazily (workspace
+// growth, intgemm dispatch and prepared matrices, cached parameters, shortlists, auto-tuning decisions)
+// then happens before the first real input arrives.
+template <class Search>
+void warmup(Ptr<ExpressionGraph> graph,
+            const std::vector<Ptr<Scorer>>& scorers,
+            Ptr<Options> options,
+            const std::vector<Ptr<Vocab>>& srcVocabs,
+            Ptr<const Vocab> trgVocab,
+            const std::vector<size_t>& lengths) {
+  timer::Timer timer;
+  for(auto length : lengths) {
+    ABORT_IF(length == 0, "--warmup lengths need to be larger than 0");
+    size_t batchSize = fakeBatchSize(options, length);
+
+    std::vector<size_t> batchSizes = {1};
+    if(batchSize > 1)
+      batchSizes.push_back(batchSize);
+
+    for(auto size : batchSizes)
+      translateFakeBatch<Search>(graph, scorers, options, srcVocabs, trgVocab, length, size);
+  }
+  LOG(info, "[warmup] Ready on {} after warm-up with source lengths {} in {:.2f}s",
+      graph->getDeviceId(), utils::join(lengths, ","), timer.elapsed());
+}
+
 template <class Search>
 class Translate : public ModelTask {
 private:
@@ -42,9 +132,7 @@ private:
 
   size_t numDevices_;
 
-#if MMAP
   std::vector<mio::mmap_source> mmaps_;
-#endif
 
 public:
   Translate(Ptr<Options> options)
@@ -65,7 +153,7 @@ public:
     std::vector<int> lshOpts = options_->get<std::vector<int>>("output-approx-knn", {});
     ABORT_IF(lshOpts.size() != 0 && lshOpts.size() != 2, "--output-approx-knn takes 2 parameters");
 
-    if (lshOpts.size() == 2 || options_->hasAndNotEmpty("shortlist")) {
+    if (lshOpts.size() == 2 || options_->hasAndNotEmpty("output-hnsw") || options_->hasAndNotEmpty("shortlist")) {
       shortlistGenerator_ = data::createShortlistGenerator(options_, srcVocab, trgVocab_, lshOpts, 0, 1, vocabs.front() == vocabs.back());
     }
 
@@ -76,19 +164,12 @@ public:
     scorers_.resize(numDevices_);
     graphs_.resize(numDevices_);
 
-#if MMAP
-    auto models = options->get<std::vector<std::string>>("models");
-    for(auto model : models) {
-      marian::filesystem::Path modelPath(model);
-      ABORT_IF(modelPath.extension() != marian::filesystem::Path(".bin"),
-              "Non-binarized models cannot be mmapped");
-      mmaps_.push_back(std::move(mio::mmap_source(model)));
-    }
-#endif
+    mmaps_ = mmapModels(options_);
 
     size_t id = 0;
     for(auto device : devices) {
       auto task = [&](DeviceId device, size_t id) {
+        timer::Timer timer;
         auto graph = New<ExpressionGraph>(true);
         auto prec = options_->get<std::vector<std::string>>("precision", {"float32"});
         graph->setDefaultElementType(typeFromString(prec[0]));
@@ -97,15 +178,14 @@ public:
           graph->getBackend()->setOptimized(options_->get<bool>("optimize"));
           graph->getBackend()->setGemmType(options_->get<std::string>("gemm-type"));
           graph->getBackend()->setQuantizeRange(options_->get<float>("quantize-range"));
+          if(!options_->get<std::string>("autotune-cache", "").empty())
+            AutoTunerCache::load(options_->get<std::string>("autotune-cache"));
         }
+        graph->setWorkspaceAllocationStrategy(allocationStrategyFromString(options_->get<std::string>("allocator", "first-fit")));
         graph->reserveWorkspaceMB(options_->get<size_t>("workspace"));
         graphs_[id] = graph;
 
-#if MMAP
-        auto scorers = createScorers(options_, mmaps_);
-#else
-        auto scorers = createScorers(options_);
-#endif
+        auto scorers = mmaps_.empty() ? createScorers(options_) : createScorers(options_, mmaps_);
         for(auto scorer : scorers) {
           scorer->init(graph);
           if(shortlistGenerator_)
@@ -114,6 +194,15 @@ public:
 
         scorers_[id] = scorers;
         graph->forward();
+        LOG(info, "[load] Model(s) ready on {} in {:.2f}s", device, timer.elapsed());
+
+        if(options_->get<size_t>("auto-workspace", 0) > 0)
+          calibrateWorkspace<Search>(graph, scorers, options_, corpus_->getVocabs(), trgVocab_,
+                                     options_->get<size_t>("auto-workspace"));
+
+        auto warmupLengths = options_->get<std::vector<size_t>>("warmup", {});
+        if(!warmupLengths.empty())
+          warmup<Search>(graph, scorers, options_, corpus_->getVocabs(), trgVocab_, warmupLengths);
       };
 
       threadPool.enqueue(task, device, id++);
@@ -173,9 +262,17 @@ public:
 
     bool doNbest = options_->get<bool>("n-best");
 
+    // with --data-threads > 1, translations are decoded and printed on separate threads, so that
+    // the devices can continue with the next batch meanwhile
+    size_t dataThreads = options_->get<size_t>("data-threads", 1);
+    UPtr<ThreadPool> printPool(dataThreads > 1 ? new ThreadPool(dataThreads) : nullptr);
+    ThreadPool* printThreads = printPool.get();
+    std::mutex syncPrints;
+    std::deque<std::future<void>> prints; // printing tasks, get() rethrows their errors
+
     bg.prepare();
     for(auto batch : bg) {
-      auto task = [=, &syncCounts,
+      auto task = [=, &syncCounts, &syncPrints, &prints,
                       &totBatches, &totLines, &totSourceTokens, &totTimer, 
                       &curBatches, &curLines, &curSourceTokens, &curTimer](size_t id) {
         thread_local Ptr<ExpressionGraph> graph;
@@ -189,14 +286,30 @@ public:
         auto search = New<Search>(options_, scorers, trgVocab_);
         auto histories = search->search(graph, batch);
 
-        for(auto history : histories) {
-          std::stringstream best1;
-          std::stringstream bestn;
-          printer->print(history, best1, bestn);
-          collector->Write((long)history->getLineNum(),
-                           best1.str(),
-                           bestn.str(),
-                           doNbest);
+        auto print = [=](size_t begin, size_t end) {
+          for(size_t i = begin; i < end; ++i) {
+            std::stringstream best1;
+            std::stringstream bestn;
+            printer->print(histories[i], best1, bestn);
+            collector->Write((long)histories[i]->getLineNum(),
+                             best1.str(),
+                             bestn.str(),
+                             doNbest);
+          }
+        };
+
+        if(printThreads) { // the collector restores the order of the lines
+          size_t perThread = (histories.size() + printThreads->getNumThreads() - 1) / printThreads->getNumThreads();
+          std::lock_guard<std::mutex> lock(syncPrints);
+          for(size_t begin = 0; begin < histories.size(); begin += perThread)
+            prints.push_back(printThreads->enqueue(print, begin, std::min(begin + perThread, histories.size())));
+          // collect finished tasks, so that the queue does not grow with the input
+          while(!prints.empty() && prints.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            prints.front().get();
+            prints.pop_front();
+          }
+        } else {
+          print(0, histories.size());
         }
 
         // if we asked for speed information display this
@@ -230,6 +343,11 @@ public:
 
     // make sure threads are joined before other local variables get de-allocated
     threadPool.join_all();
+    for(auto& print : prints) // after the translation threads, which add the last printing tasks
+      print.get();
+    if(printPool)
+      printPool->join_all();
+    AutoTunerCache::flush();
     
     // display final speed numbers over total translation if intermediate displays were requested
     if(statFreq.n > 0) {
@@ -237,6 +355,13 @@ public:
       LOG(info, 
           "Processed {} batches, {} lines, {} source tokens in {:.2f}s - Speed (total): {:.2f} batches/s - {:.2f} lines/s - {:.2f} tokens/s", 
           totBatches, totLines, totSourceTokens, totTime, totBatches / totTime, totLines / totTime, totSourceTokens / totTime);
+
+      for(auto graph : graphs_) {
+        auto stats = graph->getWorkspaceStats();
+        LOG(info,
+            "[memory] Workspace on {}: peak {:.2f} MB of {:.2f} MB reserved - {} allocations - {} grow events - fragmentation {:.2f}",
+            graph->getDeviceId(), stats.peak / (1024.f * 1024.f), stats.capacity / (1024.f * 1024.f), stats.allocations, stats.growEvents, stats.fragmentation);
+      }
     }
   }
 };
@@ -254,8 +379,10 @@ private:
 
   size_t numDevices_;
 
+  std::vector<mio::mmap_source> mmaps_;
+
 public:
-  virtual ~TranslateService() {}
+  virtual ~TranslateService() { AutoTunerCache::flush(); }
 
   TranslateService(Ptr<Options> options)
     : options_(New<Options>(options->clone())) {
@@ -280,7 +407,7 @@ public:
     ABORT_IF(lshOpts.size() != 0 && lshOpts.size() != 2, "--output-approx-knn takes 2 parameters");
 
     // load lexical shortlist
-    if (lshOpts.size() == 2 || options_->hasAndNotEmpty("shortlist")) {
+    if (lshOpts.size() == 2 || options_->hasAndNotEmpty("output-hnsw") || options_->hasAndNotEmpty("shortlist")) {
         shortlistGenerator_ = data::createShortlistGenerator(options_, srcVocab, trgVocab_, lshOpts, 0, 1, vocabPaths.front() == vocabPaths.back());
     }
 
@@ -288,6 +415,8 @@ public:
     auto devices = Config::getDevices(options_);
     numDevices_ = devices.size();
 
+    mmaps_ = mmapModels(options_);
+
     // initialize scorers
     for(auto device : devices) {
       auto graph = New<ExpressionGraph>(true);
@@ -299,11 +428,14 @@ public:
         graph->getBackend()->setOptimized(options_->get<bool>("optimize"));
         graph->getBackend()->setGemmType(options_->get<std::string>("gemm-type"));
         graph->getBackend()->setQuantizeRange(options_->get<float>("quantize-range"));
+        if(!options_->get<std::string>("autotune-cache", "").empty())
+          AutoTunerCache::load(options_->get<std::string>("autotune-cache"));
       }
+      graph->setWorkspaceAllocationStrategy(allocationStrategyFromString(options_->get<std::string>("allocator", "first-fit")));
       graph->reserveWorkspaceMB(options_->get<size_t>("workspace"));
       graphs_.push_back(graph);
 
-      auto scorers = createScorers(options_);
+      auto scorers = mmaps_.empty() ? createScorers(options_) : createScorers(options_, mmaps_);
       for(auto scorer : scorers) {
         scorer->init(graph);
         if(shortlistGenerator_)
@@ -311,6 +443,20 @@ public:
       }
       scorers_.push_back(scorers);
     }
+
+    // size the workspaces and warm up all devices in parallel before the server starts listening
+    size_t autoWorkspace = options_->get<size_t>("auto-workspace", 0);
+    auto warmupLengths = options_->get<std::vector<size_t>>("warmup", {});
+    if(autoWorkspace > 0 || !warmupLengths.empty()) {
+      ThreadPool threadPool(numDevices_, numDevices_);
+      for(size_t id = 0; id < numDevices_; ++id)
+        threadPool.enqueue([=]() {
+          if(autoWorkspace > 0)
+            calibrateWorkspace<Search>(graphs_[id], scorers_[id], options_, srcVocabs_, trgVocab_, autoWorkspace);
+          if(!warmupLengths.empty())
+            warmup<Search>(graphs_[id], scorers_[id], options_, srcVocabs_, trgVocab_, warmupLengths);
+        });
+    }
   }
 
   std::string run(const std::string& input) override {